@@ -0,0 +1,12 @@
+# Settings shared by the benchmarks
+
+QT       += core gui testlib
+
+TEMPLATE = app
+CONFIG += console c++17
+CONFIG -= app_bundle
+
+LMPICK_SRC = $$PWD/../src
+INCLUDEPATH += $$LMPICK_SRC
+
+DEFINES += QT_DEPRECATED_WARNINGS
@@ -0,0 +1,14 @@
+# Benchmarks of the performance critical parts, they are built from the
+# sources of the application and run with the QtTest benchmark options, e.g.
+#
+#   qmake benchmarks/benchmarks.pro && make && landmarklist/bench_landmarklist -iterations 10
+
+TEMPLATE = subdirs
+
+SUBDIRS += \
+    landmarklist \
+    landmarklistio \
+    normalization \
+    numberformat \
+    raycast \
+    spheres
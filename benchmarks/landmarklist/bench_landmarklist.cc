@@ -0,0 +1,118 @@
+/* -*- mia-c++  -*-
+ *
+ * This file is part of qtlmpick- a tool for landmark picking and
+ * visualization in volume data
+ * Copyright (c) Genoa 2017,  Gert Wollny
+ *
+ * qtlmpick is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with MIA; if not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include "landmarklist.hh"
+
+#include <QtTest>
+#include <algorithm>
+#include <random>
+
+// the list size asked for by the performance requirements of the table view
+static const unsigned n_landmarks = 100000;
+
+class LandmarkListBenchmark : public QObject
+{
+        Q_OBJECT
+private slots:
+        void add();
+        void remove_random_names();
+        void remove_random_rows();
+        void lookup_names();
+};
+
+static PLandmarkList create_list(unsigned n)
+{
+        auto list = std::make_shared<LandmarkList>("benchmark");
+        for (unsigned i = 0; i < n; ++i)
+                list->add(std::make_shared<Landmark>(QString("landmark %1").arg(i)));
+        return list;
+}
+
+static std::vector<QString> get_shuffled_names(const LandmarkList& list)
+{
+        std::vector<QString> names;
+        names.reserve(list.size());
+        for (auto lm: list)
+                names.push_back(lm->getName());
+        std::shuffle(names.begin(), names.end(), std::mt19937(42));
+        return names;
+}
+
+void LandmarkListBenchmark::add()
+{
+        QBENCHMARK {
+                auto list = create_list(n_landmarks);
+                QCOMPARE(list->size(), size_t(n_landmarks));
+        }
+}
+
+void LandmarkListBenchmark::remove_random_names()
+{
+        auto list = create_list(n_landmarks);
+        auto names = get_shuffled_names(*list);
+
+        QBENCHMARK_ONCE {
+                for (auto& name: names)
+                        list->remove(name);
+        }
+        QCOMPARE(list->size(), size_t(0));
+}
+
+void LandmarkListBenchmark::remove_random_rows()
+{
+        auto list = create_list(n_landmarks);
+        const LandmarkList& rows = *list;
+        std::mt19937 rng(42);
+        int name_chars = 0;
+
+        // like deleting in the table view, which reads the rows afterwards
+        QBENCHMARK_ONCE {
+                while (rows.size() > 0) {
+                        unsigned row = std::uniform_int_distribution<unsigned>(0, rows.size() - 1)(rng);
+                        list->remove(row, 1);
+                        if (row < rows.size())
+                                name_chars += rows.at(row).getName().size();
+                }
+        }
+        QVERIFY(name_chars > 0);
+}
+
+void LandmarkListBenchmark::lookup_names()
+{
+        auto list = create_list(n_landmarks);
+        auto names = get_shuffled_names(*list);
+
+        // removing every other landmark leaves tombstones in the list
+        for (unsigned i = 0; i < names.size(); i += 2)
+                list->remove(names[i]);
+
+        unsigned found = 0;
+        QBENCHMARK {
+                found = 0;
+                for (auto& name: names)
+                        found += list->has(name) ? 1 : 0;
+        }
+        QCOMPARE(found, n_landmarks / 2);
+}
+
+QTEST_APPLESS_MAIN(LandmarkListBenchmark)
+
+#include "bench_landmarklist.moc"
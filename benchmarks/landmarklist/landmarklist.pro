@@ -0,0 +1,8 @@
+include(../benchmark.pri)
+
+TARGET = bench_landmarklist
+
+SOURCES += bench_landmarklist.cc \
+    $$LMPICK_SRC/landmarklist.cc \
+    $$LMPICK_SRC/landmark.cc \
+    $$LMPICK_SRC/camera.cc
@@ -0,0 +1,85 @@
+/* -*- mia-c++  -*-
+ *
+ * This file is part of qtlmpick- a tool for landmark picking and
+ * visualization in volume data
+ * Copyright (c) Genoa 2017,  Gert Wollny
+ *
+ * qtlmpick is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with MIA; if not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include "landmarklistio.hh"
+
+#include <QtTest>
+#include <QTemporaryDir>
+#include <random>
+
+static const unsigned n_landmarks = 10000;
+
+Q_DECLARE_METATYPE(ELandmarkParser)
+
+class LandmarkListIOBenchmark : public QObject
+{
+        Q_OBJECT
+private slots:
+        void initTestCase();
+        void read_data();
+        void read();
+private:
+        QTemporaryDir m_dir;
+        QString m_xml_file;
+};
+
+void LandmarkListIOBenchmark::initTestCase()
+{
+        QVERIFY(m_dir.isValid());
+
+        std::mt19937 rng(42);
+        std::uniform_real_distribution<float> coordinate(0.0f, 256.0f);
+
+        LandmarkList list("benchmark");
+        for (unsigned i = 0; i < n_landmarks; ++i) {
+                QVector3D location(coordinate(rng), coordinate(rng), coordinate(rng));
+                Camera camera(location + QVector3D(0, 0, 100), QQuaternion(), 1.0f);
+                auto lm = std::make_shared<Landmark>(QString("landmark %1").arg(i), location, 128.0f, camera);
+                lm->setTemplateImageFile(QString("landmark_%1.png").arg(i));
+                list.add(lm);
+        }
+
+        m_xml_file = m_dir.filePath("landmarks.lmx");
+        QVERIFY(write_landmarklist(m_xml_file, list, 2));
+}
+
+void LandmarkListIOBenchmark::read_data()
+{
+        QTest::addColumn<ELandmarkParser>("parser");
+
+        QTest::newRow("dom") << lp_dom;
+        QTest::newRow("stream") << lp_stream;
+}
+
+void LandmarkListIOBenchmark::read()
+{
+        QFETCH(ELandmarkParser, parser);
+
+        PLandmarkList list;
+        QBENCHMARK {
+                list = read_landmarklist(m_xml_file, parser);
+        }
+        QCOMPARE(list->size(), size_t(n_landmarks));
+}
+
+QTEST_GUILESS_MAIN(LandmarkListIOBenchmark)
+
+#include "bench_landmarklistio.moc"
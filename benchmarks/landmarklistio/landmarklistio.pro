@@ -0,0 +1,13 @@
+include(../benchmark.pri)
+
+QT += xml
+
+TARGET = bench_landmarklistio
+
+SOURCES += bench_landmarklistio.cc \
+    $$LMPICK_SRC/landmarklistio.cc \
+    $$LMPICK_SRC/landmarklistbinary.cc \
+    $$LMPICK_SRC/landmarklist.cc \
+    $$LMPICK_SRC/landmark.cc \
+    $$LMPICK_SRC/camera.cc \
+    $$LMPICK_SRC/qruntimeexeption.cc
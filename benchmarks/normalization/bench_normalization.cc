@@ -0,0 +1,132 @@
+/* -*- mia-c++  -*-
+ *
+ * This file is part of qtlmpick- a tool for landmark picking and
+ * visualization in volume data
+ * Copyright (c) Genoa 2017,  Gert Wollny
+ *
+ * qtlmpick is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with MIA; if not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include "intensitynormalization.hh"
+
+#include <QtTest>
+#include <QElapsedTimer>
+#include <QMap>
+
+static const unsigned volume_size = 256;
+static const int n_runs = 10;
+
+/* Evaluates the intensity range and converts the intensities to float for
+ * a synthetic volume, like it is done when a volume is loaded. */
+class NormalizationBenchmark : public QObject
+{
+        Q_OBJECT
+private slots:
+        void initTestCase();
+        void range_data();
+        void range();
+        void conversion_data();
+        void conversion();
+private:
+        void add_rows();
+        void report(const QElapsedTimer& timer, const mia::C3DImage& image);
+
+        QMap<int, mia::P3DImage> m_images;
+};
+
+template <typename T>
+static mia::P3DImage create_image(const mia::C3DBounds& size, unsigned period)
+{
+        auto image = new mia::T3DImage<T>(size);
+        auto v = image->begin();
+        for (unsigned z = 0; z < size.z; ++z)
+                for (unsigned y = 0; y < size.y; ++y)
+                        for (unsigned x = 0; x < size.x; ++x, ++v)
+                                *v = T((7 * x + 13 * y + 31 * z) % period);
+        return mia::P3DImage(image);
+}
+
+void NormalizationBenchmark::initTestCase()
+{
+        mia::C3DBounds size(volume_size, volume_size, volume_size);
+        m_images[mia::it_ubyte] = create_image<unsigned char>(size, 251);
+        m_images[mia::it_ushort] = create_image<unsigned short>(size, 4093);
+        m_images[mia::it_float] = create_image<float>(size, 4093);
+}
+
+void NormalizationBenchmark::add_rows()
+{
+        QTest::addColumn<int>("pixel_type");
+        QTest::newRow("ubyte") << int(mia::it_ubyte);
+        QTest::newRow("ushort") << int(mia::it_ushort);
+        QTest::newRow("float") << int(mia::it_float);
+}
+
+void NormalizationBenchmark::report(const QElapsedTimer& timer, const mia::C3DImage& image)
+{
+        double ms = double(timer.nsecsElapsed()) / (1e6 * n_runs);
+        auto size = image.get_size();
+        double voxels = double(size.x) * size.y * size.z;
+        qDebug() << "voxels/s:" << voxels / ms * 1000.0;
+        QTest::setBenchmarkResult(ms, QTest::WalltimeMilliseconds);
+}
+
+void NormalizationBenchmark::range_data()
+{
+        add_rows();
+}
+
+void NormalizationBenchmark::range()
+{
+        QFETCH(int, pixel_type);
+        const auto& image = *m_images[pixel_type];
+        auto progress = [](float) {};
+
+        std::pair<float, float> range;
+        QElapsedTimer timer;
+        timer.start();
+        for (int i = 0; i < n_runs; ++i)
+                range = get_intensity_range(image, progress);
+        report(timer, image);
+
+        QCOMPARE(range.first, 0.0f);
+        QVERIFY(range.second > 0.0f);
+}
+
+void NormalizationBenchmark::conversion_data()
+{
+        add_rows();
+}
+
+void NormalizationBenchmark::conversion()
+{
+        QFETCH(int, pixel_type);
+        const auto& image = *m_images[pixel_type];
+        auto progress = [](float) {};
+
+        mia::P3DImage result;
+        QElapsedTimer timer;
+        timer.start();
+        for (int i = 0; i < n_runs; ++i)
+                result = normalize_intensities(image, 1.0f / 4096.0f, 0.0f, progress);
+        report(timer, image);
+
+        QCOMPARE(result->get_pixel_type(), mia::it_float);
+        QCOMPARE(result->get_size(), image.get_size());
+}
+
+QTEST_APPLESS_MAIN(NormalizationBenchmark)
+
+#include "bench_normalization.moc"
@@ -0,0 +1,9 @@
+include(../benchmark.pri)
+
+CONFIG += link_pkgconfig
+PKGCONFIG += miamesh-2.4
+
+TARGET = bench_normalization
+
+SOURCES += bench_normalization.cc \
+    $$LMPICK_SRC/intensitynormalization.cc
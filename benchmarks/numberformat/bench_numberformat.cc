@@ -0,0 +1,125 @@
+/* -*- mia-c++  -*-
+ *
+ * This file is part of qtlmpick- a tool for landmark picking and
+ * visualization in volume data
+ * Copyright (c) Genoa 2017,  Gert Wollny
+ *
+ * qtlmpick is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with MIA; if not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include "numberformat.hh"
+
+#include <QtTest>
+#include <QTextStream>
+#include <QStringList>
+#include <random>
+#include <vector>
+
+static const int n_vectors = 10000;
+
+/* Formats and parses the coordinate triples as written to the landmark
+ * list files, compared to QTextStream and QString::split with toFloat
+ * that were used before. */
+class NumberFormatBenchmark : public QObject
+{
+        Q_OBJECT
+private slots:
+        void initTestCase();
+        void format_to_chars();
+        void format_text_stream();
+        void parse_from_chars();
+        void parse_split();
+private:
+        std::vector<float> m_values;
+        std::vector<QByteArray> m_latin1;
+        QStringList m_strings;
+};
+
+void NumberFormatBenchmark::initTestCase()
+{
+        std::mt19937 rng(42);
+        std::uniform_real_distribution<float> coordinate(0.0f, 256.0f);
+        m_values.resize(3 * n_vectors);
+        for (auto& v: m_values)
+                v = coordinate(rng);
+
+        char buffer[128];
+        for (int i = 0; i < n_vectors; ++i) {
+                char *end = format_numbers(buffer, buffer + sizeof(buffer), &m_values[3 * i], 3);
+                QVERIFY(end);
+                m_latin1.push_back(QByteArray(buffer, end - buffer));
+                m_strings.append(QString::fromLatin1(m_latin1.back()));
+        }
+}
+
+void NumberFormatBenchmark::format_to_chars()
+{
+        char buffer[128];
+        int length = 0;
+        QBENCHMARK {
+                length = 0;
+                for (int i = 0; i < n_vectors; ++i)
+                        length += format_numbers(buffer, buffer + sizeof(buffer), &m_values[3 * i], 3) - buffer;
+        }
+        QVERIFY(length > 0);
+}
+
+void NumberFormatBenchmark::format_text_stream()
+{
+        int length = 0;
+        QBENCHMARK {
+                length = 0;
+                for (int i = 0; i < n_vectors; ++i) {
+                        QString s;
+                        QTextStream ts(&s);
+                        ts << m_values[3 * i] << " " << m_values[3 * i + 1] << " " << m_values[3 * i + 2];
+                        ts.flush();
+                        length += s.size();
+                }
+        }
+        QVERIFY(length > 0);
+}
+
+void NumberFormatBenchmark::parse_from_chars()
+{
+        float v[3];
+        float sum = 0.0f;
+        QBENCHMARK {
+                sum = 0.0f;
+                for (auto& text: m_latin1) {
+                        QCOMPARE(parse_numbers(text.constData(), text.constData() + text.size(), v, 3), 3);
+                        sum += v[0] + v[1] + v[2];
+                }
+        }
+        QVERIFY(sum > 0.0f);
+}
+
+void NumberFormatBenchmark::parse_split()
+{
+        float sum = 0.0f;
+        QBENCHMARK {
+                sum = 0.0f;
+                for (auto& text: m_strings) {
+                        QStringList v = text.split(" ");
+                        QCOMPARE(v.size(), 3);
+                        sum += v.at(0).toFloat() + v.at(1).toFloat() + v.at(2).toFloat();
+                }
+        }
+        QVERIFY(sum > 0.0f);
+}
+
+QTEST_APPLESS_MAIN(NumberFormatBenchmark)
+
+#include "bench_numberformat.moc"
@@ -0,0 +1,5 @@
+include(../benchmark.pri)
+
+TARGET = bench_numberformat
+
+SOURCES += bench_numberformat.cc
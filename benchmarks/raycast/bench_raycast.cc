@@ -0,0 +1,171 @@
+/* -*- mia-c++  -*-
+ *
+ * This file is part of qtlmpick- a tool for landmark picking and
+ * visualization in volume data
+ * Copyright (c) Genoa 2017,  Gert Wollny
+ *
+ * qtlmpick is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with MIA; if not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include "volumedata.hh"
+#include "gpuprofiler.hh"
+
+#include <QtTest>
+#include <QOffscreenSurface>
+#include <QOpenGLContext>
+#include <QOpenGLFramebufferObject>
+#include <QSurfaceFormat>
+#include <cmath>
+#include <memory>
+#include <vector>
+
+static const unsigned volume_size = 256;
+static const float blob_period = 32.0f;
+static const float iso_value = 160.0f;
+static const int n_warmup_frames = 10;
+static const int n_frames = 100;
+static const QSize viewport_size(1024, 1024);
+
+/* Ray casts a volume filled with blobs, so that nearly every ray hits
+ * the iso-surface, with the normals evaluated in the shader and read
+ * from the gradient volume. The reported time is the mean GPU time of
+ * the ray casting stage as measured by the GpuProfiler. */
+class RaycastBenchmark : public QObject
+{
+        Q_OBJECT
+private slots:
+        void initTestCase();
+        void cleanupTestCase();
+        void draw_data();
+        void draw();
+private:
+        QOffscreenSurface m_surface;
+        QOpenGLContext m_context;
+        std::unique_ptr<QOpenGLFramebufferObject> m_target;
+        PVolumeData m_volume;
+        GlobalSceneState m_state;
+};
+
+static mia::P3DImage create_blobs(unsigned n)
+{
+        std::vector<float> wave(n);
+        for (unsigned i = 0; i < n; ++i)
+                wave[i] = std::sin(2.0f * float(M_PI) * i / blob_period);
+
+        auto image = new mia::C3DUBImage(mia::C3DBounds(n, n, n));
+        auto v = image->begin();
+        for (unsigned z = 0; z < n; ++z)
+                for (unsigned y = 0; y < n; ++y)
+                        for (unsigned x = 0; x < n; ++x, ++v)
+                                *v = static_cast<unsigned char>(127.5f + 127.5f * wave[x] * wave[y] * wave[z]);
+        return mia::P3DImage(image);
+}
+
+void RaycastBenchmark::initTestCase()
+{
+        // the same format as the application
+        QSurfaceFormat format;
+        format.setDepthBufferSize(32);
+        format.setVersion(3, 3);
+        format.setRenderableType(QSurfaceFormat::OpenGL);
+        format.setProfile(QSurfaceFormat::CoreProfile);
+
+        m_surface.setFormat(format);
+        m_surface.create();
+        m_context.setFormat(format);
+        if (!m_context.create() || !m_context.makeCurrent(&m_surface))
+                QSKIP("Unable to create an OpenGL context");
+
+        m_target.reset(new QOpenGLFramebufferObject(viewport_size, QOpenGLFramebufferObject::CombinedDepthStencil));
+
+        m_volume = std::make_shared<VolumeData>(create_blobs(volume_size));
+        m_volume->create_gradient_volume();
+        m_volume->attach_gl(&m_context);
+        m_volume->resize_viewport(viewport_size);
+        m_volume->set_iso_value(iso_value);
+
+        // the quality of the converged on-screen image
+        m_volume->set_sampling(0.5f, 4);
+
+        m_state.viewport = viewport_size;
+        m_state.update_projection();
+}
+
+void RaycastBenchmark::cleanupTestCase()
+{
+        if (m_volume && m_context.makeCurrent(&m_surface)) {
+                m_volume->detach_gl();
+                m_volume.reset();
+                m_target.reset();
+                m_context.doneCurrent();
+        }
+}
+
+void RaycastBenchmark::draw_data()
+{
+        QTest::addColumn<bool>("gradient_volume");
+
+        QTest::newRow("shader normals") << false;
+        QTest::newRow("gradient volume") << true;
+}
+
+void RaycastBenchmark::draw()
+{
+        QFETCH(bool, gradient_volume);
+
+        auto gl = m_context.functions();
+        m_volume->set_use_gradient_volume(gradient_volume);
+
+        GpuProfiler profiler;
+        if (!profiler.attach_gl())
+                QSKIP("Timer queries are not supported");
+
+        m_target->bind();
+        for (int i = 0; i < n_warmup_frames + n_frames; ++i) {
+                // the first frames upload the gradient texture
+                if (i == n_warmup_frames)
+                        m_volume->set_gpu_profiler(&profiler);
+
+                // an unchanged view would be taken from the render cache,
+                // so the iso value alternates by half an intensity step
+                m_volume->set_iso_value(iso_value + 0.5f * (i & 1));
+
+                gl->glViewport(0, 0, viewport_size.width(), viewport_size.height());
+                gl->glClearColor(0.1,0.1,0.1,1);
+                gl->glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+                gl->glEnable(GL_DEPTH_TEST);
+                gl->glDepthFunc(GL_LESS);
+                gl->glDepthMask(GL_TRUE);
+
+                m_volume->draw(m_state);
+
+                // waiting for each frame makes sure that every query result is read
+                gl->glFinish();
+                profiler.collect();
+        }
+        m_target->release();
+        m_volume->set_gpu_profiler(nullptr);
+
+        auto stats = profiler.get_statistics()[GpuProfiler::gs_raycast];
+        profiler.detach_gl();
+
+        QVERIFY(stats.samples > 0);
+        qDebug() << "GPU time of the ray casting in ms: min" << stats.min_ms << "max" << stats.max_ms;
+        QTest::setBenchmarkResult(stats.mean_ms, QTest::WalltimeMilliseconds);
+}
+
+QTEST_MAIN(RaycastBenchmark)
+
+#include "bench_raycast.moc"
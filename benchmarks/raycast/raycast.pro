@@ -0,0 +1,21 @@
+include(../benchmark.pri)
+
+QT += opengl
+
+CONFIG += link_pkgconfig
+PKGCONFIG += miamesh-2.4
+
+TARGET = bench_raycast
+
+SOURCES += bench_raycast.cc \
+    $$LMPICK_SRC/volumedata.cc \
+    $$LMPICK_SRC/intensitynormalization.cc \
+    $$LMPICK_SRC/volumepager.cc \
+    $$LMPICK_SRC/rendertargetpool.cc \
+    $$LMPICK_SRC/qruntimeexeption.cc \
+    $$LMPICK_SRC/drawable.cc \
+    $$LMPICK_SRC/gpuprofiler.cc \
+    $$LMPICK_SRC/globalscenestate.cc \
+    $$LMPICK_SRC/camera.cc
+
+RESOURCES += ../../lmpick.qrc
@@ -0,0 +1,155 @@
+/* -*- mia-c++  -*-
+ *
+ * This file is part of qtlmpick- a tool for landmark picking and
+ * visualization in volume data
+ * Copyright (c) Genoa 2017,  Gert Wollny
+ *
+ * qtlmpick is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with MIA; if not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include "landmarklistpainter.hh"
+#include "gpuprofiler.hh"
+
+#include <QtTest>
+#include <QOffscreenSurface>
+#include <QOpenGLContext>
+#include <QOpenGLFramebufferObject>
+#include <QSurfaceFormat>
+#include <memory>
+#include <random>
+
+static const unsigned n_landmarks = 10000;
+static const int n_warmup_frames = 10;
+static const int n_frames = 100;
+static const QSize viewport_size(1024, 1024);
+
+/* Draws 10^4 landmarks as instanced sphere meshes and as ray cast
+ * impostors. The reported time is the mean GPU time of the landmark
+ * stage as measured by the GpuProfiler, not the wall time. */
+class SphereBenchmark : public QObject
+{
+        Q_OBJECT
+private slots:
+        void initTestCase();
+        void cleanupTestCase();
+        void draw_data();
+        void draw();
+private:
+        QOffscreenSurface m_surface;
+        QOpenGLContext m_context;
+        std::unique_ptr<QOpenGLFramebufferObject> m_target;
+        std::unique_ptr<LandmarkListPainter> m_painter;
+        GlobalSceneState m_state;
+};
+
+void SphereBenchmark::initTestCase()
+{
+        // the same format as the application
+        QSurfaceFormat format;
+        format.setDepthBufferSize(32);
+        format.setVersion(3, 3);
+        format.setRenderableType(QSurfaceFormat::OpenGL);
+        format.setProfile(QSurfaceFormat::CoreProfile);
+
+        m_surface.setFormat(format);
+        m_surface.create();
+        m_context.setFormat(format);
+        if (!m_context.create() || !m_context.makeCurrent(&m_surface))
+                QSKIP("Unable to create an OpenGL context");
+
+        m_target.reset(new QOpenGLFramebufferObject(viewport_size, QOpenGLFramebufferObject::CombinedDepthStencil));
+
+        std::mt19937 rng(42);
+        std::uniform_real_distribution<float> coordinate(0.0f, 256.0f);
+        auto list = std::make_shared<LandmarkList>("benchmark");
+        for (unsigned i = 0; i < n_landmarks; ++i) {
+                QVector3D location(coordinate(rng), coordinate(rng), coordinate(rng));
+                list->add(std::make_shared<Landmark>(QString("landmark %1").arg(i), location, 128.0f, Camera()));
+        }
+
+        m_painter.reset(new LandmarkListPainter);
+        m_painter->attach_gl(&m_context);
+        if (Drawable::get_shader_version() < 330)
+                QSKIP("Instancing and impostors need GLSL 3.30");
+
+        // the landmarks are fit into the view like without a volume
+        m_painter->set_landmark_list(list);
+
+        m_state.viewport = viewport_size;
+        m_state.update_projection();
+}
+
+void SphereBenchmark::cleanupTestCase()
+{
+        if (m_painter && m_context.makeCurrent(&m_surface)) {
+                m_painter->detach_gl();
+                m_painter.reset();
+                m_target.reset();
+                m_context.doneCurrent();
+        }
+}
+
+void SphereBenchmark::draw_data()
+{
+        QTest::addColumn<bool>("impostors");
+
+        QTest::newRow("instanced mesh") << false;
+        QTest::newRow("impostors") << true;
+}
+
+void SphereBenchmark::draw()
+{
+        QFETCH(bool, impostors);
+
+        auto gl = m_context.functions();
+        m_painter->set_use_impostors(impostors);
+
+        GpuProfiler profiler;
+        if (!profiler.attach_gl())
+                QSKIP("Timer queries are not supported");
+
+        m_target->bind();
+        for (int i = 0; i < n_warmup_frames + n_frames; ++i) {
+                // the first frames create the buffers of the instances
+                if (i == n_warmup_frames)
+                        m_painter->set_gpu_profiler(&profiler);
+
+                gl->glViewport(0, 0, viewport_size.width(), viewport_size.height());
+                gl->glClearColor(0.1,0.1,0.1,1);
+                gl->glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+                gl->glEnable(GL_DEPTH_TEST);
+                gl->glDepthFunc(GL_LESS);
+                gl->glDepthMask(GL_TRUE);
+
+                m_painter->draw(m_state);
+
+                // waiting for each frame makes sure that every query result is read
+                gl->glFinish();
+                profiler.collect();
+        }
+        m_target->release();
+        m_painter->set_gpu_profiler(nullptr);
+
+        auto stats = profiler.get_statistics()[GpuProfiler::gs_landmarks];
+        profiler.detach_gl();
+
+        QVERIFY(stats.samples > 0);
+        qDebug() << "GPU time of the landmarks in ms: min" << stats.min_ms << "max" << stats.max_ms;
+        QTest::setBenchmarkResult(stats.mean_ms, QTest::WalltimeMilliseconds);
+}
+
+QTEST_MAIN(SphereBenchmark)
+
+#include "bench_spheres.moc"
@@ -0,0 +1,17 @@
+include(../benchmark.pri)
+
+QT += opengl
+
+TARGET = bench_spheres
+
+SOURCES += bench_spheres.cc \
+    $$LMPICK_SRC/landmarklistpainter.cc \
+    $$LMPICK_SRC/sphere.cc \
+    $$LMPICK_SRC/drawable.cc \
+    $$LMPICK_SRC/gpuprofiler.cc \
+    $$LMPICK_SRC/globalscenestate.cc \
+    $$LMPICK_SRC/camera.cc \
+    $$LMPICK_SRC/landmark.cc \
+    $$LMPICK_SRC/landmarklist.cc
+
+RESOURCES += ../../lmpick.qrc
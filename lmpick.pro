@@ -31,6 +31,7 @@ SOURCES += src/main.cc\
     src/globalscenestate.cc \
     src/drawable.cc \
     src/volumedata.cc \
+    src/intensitynormalization.cc \
     src/landmark.cc \
     src/camera.cc \
     src/landmarklist.cc \
@@ -41,7 +42,17 @@ SOURCES += src/main.cc\
     src/landmarktablemodel.cc \
     src/landmarktableview.cc \
     src/qruntimeexeption.cc \
-    src/aboutdialog.cc
+    src/aboutdialog.cc \
+    src/rendertargetpool.cc \
+    src/volumeloader.cc \
+    src/volumecache.cc \
+    src/volumepager.cc \
+    src/renderworker.cc \
+    src/offscreenrenderer.cc \
+    src/batchrenderer.cc \
+    src/snapshotwriter.cc \
+    src/gpuprofiler.cc \
+    src/landmarklistbinary.cc
 
 
 HEADERS  += src/mainwindow.hh \
@@ -50,6 +61,7 @@ HEADERS  += src/mainwindow.hh \
     src/globalscenestate.hh \
     src/drawable.hh \
     src/volumedata.hh \
+    src/intensitynormalization.hh \
     src/landmark.hh \
     src/camera.hh \
     src/landmarklist.hh \
@@ -61,7 +73,19 @@ HEADERS  += src/mainwindow.hh \
     src/landmarktablemodel.hh \
     src/landmarktableview.hh \
     src/qruntimeexeption.hh \
-    src/aboutdialog.hh
+    src/aboutdialog.hh \
+    src/rendertargetpool.hh \
+    src/volumeloader.hh \
+    src/parallel.hh \
+    src/volumecache.hh \
+    src/volumepager.hh \
+    src/renderworker.hh \
+    src/offscreenrenderer.hh \
+    src/batchrenderer.hh \
+    src/snapshotwriter.hh \
+    src/gpuprofiler.hh \
+    src/numberformat.hh \
+    src/landmarklistbinary.hh
 
 FORMS    += mainwindow.ui \
     src/aboutdialog.ui
@@ -82,6 +106,11 @@ DISTFILES += \
     shaders_330/volume_2nd_pass_frag.glsl \
     shaders_330/volume_blit_frag.glsl \
     shaders_330/shere_vtx.glsl \
+    shaders_330/shere_instanced_vtx.glsl \
+    shaders_330/shere_impostor_vtx.glsl \
+    shaders_330/shere_impostor_frag.glsl \
+    shaders_330/volume_raycast_frag.glsl \
+    shaders_330/volume_raycast_paged_frag.glsl \
     src/icons/auto_snapshot.png \
     src/icons/auto_snapshot_on.png \
     src/icons/document-open-volume.png \
@@ -94,6 +123,9 @@ RESOURCES += \
     lmpick.qrc
 
 CONFIG += link_pkgconfig
+
+# std::to_chars and std::from_chars for floats
+CONFIG += c++17
 PKGCONFIG += miamesh-2.4
 
 
@@ -38,6 +38,20 @@
 
    iso_value:   the texture intensity value that is used to extract the iso-surface
 
+   brick_grid:  3D texture with the (min, max) intensity of each brick of the volume
+                (including the adjacent voxels), used for empty space skipping
+
+   brick_size:  size of one brick in texture coordinates
+
+   brick_count: number of bricks in each direction
+
+   skip_empty_space: whether to leap over bricks whose maximum is below the iso value
+
+   use_gradients: whether to shade with the precomputed normals instead of evaluating
+                  them by central differences
+
+   gradients:   3D texture with the normals of the volume packed to [0,1]
+
    light_source: the light direction vector used for shading. This direction must be
                  corrected for the view direction.
 
@@ -69,6 +83,12 @@ uniform sampler2D ray_end;
 
 uniform highp vec3 step_length;
 uniform highp float iso_value;
+uniform sampler3D brick_grid;
+uniform highp vec3 brick_size;
+uniform highp vec3 brick_count;
+uniform bool skip_empty_space;
+uniform bool use_gradients;
+uniform sampler3D gradients;
 uniform highp vec3 light_source;
 uniform highp mat4 qt_mv;
 
@@ -92,6 +112,18 @@ float depthSample(float linearDepth)
     return (zFar + zNear - 2.0 * zNear * zFar / linearDepth) / (zFar - zNear);
 }
 
+// number of whole steps along the ray that stay inside the brick containing x
+highp float steps_inside_brick(highp vec3 x, highp vec3 step, highp vec3 brick)
+{
+        highp vec3 lo = brick * brick_size;
+        highp vec3 hi = lo + brick_size;
+        highp vec3 t = vec3(1e20);
+        if (step.x > 0.0) t.x = (hi.x - x.x) / step.x; else if (step.x < 0.0) t.x = (lo.x - x.x) / step.x;
+        if (step.y > 0.0) t.y = (hi.y - x.y) / step.y; else if (step.y < 0.0) t.y = (lo.y - x.y) / step.y;
+        if (step.z > 0.0) t.z = (hi.z - x.z) / step.z; else if (step.z < 0.0) t.z = (lo.z - x.z) / step.z;
+        return max(floor(min(min(t.x, t.y), t.z)), 0.0);
+}
+
 void main(void)
 {
         // obtain start and end position of the ray
@@ -124,6 +156,16 @@ void main(void)
 
         for (highp float a = 0; a < max_nf ; a += 1.0)  {
                 highp vec3 x = start.xyz + a * step;
+
+                // leap over bricks whose intensity range is below the iso value
+                if (skip_empty_space) {
+                        highp vec3 brick = floor(x / brick_size);
+                        if (texture3D(brick_grid, (brick + 0.5) / brick_count).g < iso_value) {
+                                a += steps_inside_brick(x, step, brick);
+                                old_iso = texture3D(volume, start.xyz + a * step).r;
+                                continue;
+                        }
+                }
                 highp vec4 color = texture3D(volume, x);
 
                 // if we cross the iso-boundary draw the pixel
@@ -139,17 +181,23 @@ void main(void)
                         }
                         x = start.xyz +  f * step;
 
-                        // evalute the normal by using centered finite differences
-                        highp float gx = (texture3D(volume, vec3(x.x - step_length.x, x.y, x.z)).r -
-                                    texture3D(volume, vec3(x.x + step_length.x, x.y, x.z)).r)/ step_length.x / 2.0;
+                        highp vec3 normal;
+                        if (use_gradients) {
+                                // precomputed normal, packed to [0,1]
+                                normal = normalize(texture3D(gradients, x).rgb * 2.0 - 1.0);
+                        } else {
+                                // evalute the normal by using centered finite differences
+                                highp float gx = (texture3D(volume, vec3(x.x - step_length.x, x.y, x.z)).r -
+                                            texture3D(volume, vec3(x.x + step_length.x, x.y, x.z)).r)/ step_length.x / 2.0;
 
-                        highp float gy = (texture3D(volume, vec3(x.x, x.y - step_length.y, x.z)).r -
-                                    texture3D(volume, vec3(x.x, x.y + step_length.y, x.z)).r)/ step_length.y / 2.0;
+                                highp float gy = (texture3D(volume, vec3(x.x, x.y - step_length.y, x.z)).r -
+                                            texture3D(volume, vec3(x.x, x.y + step_length.y, x.z)).r)/ step_length.y / 2.0;
 
-                        highp float gz = (texture3D(volume, vec3(x.x, x.y, x.z - step_length.z)).r -
-                                    texture3D(volume, vec3(x.x, x.y, x.z + step_length.z)).r)/ step_length.z / 2.0;
+                                highp float gz = (texture3D(volume, vec3(x.x, x.y, x.z - step_length.z)).r -
+                                            texture3D(volume, vec3(x.x, x.y, x.z + step_length.z)).r)/ step_length.z / 2.0;
 
-                        highp vec3 normal = normalize(vec3(gx, gy, gz));
+                                normal = normalize(vec3(gx, gy, gz));
+                        }
 
                         // evaaluate the light inetensity
                         highp float li = -dot(normal, light_source);
@@ -0,0 +1,58 @@
+/*
+ * This file is part of qtlmpick- a tool for landmark picking and
+ * visualization in volume data
+ * Copyright (c) Genoa 2017,  Gert Wollny
+ *
+ * qtlmpick is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with MIA; if not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+/*
+  Sphere impostors: intersects the view ray through the fragment with the
+  sphere, shades the hit point like the sphere mesh, and writes the depth
+  of the hit point so that the spheres intersect correctly with each other
+  and with the volume.
+*/
+
+#version 330
+
+uniform highp mat4 qt_projection;
+uniform highp vec3 qt_light_direction;
+
+varying highp vec3 view_center;
+varying highp vec3 view_point;
+varying highp float view_radius;
+varying highp vec4 base_color;
+
+void main(void)
+{
+        // the eye is at the origin of the view space
+        highp vec3 ray = normalize(view_point);
+        highp float b = dot(ray, view_center);
+        highp float c = dot(view_center, view_center) - view_radius * view_radius;
+        highp float disc = b * b - c;
+        if (disc < 0.0)
+                discard;
+
+        // nearest intersection
+        highp vec3 p = (b - sqrt(disc)) * ray;
+        highp vec3 normal = normalize(p - view_center);
+
+        // the mesh uses inward normals, hence the sign
+        float light_intensity = dot(normal, qt_light_direction);
+        gl_FragColor = base_color *  (0.9 * light_intensity + 0.1);
+
+        highp vec4 clip = qt_projection * vec4(p, 1.0);
+        gl_FragDepth = 0.5 * clip.z / clip.w + 0.5;
+}
@@ -0,0 +1,59 @@
+/*
+ * This file is part of qtlmpick- a tool for landmark picking and
+ * visualization in volume data
+ * Copyright (c) Genoa 2017,  Gert Wollny
+ *
+ * qtlmpick is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with MIA; if not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+/*
+  Sphere impostors: every sphere is drawn as a screen aligned quad that is
+  large enough to contain the silhouette of the sphere, the fragment shader
+  intersects the view ray with the sphere.
+
+  The per vertex input is the quad corner in [-1,1]^2, the per instance
+  inputs are:
+
+    instance_offset: the center of the sphere in model space
+    instance_color:  the base color of the sphere
+*/
+
+#version 330
+
+attribute highp vec2 qt_corner;
+attribute highp vec3 instance_offset;
+attribute highp vec4 instance_color;
+
+uniform highp mat4 qt_modelview;
+uniform highp mat4 qt_projection;
+uniform highp float radius;
+
+varying highp vec3 view_center;
+varying highp vec3 view_point;
+varying highp float view_radius;
+varying highp vec4 base_color;
+
+void main(void)
+{
+        vec4 center = qt_modelview * vec4(instance_offset, 1);
+        view_center = center.xyz;
+        view_radius = radius * length(qt_modelview[0].xyz);
+
+        // under perspective the silhouette is slightly larger than the
+        // sphere radius, the margin keeps it inside the quad
+        view_point = view_center + vec3(1.25 * view_radius * qt_corner, 0.0);
+        gl_Position = qt_projection * vec4(view_point, 1);
+        base_color = instance_color;
+}
@@ -34,7 +34,30 @@
                and the ray end depth information.
 
    iso_value:   the texture intensity value that is used to extract the iso-surface
+
+   brick_grid:  3D texture with the (min, max) intensity of each brick of the volume
+                (including the adjacent voxels), used for empty space skipping
+
+   brick_size:  size of one brick in texture coordinates
+
+   brick_count: number of bricks in each direction
+
+   skip_empty_space: whether to leap over bricks whose maximum is below the iso value
+
+   use_gradients: whether to shade with the precomputed normals instead of evaluating
+                  them by central differences
+
+   gradients:   3D texture with the normals of the volume packed to [0,1]
+
+   lod:         the resolution level of the volume texture to sample, the step length
+                follows the resolution of the level
 0
+   step_scale:  factor applied to the step length along the ray, values below 1
+                sample the ray more densely than once per voxel
+
+   hit_refinement: number of bisection steps used to locate the iso-surface
+                   between the last two samples before it is interpolated
+
    light_source: the light direction vector used for shading. This direction must be
                  corrected for the view direction.
 
@@ -64,6 +87,15 @@ uniform sampler2D ray_start;
 uniform sampler2D ray_end;
 
 uniform highp float iso_value;
+uniform sampler3D brick_grid;
+uniform highp vec3 brick_size;
+uniform highp vec3 brick_count;
+uniform bool skip_empty_space;
+uniform bool use_gradients;
+uniform sampler3D gradients;
+uniform highp float lod;
+uniform highp float step_scale;
+uniform int hit_refinement;
 uniform highp vec3 light_source;
 uniform highp mat4 qt_mv;
 
@@ -85,6 +117,18 @@ float depthSample(float linearDepth)
     return (zFar + zNear - 2.0 * zNear * zFar / linearDepth) / (zFar - zNear);
 }
 
+// number of whole steps along the ray that stay inside the brick containing x
+highp float steps_inside_brick(highp vec3 x, highp vec3 step, highp vec3 brick)
+{
+        highp vec3 lo = brick * brick_size;
+        highp vec3 hi = lo + brick_size;
+        highp vec3 t = vec3(1e20);
+        if (step.x > 0.0) t.x = (hi.x - x.x) / step.x; else if (step.x < 0.0) t.x = (lo.x - x.x) / step.x;
+        if (step.y > 0.0) t.y = (hi.y - x.y) / step.y; else if (step.y < 0.0) t.y = (lo.y - x.y) / step.y;
+        if (step.z > 0.0) t.z = (hi.z - x.z) / step.z; else if (step.z < 0.0) t.z = (lo.z - x.z) / step.z;
+        return max(floor(min(min(t.x, t.y), t.z)), 0.0);
+}
+
 void main(void)
 {
         // obtain start and end position of the ray
@@ -102,7 +146,7 @@ void main(void)
 
         // evaluate the step_length based on the texture size
         // each step should move into another voxel
-        ivec3 ts = textureSize(volume, 0);
+        ivec3 ts = textureSize(volume, int(lod));
         vec3 step_length = vec3(1.0/ts.x, 1.0/ts.y, 1.0/ts.z);
 
         // if the length of all drawing line components is smaller
@@ -112,7 +156,7 @@ void main(void)
         }
 
         // calculate the actually used step length
-        highp vec3 nf = adir  / step_length;
+        highp vec3 nf = adir  / (step_length * step_scale);
         highp float max_nf =max(max(nf.x, nf.y), nf.z);
         highp vec3 step = dir / max_nf;
 
@@ -122,28 +166,61 @@ void main(void)
 
         for (highp float a = 0; a < max_nf ; a += 1.0)  {
                 highp vec3 x = start.xyz + a * step;
-                highp vec4 color = texture3D(volume, x);
+
+                // leap over bricks whose intensity range is below the iso value
+                if (skip_empty_space) {
+                        highp vec3 brick = floor(x / brick_size);
+                        if (texture3D(brick_grid, (brick + 0.5) / brick_count).g < iso_value) {
+                                a += steps_inside_brick(x, step, brick);
+                                old_iso = textureLod(volume, start.xyz + a * step, lod).r;
+                                continue;
+                        }
+                }
+                highp vec4 color = textureLod(volume, x, lod);
 
                 // if we cross the iso-boundary draw the pixel
                 if (color.r < iso_value) {
                         old_iso = color.r;
                         continue;
                 } else {
-                        highp float f = a - 1 + (iso_value - old_iso) / (color.r - old_iso);
+                        // narrow down the crossing by bisection, the first sample has no predecessor
+                        highp float lo = a - 1.0;
+                        highp float hi = a;
+                        highp float v_lo = old_iso;
+                        highp float v_hi = color.r;
+                        int refine = a > 0.0 ? hit_refinement : 0;
+                        for (int i = 0; i < refine; ++i) {
+                                highp float mid = 0.5 * (lo + hi);
+                                highp float v = textureLod(volume, start.xyz + mid * step, lod).r;
+                                if (v < iso_value) {
+                                        lo = mid;
+                                        v_lo = v;
+                                } else {
+                                        hi = mid;
+                                        v_hi = v;
+                                }
+                        }
+                        highp float f = lo + (hi - lo) * (iso_value - v_lo) / (v_hi - v_lo);
 
                         x = start.xyz +  f * step;
 
-                        // evalute the normal by using centered finite differences
-                        highp float gx = (texture3D(volume, vec3(x.x - step_length.x, x.y, x.z)).r -
-                                    texture3D(volume, vec3(x.x + step_length.x, x.y, x.z)).r)/ step_length.x / 2.0;
+                        highp vec3 normal;
+                        if (use_gradients) {
+                                // precomputed normal, packed to [0,1]
+                                normal = normalize(textureLod(gradients, x, 0.0).rgb * 2.0 - 1.0);
+                        } else {
+                                // evalute the normal by using centered finite differences
+                                highp float gx = (textureLod(volume, vec3(x.x - step_length.x, x.y, x.z), lod).r -
+                                            textureLod(volume, vec3(x.x + step_length.x, x.y, x.z), lod).r)/ step_length.x / 2.0;
 
-                        highp float gy = (texture3D(volume, vec3(x.x, x.y - step_length.y, x.z)).r -
-                                    texture3D(volume, vec3(x.x, x.y + step_length.y, x.z)).r)/ step_length.y / 2.0;
+                                highp float gy = (textureLod(volume, vec3(x.x, x.y - step_length.y, x.z), lod).r -
+                                            textureLod(volume, vec3(x.x, x.y + step_length.y, x.z), lod).r)/ step_length.y / 2.0;
 
-                        highp float gz = (texture3D(volume, vec3(x.x, x.y, x.z - step_length.z)).r -
-                                    texture3D(volume, vec3(x.x, x.y, x.z + step_length.z)).r)/ step_length.z / 2.0;
+                                highp float gz = (textureLod(volume, vec3(x.x, x.y, x.z - step_length.z), lod).r -
+                                            textureLod(volume, vec3(x.x, x.y, x.z + step_length.z), lod).r)/ step_length.z / 2.0;
 
-                        highp vec3 normal = normalize(vec3(gx, gy, gz));
+                                normal = normalize(vec3(gx, gy, gz));
+                        }
 
                         // evaaluate the light inetensity
                         highp float li = -dot(normal, light_source);
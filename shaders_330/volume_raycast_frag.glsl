@@ -0,0 +1,242 @@
+/*
+ * This file is part of qtlmpick- a tool for landmark picking and
+ * visualization in volume data
+ * Copyright (c) Genoa 2017,  Gert Wollny
+ *
+ * qtlmpick is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with MIA; if not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+/*
+  This shader implements single pass volume iso surface rendering by using ray casting.
+  Other than the two pass renderer the ray start and end points are not read from
+  render targets but evaluated analytically by intersecting the view ray with the
+  volume box. Like the two pass renderer it does no depth testing but it writes the
+  depth information, hence it should always be drawn first.
+
+  The inputs are:
+
+   volume: the 3D texture used as input for the volume rendering
+
+   qt_mvp:     the model-view-projection matrix used to draw the volume box
+
+   qt_inv_mvp: the inverse of qt_mvp, used to obtain the view ray in model space
+
+   box_scale:  the half size of the volume box in model space, the box is centered
+               at the origin
+
+   iso_value:   the texture intensity value that is used to extract the iso-surface
+
+   brick_grid:  3D texture with the (min, max) intensity of each brick of the volume
+                (including the adjacent voxels), used for empty space skipping
+
+   brick_size:  size of one brick in texture coordinates
+
+   brick_count: number of bricks in each direction
+
+   skip_empty_space: whether to leap over bricks whose maximum is below the iso value
+
+   use_gradients: whether to shade with the precomputed normals instead of evaluating
+                  them by central differences
+
+   gradients:   3D texture with the normals of the volume packed to [0,1]
+
+   lod:         the resolution level of the volume texture to sample, the step length
+                follows the resolution of the level
+
+   step_scale:  factor applied to the step length along the ray, values below 1
+                sample the ray more densely than once per voxel
+
+   hit_refinement: number of bisection steps used to locate the iso-surface
+                   between the last two samples before it is interpolated
+
+   light_source: the light direction vector used for shading. This direction must be
+                 corrected for the view direction.
+
+Outputs:
+    The same as volume_2nd_pass_frag.glsl
+
+    gl_FragData[0]: a 4D vector with light intensity in the color componets rgb, and
+                     the z value in the w component.
+
+    gl_FragData[1]: xyz = 3D texture coordinate where the ray stopped, and w=1,
+                    if ray hit something.
+
+*/
+
+#version 140
+uniform sampler3D volume;
+
+uniform highp float iso_value;
+uniform sampler3D brick_grid;
+uniform highp vec3 brick_size;
+uniform highp vec3 brick_count;
+uniform bool skip_empty_space;
+uniform bool use_gradients;
+uniform sampler3D gradients;
+uniform highp float lod;
+uniform highp float step_scale;
+uniform int hit_refinement;
+uniform highp vec3 light_source;
+uniform highp mat4 qt_mvp;
+uniform highp mat4 qt_inv_mvp;
+uniform highp vec3 box_scale;
+
+varying highp vec2 tex2dcoord;
+
+// number of whole steps along the ray that stay inside the brick containing x
+highp float steps_inside_brick(highp vec3 x, highp vec3 step, highp vec3 brick)
+{
+        highp vec3 lo = brick * brick_size;
+        highp vec3 hi = lo + brick_size;
+        highp vec3 t = vec3(1e20);
+        if (step.x > 0.0) t.x = (hi.x - x.x) / step.x; else if (step.x < 0.0) t.x = (lo.x - x.x) / step.x;
+        if (step.y > 0.0) t.y = (hi.y - x.y) / step.y; else if (step.y < 0.0) t.y = (lo.y - x.y) / step.y;
+        if (step.z > 0.0) t.z = (hi.z - x.z) / step.z; else if (step.z < 0.0) t.z = (lo.z - x.z) / step.z;
+        return max(floor(min(min(t.x, t.y), t.z)), 0.0);
+}
+
+void main(void)
+{
+        // obtain the view ray in model space from the near and far plane points
+        highp vec2 ndc = 2.0 * tex2dcoord - 1.0;
+        highp vec4 near_point = qt_inv_mvp * vec4(ndc, -1.0, 1.0);
+        highp vec4 far_point = qt_inv_mvp * vec4(ndc, 1.0, 1.0);
+        highp vec3 origin = near_point.xyz / near_point.w;
+        highp vec3 ray = far_point.xyz / far_point.w - origin;
+
+        // intersect the ray with the volume box (slab test), avoid
+        // divisions by zero for axis aligned rays
+        highp vec3 safe_ray = mix(ray, vec3(1e-20), equal(ray, vec3(0.0)));
+        highp vec3 t0 = (-box_scale - origin) / safe_ray;
+        highp vec3 t1 = (box_scale - origin) / safe_ray;
+        highp vec3 tmin = min(t0, t1);
+        highp vec3 tmax = max(t0, t1);
+        highp float t_enter = max(max(max(tmin.x, tmin.y), tmin.z), 0.0);
+        highp float t_exit = min(min(min(tmax.x, tmax.y), tmax.z), 1.0);
+
+        // the ray misses the box
+        if (t_enter >= t_exit) {
+                discard;
+        }
+
+        // ray start and end in texture space
+        highp vec3 start = 0.5 * (origin + t_enter * ray) / box_scale + 0.5;
+        highp vec3 end = 0.5 * (origin + t_exit * ray) / box_scale + 0.5;
+
+        // obtain drawing direction
+        highp vec3 dir = end - start;
+        highp vec3 adir = abs(dir);
+
+        // evaluate the step_length based on the texture size
+        // each step should move into another voxel
+        ivec3 ts = textureSize(volume, int(lod));
+        vec3 step_length = vec3(1.0/ts.x, 1.0/ts.y, 1.0/ts.z);
+
+        // if the length of all drawing line components is smaller
+        // as the corresponding step length then discard the fragment
+        if (adir.x < step_length.x && adir.y < step_length.y && adir.z < step_length.z) {
+                discard;
+        }
+
+        // calculate the actually used step length
+        highp vec3 nf = adir  / (step_length * step_scale);
+        highp float max_nf =max(max(nf.x, nf.y), nf.z);
+        highp vec3 step = dir / max_nf;
+
+        // iterate along the ray, front to back
+        bool hit = false;
+        highp float old_iso = -1;
+
+        for (highp float a = 0; a < max_nf ; a += 1.0)  {
+                highp vec3 x = start + a * step;
+
+                // leap over bricks whose intensity range is below the iso value
+                if (skip_empty_space) {
+                        highp vec3 brick = floor(x / brick_size);
+                        if (texture3D(brick_grid, (brick + 0.5) / brick_count).g < iso_value) {
+                                a += steps_inside_brick(x, step, brick);
+                                old_iso = textureLod(volume, start + a * step, lod).r;
+                                continue;
+                        }
+                }
+                highp vec4 color = textureLod(volume, x, lod);
+
+                // if we cross the iso-boundary draw the pixel
+                if (color.r < iso_value) {
+                        old_iso = color.r;
+                        continue;
+                } else {
+                        // narrow down the crossing by bisection, the first sample has no predecessor
+                        highp float lo = a - 1.0;
+                        highp float hi = a;
+                        highp float v_lo = old_iso;
+                        highp float v_hi = color.r;
+                        int refine = a > 0.0 ? hit_refinement : 0;
+                        for (int i = 0; i < refine; ++i) {
+                                highp float mid = 0.5 * (lo + hi);
+                                highp float v = textureLod(volume, start + mid * step, lod).r;
+                                if (v < iso_value) {
+                                        lo = mid;
+                                        v_lo = v;
+                                } else {
+                                        hi = mid;
+                                        v_hi = v;
+                                }
+                        }
+                        highp float f = lo + (hi - lo) * (iso_value - v_lo) / (v_hi - v_lo);
+
+                        x = start +  f * step;
+
+                        highp vec3 normal;
+                        if (use_gradients) {
+                                // precomputed normal, packed to [0,1]
+                                normal = normalize(textureLod(gradients, x, 0.0).rgb * 2.0 - 1.0);
+                        } else {
+                                // evalute the normal by using centered finite differences
+                                highp float gx = (textureLod(volume, vec3(x.x - step_length.x, x.y, x.z), lod).r -
+                                            textureLod(volume, vec3(x.x + step_length.x, x.y, x.z), lod).r)/ step_length.x / 2.0;
+
+                                highp float gy = (textureLod(volume, vec3(x.x, x.y - step_length.y, x.z), lod).r -
+                                            textureLod(volume, vec3(x.x, x.y + step_length.y, x.z), lod).r)/ step_length.y / 2.0;
+
+                                highp float gz = (textureLod(volume, vec3(x.x, x.y, x.z - step_length.z), lod).r -
+                                            textureLod(volume, vec3(x.x, x.y, x.z + step_length.z), lod).r)/ step_length.z / 2.0;
+
+                                normal = normalize(vec3(gx, gy, gz));
+                        }
+
+                        // evaaluate the light inetensity
+                        highp float li = -dot(normal, light_source);
+
+                        // project the hit point to obtain the window depth
+                        highp float t_hit = t_enter + max(f, 0.0) / max_nf * (t_exit - t_enter);
+                        highp vec4 clip = qt_mvp * vec4(origin + t_hit * ray, 1.0);
+                        highp float depth = 0.5 * clip.z / clip.w + 0.5;
+
+                        // Store depth in the alpha component off the output color.
+                        gl_FragData[0] = vec4(li, li, li, depth);
+
+                        // output texture coordinate to second render target
+                        gl_FragData[1] = vec4(x.xyz, 1);
+
+                        // exit the loop and indicate that a pixel was drawn
+                        hit = true;
+                        break;
+                }
+        }
+        //if  not hit the iso-value, then discard the fragment
+        if (!hit)
+                discard;
+}
@@ -0,0 +1,321 @@
+/* -*- mia-c++  -*-
+ *
+ * This file is part of qtlmpick- a tool for landmark picking and
+ * visualization in volume data
+ * Copyright (c) Genoa 2017,  Gert Wollny
+ *
+ * qtlmpick is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with MIA; if not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include "batchrenderer.hh"
+#include "offscreenrenderer.hh"
+#include "landmarklistio.hh"
+#include "volumecache.hh"
+#include "qruntimeexeption.hh"
+
+#include <QCommandLineParser>
+#include <QCoreApplication>
+#include <QOpenGLContext>
+#include <QRegularExpression>
+#include <QTextStream>
+#include <QThread>
+#include <QFileInfo>
+#include <QFile>
+#include <QDir>
+#include <QHash>
+#include <QSet>
+#include <QDebug>
+#include <mia/3d/imageio.hh>
+#include <memory>
+
+using std::unique_ptr;
+
+BatchRenderer::BatchRenderer(const QSize& size, int n_contexts):
+        m_size(size),
+        m_n_contexts(std::max(n_contexts, 1)),
+        m_loading_done(false),
+        m_failed(0)
+{
+}
+
+void BatchRenderer::add_subject(const Subject& subject)
+{
+        m_subjects.push_back(subject);
+}
+
+int BatchRenderer::run()
+{
+        m_loaded.clear();
+        m_loading_done = false;
+        m_failed = 0;
+
+        // the contexts and their surfaces must be created in the GUI thread
+        int n_contexts = std::min<int>(m_n_contexts, m_subjects.size());
+        if (n_contexts > 1 && !QOpenGLContext::supportsThreadedOpenGL()) {
+                qWarning() << "The platform doesn't support rendering in threads, using one context";
+                n_contexts = 1;
+        }
+
+        std::vector<unique_ptr<OffscreenRenderer>> renderers;
+        for (int i = 0; i < n_contexts; ++i)
+                renderers.emplace_back(new OffscreenRenderer(m_size));
+
+        unique_ptr<QThread> loader(QThread::create([this]() {load_subjects();}));
+        loader->start();
+
+        if (n_contexts == 1) {
+                // the loader still works ahead while the GUI thread renders
+                if (!renderers.empty())
+                        render_subjects(*renderers[0]);
+        } else {
+                QThread *gui_thread = QThread::currentThread();
+                std::vector<unique_ptr<QThread>> threads;
+                for (auto& r: renderers) {
+                        OffscreenRenderer *renderer = r.get();
+                        threads.emplace_back(QThread::create([this, renderer, gui_thread]() {
+                                                render_subjects(*renderer);
+                                                renderer->release(gui_thread);
+                                        }));
+                        renderer->move_to_thread(threads.back().get());
+                        threads.back()->start();
+                }
+                for (auto& t: threads)
+                        t->wait();
+        }
+
+        loader->wait();
+        return m_failed;
+}
+
+void BatchRenderer::load_subjects()
+{
+        for (unsigned i = 0; i < m_subjects.size(); ++i) {
+                LoadedSubject loaded;
+                loaded.index = i;
+                load_subject(loaded);
+                push(std::move(loaded));
+        }
+
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_loading_done = true;
+        m_changed.notify_all();
+}
+
+void BatchRenderer::load_subject(LoadedSubject& loaded) const
+{
+        const Subject& subject = m_subjects[loaded.index];
+        try {
+                loaded.landmarks = read_landmarklist(subject.landmark_file);
+
+                VolumeCache cache;
+                auto volume = cache.load(subject.volume_file);
+                if (!volume) {
+                        auto image = mia::load_image3d(subject.volume_file.toStdString());
+                        if (!image) {
+                                loaded.error = QObject::tr("Unable to read '%1'").arg(subject.volume_file);
+                                return;
+                        }
+                        volume = std::make_shared<VolumeData>(image);
+                        cache.store(subject.volume_file, *volume);
+                }
+
+                // only the host data is passed on, the rendering thread creates its own volume
+                loaded.volume = volume->get_host_data();
+        }
+        catch (QRuntimeExeption& x) {
+                loaded.error = x.qwhat();
+        }
+        catch (std::exception& x) {
+                loaded.error = x.what();
+        }
+}
+
+void BatchRenderer::push(LoadedSubject&& loaded)
+{
+        std::unique_lock<std::mutex> lock(m_mutex);
+
+        // don't load further ahead than the contexts can take
+        m_changed.wait(lock, [this]() {return static_cast<int>(m_loaded.size()) < m_n_contexts;});
+        m_loaded.push_back(std::move(loaded));
+        m_changed.notify_all();
+}
+
+bool BatchRenderer::pop(LoadedSubject& loaded)
+{
+        std::unique_lock<std::mutex> lock(m_mutex);
+        m_changed.wait(lock, [this]() {return !m_loaded.empty() || m_loading_done;});
+        if (m_loaded.empty())
+                return false;
+
+        loaded = std::move(m_loaded.front());
+        m_loaded.pop_front();
+        m_changed.notify_all();
+        return true;
+}
+
+void BatchRenderer::render_subjects(OffscreenRenderer& renderer)
+{
+        LoadedSubject loaded;
+        while (pop(loaded)) {
+                if (!render_subject(renderer, loaded)) {
+                        std::lock_guard<std::mutex> lock(m_mutex);
+                        ++m_failed;
+                }
+        }
+}
+
+bool BatchRenderer::render_subject(OffscreenRenderer& renderer, const LoadedSubject& loaded)
+{
+        const Subject& subject = m_subjects[loaded.index];
+        if (!loaded.error.isEmpty()) {
+                qWarning() << subject.volume_file << ":" << loaded.error;
+                return false;
+        }
+
+        try {
+                if (!QDir().mkpath(subject.out_dir))
+                        throw QRuntimeExeption(QObject::tr("Unable to create the directory '%1'").arg(subject.out_dir));
+
+                renderer.set_volume(std::make_shared<VolumeData>(loaded.volume));
+                renderer.set_landmark_list(loaded.landmarks);
+                int n = renderer.create_templates(*loaded.landmarks, subject.out_dir);
+                renderer.set_volume(PVolumeData());
+
+                if (!write_landmarklist(subject.out_dir + "/template.lmx", *loaded.landmarks))
+                        throw QRuntimeExeption(QObject::tr("Unable to write '%1'").arg(subject.out_dir + "/template.lmx"));
+
+                qInfo() << subject.volume_file << ":" << n << "templates written to" << subject.out_dir;
+                return true;
+        }
+        catch (QRuntimeExeption& x) {
+                qWarning() << subject.volume_file << ":" << x.qwhat();
+        }
+        catch (std::exception& x) {
+                qWarning() << subject.volume_file << ":" << x.what();
+        }
+        renderer.set_volume(PVolumeData());
+        return false;
+}
+
+static bool parse_size(const QString& s, QSize& size)
+{
+        auto wh = s.split('x');
+        if (wh.size() != 2)
+                return false;
+        bool w_ok, h_ok;
+        size = QSize(wh[0].toInt(&w_ok), wh[1].toInt(&h_ok));
+        return w_ok && h_ok && !size.isEmpty();
+}
+
+static bool read_subject_list(const QString& filename, QStringList& files)
+{
+        QFile file(filename);
+        if (!file.open(QIODevice::ReadOnly | QIODevice::Text))
+                return false;
+
+        QTextStream in(&file);
+        while (!in.atEnd()) {
+                QString line = in.readLine().trimmed();
+                if (line.isEmpty() || line.startsWith('#'))
+                        continue;
+                files << line.split(QRegularExpression("\\s+"));
+        }
+        return true;
+}
+
+int batch_main(const QStringList& arguments)
+{
+        QCommandLineParser parser;
+        parser.setApplicationDescription(QObject::tr(
+                "Render the landmark template images of the given subjects without user interaction. "
+                "Each subject is given by a volume file followed by its landmark list. "
+                "Without a display run with QT_QPA_PLATFORM=offscreen or minimalegl."));
+        parser.addHelpOption();
+        parser.addOptions({
+                        {"batch", QObject::tr("Run in batch mode.")},
+                        {{"o", "output"}, QObject::tr("Write the templates of each subject to a sub-directory "
+                                                      "of <dir> named after the volume file, prefixed by "
+                                                      "its directory if several volumes have the same name."),
+                         QObject::tr("dir"), "."},
+                        {"size", QObject::tr("Size of the template images."), QObject::tr("WxH"), "512x512"},
+                        {"contexts", QObject::tr("Number of subjects rendered in parallel."), QObject::tr("n"), "2"},
+                        {"subjects", QObject::tr("Read the subjects from <file>, one pair of volume and "
+                                                 "landmark list per line."), QObject::tr("file")}
+                });
+        parser.addPositionalArgument("subjects", QObject::tr("Pairs of volume and landmark list files."),
+                                     "[volume landmarks]...");
+        parser.process(arguments);
+
+        QSize size;
+        if (!parse_size(parser.value("size"), size)) {
+                qWarning() << "Invalid image size" << parser.value("size");
+                return 1;
+        }
+
+        bool contexts_ok;
+        int n_contexts = parser.value("contexts").toInt(&contexts_ok);
+        if (!contexts_ok || n_contexts < 1) {
+                qWarning() << "Invalid number of contexts" << parser.value("contexts");
+                return 1;
+        }
+
+        QStringList files = parser.positionalArguments();
+        if (parser.isSet("subjects") && !read_subject_list(parser.value("subjects"), files)) {
+                qWarning() << "Unable to read" << parser.value("subjects");
+                return 1;
+        }
+        if (files.size() % 2) {
+                qWarning() << "Each volume must be followed by a landmark list";
+                return 1;
+        }
+
+        // the output directory is named after the volume, and if volumes of the
+        // same name are stored in different directories, also after their directory
+        QStringList names;
+        QHash<QString, int> name_count;
+        for (int i = 0; i < files.size(); i += 2) {
+                names.append(QFileInfo(files[i]).baseName());
+                ++name_count[names.back()];
+        }
+        QSet<QString> unique_names;
+        for (int i = 0; i < names.size(); ++i) {
+                if (name_count[names[i]] > 1) {
+                        QFileInfo info(files[2 * i]);
+                        names[i] = info.absoluteDir().dirName() + "_" + info.baseName();
+                }
+                if (unique_names.contains(names[i])) {
+                        qWarning() << "The output directory" << names[i] << "of" << files[2 * i]
+                                   << "is not unique, the templates of the subjects would overwrite each other";
+                        return 1;
+                }
+                unique_names.insert(names[i]);
+        }
+
+        BatchRenderer batch(size, n_contexts);
+        QDir out_dir(parser.value("output"));
+        for (int i = 0; i < names.size(); ++i)
+                batch.add_subject(BatchRenderer::Subject{files[2 * i], files[2 * i + 1], out_dir.filePath(names[i])});
+
+        try {
+                int failed = batch.run();
+                if (failed)
+                        qWarning() << failed << "of" << files.size() / 2 << "subjects failed";
+                return failed ? 1 : 0;
+        }
+        catch (QRuntimeExeption& x) {
+                qWarning() << x.qwhat();
+        }
+        return 1;
+}
@@ -0,0 +1,106 @@
+/* -*- mia-c++  -*-
+ *
+ * This file is part of qtlmpick- a tool for landmark picking and
+ * visualization in volume data
+ * Copyright (c) Genoa 2017,  Gert Wollny
+ *
+ * qtlmpick is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with MIA; if not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef BATCHRENDERER_HH
+#define BATCHRENDERER_HH
+
+#include "volumedata.hh"
+#include "landmarklist.hh"
+
+#include <QSize>
+#include <QString>
+#include <QStringList>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <vector>
+
+class OffscreenRenderer;
+
+/**
+  \brief Creates the landmark templates of many subjects without user interaction
+
+  Each subject is a volume and a landmark list, the template images of
+  the landmarks and the list referring to them are written to the output
+  directory of the subject (see OffscreenRenderer::create_templates).
+
+  One thread loads and preprocesses the volumes ahead of the rendering,
+  the subjects are rendered in parallel, each rendering thread with its
+  own OpenGL context. At most one loaded subject per context is kept
+  waiting, so the memory use is bounded independent of the number of
+  subjects.
+*/
+class BatchRenderer {
+public:
+        struct Subject {
+                QString volume_file;
+                QString landmark_file;
+                QString out_dir;
+        };
+
+        /**
+           \param size size of the template images
+           \param n_contexts number of OpenGL contexts rendering in parallel
+        */
+        BatchRenderer(const QSize& size, int n_contexts);
+
+        void add_subject(const Subject& subject);
+
+        /**
+           Process all subjects, must be called from the GUI thread.
+           \returns the number of subjects that failed
+        */
+        int run();
+
+private:
+        struct LoadedSubject {
+                int index;
+                VolumeData::HostData volume;
+                PLandmarkList landmarks;
+                QString error;
+        };
+
+        void load_subjects();
+        void load_subject(LoadedSubject& loaded) const;
+        void render_subjects(OffscreenRenderer& renderer);
+        bool render_subject(OffscreenRenderer& renderer, const LoadedSubject& loaded);
+
+        void push(LoadedSubject&& loaded);
+        bool pop(LoadedSubject& loaded);
+
+        QSize m_size;
+        int m_n_contexts;
+        std::vector<Subject> m_subjects;
+
+        std::mutex m_mutex;
+        std::condition_variable m_changed;
+        std::deque<LoadedSubject> m_loaded;
+        bool m_loading_done;
+        int m_failed;
+};
+
+/**
+   Run the batch mode with the given command line arguments.
+   \returns the exit code of the program
+*/
+int batch_main(const QStringList& arguments);
+
+#endif // BATCHRENDERER_HH
@@ -23,7 +23,9 @@
 #include "drawable.hh"
 
 
-Drawable::Drawable()
+Drawable::Drawable():
+        m_context(nullptr),
+        m_profiler(nullptr)
 {
 
 }
@@ -41,25 +43,33 @@ void Drawable::draw(const GlobalSceneState &state)
 void Drawable::attach_gl(QOpenGLContext *context)
 {
         m_context = context;
-        if (!m_shader_prefix_set) {
-                QString slversion((const char*)context->functions()->glGetString(GL_SHADING_LANGUAGE_VERSION));
-                QStringList v = slversion.split(".");
-
-                int major = v.at(0).toInt();
-                int minor = v.at(1).toInt();
-
-                if (major > 3 || (major == 3 && minor > 2)) {
-                        m_shader_prefix = ":/shaders/shaders_330/";
-                        m_shader_prefix_set = true;
-                } else {
-                        m_shader_prefix = ":/shaders/shaders_120/";
-                        m_shader_prefix_set = true;
-                }
-                qDebug() << "OGLSL version: " << slversion;
-        }
+        select_shader_set(context);
         do_attach_gl();
 }
 
+void Drawable::select_shader_set(QOpenGLContext *context)
+{
+        if (m_shader_prefix_set)
+                return;
+
+        QString slversion((const char*)context->functions()->glGetString(GL_SHADING_LANGUAGE_VERSION));
+        QStringList v = slversion.split(".");
+
+        int major = v.at(0).toInt();
+        int minor = v.at(1).toInt();
+
+        if (major > 3 || (major == 3 && minor > 2)) {
+                m_shader_prefix = ":/shaders/shaders_330/";
+                m_shader_version = 330;
+                m_shader_prefix_set = true;
+        } else {
+                m_shader_prefix = ":/shaders/shaders_120/";
+                m_shader_version = 120;
+                m_shader_prefix_set = true;
+        }
+        qDebug() << "OGLSL version: " << slversion;
+}
+
 void Drawable::compile_and_link(QOpenGLShaderProgram& program, const QString& vtx_prog, const QString& frag_pgrm)
 {
         QString vtx_prog_full = m_shader_prefix + vtx_prog;
@@ -75,6 +85,11 @@ void Drawable::compile_and_link(QOpenGLShaderProgram& program, const QString& vt
                 qWarning() << "Error linking (" << vtx_prog_full << "," << frag_prog_full << ")', view will be clobbered\n";
 }
 
+int Drawable::get_shader_version()
+{
+        return m_shader_version;
+}
+
 void Drawable::detach_gl()
 {
         do_detach_gl();
@@ -86,6 +101,17 @@ QOpenGLContext *Drawable::get_context() const
         return m_context;
 }
 
+void Drawable::set_gpu_profiler(GpuProfiler *profiler)
+{
+        m_profiler = profiler;
+}
+
+GpuProfiler *Drawable::get_gpu_profiler() const
+{
+        return m_profiler;
+}
+
 
 bool Drawable::m_shader_prefix_set = false;
 QString Drawable::m_shader_prefix;
+int Drawable::m_shader_version = 0;
@@ -29,6 +29,8 @@
 #include <QString>
 #include <memory>
 
+class GpuProfiler;
+
 /**
 
 \brief base class for all objects to be drawn in the scene
@@ -45,11 +47,26 @@ public:
         void attach_gl(QOpenGLContext *context);
         void detach_gl();
 
+        /// measure the GPU time of the drawing stages with the given profiler, may be null
+        void set_gpu_profiler(GpuProfiler *profiler);
+
         static void compile_and_link(QOpenGLShaderProgram& program, const QString& vtx_prog, const QString& frag_pgrm);
 
+        /// the version of the shader set in use, i.e. 330 or 120, 0 if not yet known
+        static int get_shader_version();
+
+        /**
+           Select the shader set supported by the given current context, this is
+           done by the first attach_gl, but when drawables are attached from
+           several threads it must be done before the threads are started.
+        */
+        static void select_shader_set(QOpenGLContext *context);
+
 protected:
         QOpenGLContext *get_context() const;
 
+        GpuProfiler *get_gpu_profiler() const;
+
 
 
 private:
@@ -58,9 +75,11 @@ private:
         virtual void do_detach_gl() = 0;
 
         QOpenGLContext *m_context;
+        GpuProfiler *m_profiler;
 
         static bool m_shader_prefix_set;
         static QString m_shader_prefix;
+        static int m_shader_version;
 
 };
 
@@ -46,3 +46,17 @@ void GlobalSceneState::delete_offset()
 {
         m_offset = QVector3D(0,0,0);
 }
+
+void GlobalSceneState::update_projection()
+{
+        projection.setToIdentity();
+        float zw, zh;
+        if (viewport.width() > viewport.height()) {
+                zw = camera.get_zoom() * viewport.width() / viewport.height();
+                zh = camera.get_zoom();
+        }else{
+                zh = camera.get_zoom()* viewport.height() / viewport.width();
+                zw = camera.get_zoom();
+        }
+        projection.frustum(-zw, zw, -zh, zh, 248, 252);
+}
@@ -40,6 +40,9 @@ public:
         void set_offset(const QVector3D& v);
         void delete_offset();
 
+        /// Set the projection from the camera zoom and the aspect ratio of the viewport
+        void update_projection();
+
         Camera camera;
         QVector3D light_source;
         QMatrix4x4 projection;
@@ -0,0 +1,214 @@
+/* -*- mia-c++  -*-
+ *
+ * This file is part of qtlmpick- a tool for landmark picking and
+ * visualization in volume data
+ * Copyright (c) Genoa 2017,  Gert Wollny
+ *
+ * qtlmpick is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with MIA; if not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include "gpuprofiler.hh"
+
+#include <QOpenGLTimerQuery>
+#include <QOpenGLContext>
+#include <QOpenGLFunctions>
+#include <QTextStream>
+#include <QDebug>
+#include <algorithm>
+
+// queries per stage, a result is usually available two frames later
+static const unsigned n_queries = 4;
+
+// number of samples the statistics are evaluated over
+static const unsigned n_samples = 128;
+
+static const char *stage_names[GpuProfiler::gs_count] = {
+        "ray_setup",
+        "raycast",
+        "blit",
+        "pick",
+        "landmarks"
+};
+
+GpuProfiler::Scope::Scope(GpuProfiler *profiler, EStage stage):
+        m_profiler(profiler),
+        m_stage(stage)
+{
+        if (m_profiler)
+                m_profiler->begin(m_stage);
+}
+
+GpuProfiler::Scope::~Scope()
+{
+        if (m_profiler)
+                m_profiler->end(m_stage);
+}
+
+GpuProfiler::GpuProfiler():
+        m_is_attached(false)
+{
+        for (auto& s: m_stages) {
+                s.next = 0;
+                s.running = -1;
+                s.samples.resize(n_samples);
+                s.n_samples = 0;
+                s.next_sample = 0;
+        }
+}
+
+GpuProfiler::~GpuProfiler()
+{
+        for (auto& s: m_stages) {
+                for (auto& q: s.queries)
+                        delete q.query;
+        }
+}
+
+const char *GpuProfiler::get_stage_name(EStage stage)
+{
+        return stage_names[stage];
+}
+
+bool GpuProfiler::attach_gl()
+{
+        auto context = QOpenGLContext::currentContext();
+        auto gl = context->functions();
+        {
+                std::lock_guard<std::mutex> lock(m_mutex);
+                m_renderer = QString("%1, OpenGL %2").arg((const char *)gl->glGetString(GL_RENDERER))
+                             .arg((const char *)gl->glGetString(GL_VERSION));
+        }
+
+        for (auto& s: m_stages) {
+                for (unsigned i = 0; i < n_queries; ++i) {
+                        Query q{new QOpenGLTimerQuery, false};
+                        s.queries.push_back(q);
+                        if (!q.query->create()) {
+                                qWarning() << "GpuProfiler: timer queries are not supported, the GPU time is not measured";
+                                detach_gl();
+                                return false;
+                        }
+                }
+                s.next = 0;
+                s.running = -1;
+        }
+        m_is_attached = true;
+        return true;
+}
+
+void GpuProfiler::detach_gl()
+{
+        for (auto& s: m_stages) {
+                for (auto& q: s.queries) {
+                        q.query->destroy();
+                        delete q.query;
+                }
+                s.queries.clear();
+        }
+        m_is_attached = false;
+}
+
+void GpuProfiler::begin(EStage stage)
+{
+        if (!m_is_attached)
+                return;
+
+        StageTimer& s = m_stages[stage];
+        Query& q = s.queries[s.next];
+
+        // skip this measurement rather than waiting for the result
+        if (q.in_flight)
+                return;
+
+        q.query->begin();
+        q.in_flight = true;
+        s.running = s.next;
+        s.next = (s.next + 1) % n_queries;
+}
+
+void GpuProfiler::end(EStage stage)
+{
+        StageTimer& s = m_stages[stage];
+        if (!m_is_attached || s.running < 0)
+                return;
+
+        s.queries[s.running].query->end();
+        s.running = -1;
+}
+
+void GpuProfiler::collect()
+{
+        if (!m_is_attached)
+                return;
+
+        for (auto& s: m_stages) {
+                // the queries finish in the order they were issued, starting with the oldest
+                for (unsigned k = 0; k < n_queries; ++k) {
+                        int idx = (s.next + k) % n_queries;
+                        Query& q = s.queries[idx];
+                        if (!q.in_flight || idx == s.running)
+                                continue;
+                        if (!q.query->isResultAvailable())
+                                break;
+
+                        double ms = q.query->waitForResult() * 1e-6;
+                        q.in_flight = false;
+
+                        std::lock_guard<std::mutex> lock(m_mutex);
+                        s.samples[s.next_sample] = ms;
+                        s.next_sample = (s.next_sample + 1) % n_samples;
+                        s.n_samples = std::min(s.n_samples + 1, n_samples);
+                }
+        }
+}
+
+std::vector<GpuProfiler::Statistics> GpuProfiler::get_statistics() const
+{
+        std::lock_guard<std::mutex> lock(m_mutex);
+        std::vector<Statistics> result;
+        for (int i = 0; i < gs_count; ++i) {
+                const StageTimer& s = m_stages[i];
+                Statistics stat{stage_names[i], s.n_samples, 0.0, 0.0, 0.0, 0.0};
+                if (s.n_samples > 0) {
+                        stat.last_ms = s.samples[(s.next_sample + n_samples - 1) % n_samples];
+                        stat.min_ms = stat.max_ms = stat.last_ms;
+                        double sum = 0.0;
+                        for (unsigned k = 0; k < s.n_samples; ++k) {
+                                sum += s.samples[k];
+                                stat.min_ms = std::min(stat.min_ms, s.samples[k]);
+                                stat.max_ms = std::max(stat.max_ms, s.samples[k]);
+                        }
+                        stat.mean_ms = sum / s.n_samples;
+                }
+                result.push_back(stat);
+        }
+        return result;
+}
+
+QString GpuProfiler::dump() const
+{
+        QString result;
+        QTextStream out(&result);
+        {
+                std::lock_guard<std::mutex> lock(m_mutex);
+                out << "# " << m_renderer << "\n";
+        }
+        out << "stage,samples,last_ms,mean_ms,min_ms,max_ms\n";
+        for (auto& s: get_statistics()) {
+                out << s.stage << "," << s.samples << "," << s.last_ms << ","
+                    << s.mean_ms << "," << s.min_ms << "," << s.max_ms << "\n";
+        }
+        return result;
+}
@@ -0,0 +1,119 @@
+/* -*- mia-c++  -*-
+ *
+ * This file is part of qtlmpick- a tool for landmark picking and
+ * visualization in volume data
+ * Copyright (c) Genoa 2017,  Gert Wollny
+ *
+ * qtlmpick is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with MIA; if not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef GPUPROFILER_HH
+#define GPUPROFILER_HH
+
+#include <QString>
+#include <mutex>
+#include <vector>
+
+class QOpenGLTimerQuery;
+
+/**
+  \brief Measures the GPU time of the rendering stages
+
+  Each stage has a small ring of timer queries, a query is only read
+  when its result is available, so measuring never stalls the pipeline.
+  If all queries of a stage are still in flight the stage is not
+  measured in that frame. The statistics are kept over the last samples
+  of each stage and may be read from any thread.
+
+  Timer queries can't be nested, hence the stages must not overlap.
+*/
+class GpuProfiler {
+public:
+        enum EStage {
+                gs_ray_setup,   /**< drawing the proxy cube to obtain the ray start and end points */
+                gs_raycast,     /**< casting the rays through the volume */
+                gs_blit,        /**< drawing the ray casting result to the frame */
+                gs_pick,        /**< reading back the texture coordinates for picking */
+                gs_landmarks,   /**< drawing the landmark spheres */
+                gs_count
+        };
+
+        struct Statistics {
+                QString stage;
+                unsigned samples;
+                double last_ms;
+                double mean_ms;
+                double min_ms;
+                double max_ms;
+        };
+
+        /// Measures a stage while in scope, does nothing if profiler is null
+        class Scope {
+        public:
+                Scope(GpuProfiler *profiler, EStage stage);
+                ~Scope();
+        private:
+                GpuProfiler *m_profiler;
+                EStage m_stage;
+        };
+
+        GpuProfiler();
+        ~GpuProfiler();
+
+        /**
+           Create the queries, requires the context to be current.
+           \returns false if timer queries are not supported, then nothing is measured
+        */
+        bool attach_gl();
+
+        void detach_gl();
+
+        void begin(EStage stage);
+        void end(EStage stage);
+
+        /// read the results of the finished queries without waiting
+        void collect();
+
+        /// \returns the statistics of all stages, may be called from any thread
+        std::vector<Statistics> get_statistics() const;
+
+        /// \returns the statistics as CSV, one line per stage, preceded by the renderer description
+        QString dump() const;
+
+        static const char *get_stage_name(EStage stage);
+
+private:
+        struct Query {
+                QOpenGLTimerQuery *query;
+                bool in_flight;
+        };
+
+        struct StageTimer {
+                std::vector<Query> queries;
+                unsigned next;
+                int running;
+
+                std::vector<double> samples;
+                unsigned n_samples;
+                unsigned next_sample;
+        };
+
+        StageTimer m_stages[gs_count];
+        bool m_is_attached;
+        QString m_renderer;
+        mutable std::mutex m_mutex;
+};
+
+#endif // GPUPROFILER_HH
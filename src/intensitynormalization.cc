@@ -0,0 +1,154 @@
+/* -*- mia-c++  -*-
+ *
+ * This file is part of qtlmpick- a tool for landmark picking and
+ * visualization in volume data
+ * Copyright (c) Genoa 2017,  Gert Wollny
+ *
+ * qtlmpick is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with MIA; if not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include "intensitynormalization.hh"
+#include "parallel.hh"
+#include <mia/core/filter.hh>
+#include <algorithm>
+#include <iterator>
+#include <memory>
+#include <vector>
+
+using mia::C3DFImage;
+
+using std::unique_ptr;
+using std::vector;
+using std::make_pair;
+
+namespace {
+
+/* Intensity range of n values. The values are reduced into independent lanes
+ * and the lanes are combined at the end, this breaks the dependency between
+ * the loop iterations so that the compiler can vectorize the inner loop. */
+template <typename I>
+std::pair<typename std::iterator_traits<I>::value_type, typename std::iterator_traits<I>::value_type>
+minmax_kernel(I v, size_t n)
+{
+        typedef typename std::iterator_traits<I>::value_type T;
+        const unsigned lanes = 16;
+        T lmin[lanes];
+        T lmax[lanes];
+        std::fill(lmin, lmin + lanes, v[0]);
+        std::fill(lmax, lmax + lanes, v[0]);
+
+        size_t i = 0;
+        for (; i + lanes <= n; i += lanes)
+                for (unsigned l = 0; l < lanes; ++l) {
+                        T x = v[i + l];
+                        lmin[l] = x < lmin[l] ? x : lmin[l];
+                        lmax[l] = x > lmax[l] ? x : lmax[l];
+                }
+        for (; i < n; ++i) {
+                T x = v[i];
+                lmin[0] = x < lmin[0] ? x : lmin[0];
+                lmax[0] = x > lmax[0] ? x : lmax[0];
+        }
+        return make_pair(*std::min_element(lmin, lmin + lanes),
+                         *std::max_element(lmax, lmax + lanes));
+}
+
+/* out = (in - shift) * scale for n values, written for the auto-vectorizer */
+template <typename I>
+void scale_shift_kernel(I in, float *out, size_t n, float scale, float shift)
+{
+        for (size_t i = 0; i < n; ++i)
+                out[i] = (in[i] - shift) * scale;
+}
+
+/* obtain the intensity range of the input image, the slices are processed in parallel */
+struct GetIntensityRange: public mia::TFilter<std::pair<float, float>> {
+
+        GetIntensityRange(const NormalizationProgress& progress):
+                m_progress(progress)
+        {
+        }
+
+        template <typename T>
+        std::pair<float, float> operator() (const mia::T3DImage<T>& input) {
+                //should test that there are more than one
+                auto size = input.get_size();
+                const size_t slice_size = size.x * size.y;
+
+                vector<std::pair<T, T>> slice_range(size.z);
+                auto slice = [&](unsigned z) {
+                        slice_range[z] = minmax_kernel(input.begin_at(0, 0, z), slice_size);
+                };
+                parallel_blocks(size.z, slice, m_progress);
+
+                T vmin = slice_range[0].first;
+                T vmax = slice_range[0].second;
+                for (auto& r: slice_range) {
+                        if (r.first < vmin)
+                                vmin = r.first;
+                        if (r.second > vmax)
+                                vmax = r.second;
+                }
+                return make_pair(vmin, vmax);
+        }
+private:
+        const NormalizationProgress& m_progress;
+};
+
+/* convert the input image to a float valued picture that
+ * optimally uses the intensity range [0,1]; */
+struct GetFloat01Picture: public mia::TFilter<mia::C3DFImage *> {
+
+        GetFloat01Picture(float scale, float shift, const NormalizationProgress& progress):
+                m_scale(scale),
+                m_shift(shift),
+                m_progress(progress)
+        {
+        }
+
+        template <typename T>
+        mia::C3DFImage *operator() (const mia::T3DImage<T>& input) {
+                auto size = input.get_size();
+                const size_t slice_size = size.x * size.y;
+                unique_ptr<C3DFImage> result(new C3DFImage(size, input));
+                float *out = &(*result)[0];
+
+                auto slice = [&](unsigned z) {
+                        scale_shift_kernel(input.begin_at(0, 0, z), out + z * slice_size,
+                                           slice_size, m_scale, m_shift);
+                };
+                parallel_blocks(size.z, slice, m_progress);
+                return result.release();
+        }
+private:
+        float m_scale;
+        float m_shift;
+        const NormalizationProgress& m_progress;
+};
+
+}
+
+std::pair<float, float> get_intensity_range(const mia::C3DImage& image, const NormalizationProgress& progress)
+{
+        GetIntensityRange get_range(progress);
+        return mia::accumulate(get_range, image);
+}
+
+mia::P3DImage normalize_intensities(const mia::C3DImage& image, float scale, float shift,
+                                    const NormalizationProgress& progress)
+{
+        GetFloat01Picture scaler(scale, shift, progress);
+        return mia::P3DImage(mia::accumulate(scaler, image));
+}
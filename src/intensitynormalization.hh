@@ -0,0 +1,48 @@
+/* -*- mia-c++  -*-
+ *
+ * This file is part of qtlmpick- a tool for landmark picking and
+ * visualization in volume data
+ * Copyright (c) Genoa 2017,  Gert Wollny
+ *
+ * qtlmpick is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with MIA; if not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef INTENSITYNORMALIZATION_HH
+#define INTENSITYNORMALIZATION_HH
+
+#include <mia/3d/image.hh>
+#include <functional>
+#include <utility>
+
+/**
+  Called with the fraction of the work done, always from the calling
+  thread. Throwing an exception cancels the work.
+*/
+typedef std::function<void(float)> NormalizationProgress;
+
+/**
+  Evaluate the intensity range of the image, the slices are processed
+  on all hardware threads.
+*/
+std::pair<float, float> get_intensity_range(const mia::C3DImage& image, const NormalizationProgress& progress);
+
+/**
+  Convert the image to float with (value - shift) * scale, the slices are
+  processed on all hardware threads.
+*/
+mia::P3DImage normalize_intensities(const mia::C3DImage& image, float scale, float shift,
+                                    const NormalizationProgress& progress);
+
+#endif // INTENSITYNORMALIZATION_HH
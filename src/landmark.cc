@@ -45,6 +45,12 @@ Landmark::Landmark(const QString& name, const QVector3D& location, float iso, co
         m_flags = lm_name | lm_location | lm_camera | lm_iso_value;
 }
 
+void Landmark::touch()
+{
+        if (m_list_revision)
+                ++*m_list_revision;
+}
+
 bool Landmark::has(EFlags flag) const
 {
         return (flag &   m_flags) == flag;
@@ -58,6 +64,7 @@ bool Landmark::isSet() const
 void Landmark::clearFlag(EFlags flag)
 {
         m_flags = static_cast<Landmark::EFlags>(static_cast<int>(m_flags) & ~static_cast<int>(flag));
+        touch();
 }
 
 void Landmark::set(const QVector3D& location, float iso, const Camera& best_view)
@@ -68,23 +75,27 @@ void Landmark::set(const QVector3D& location, float iso, const Camera& best_view
         m_is_set = true;
 
         m_flags = m_flags  | lm_location | lm_camera | lm_iso_value;
+        touch();
 }
 
 void  Landmark::setLocation(const QVector3D& loc)
 {
         m_location = loc;
         m_flags = m_flags | lm_location;
+        touch();
 }
 
 void  Landmark::setCamera(const Camera& camera)
 {
         m_best_view = camera;
         m_flags = m_flags |lm_camera;
+        touch();
 }
 
 void Landmark::set_name(const QString& new_name)
 {
         m_name = new_name;
+        touch();
 }
 
 const QString& Landmark::getName() const
@@ -96,6 +107,7 @@ void Landmark::setTemplateImageFile(const QString& fname)
 {
         m_template_image_filename = fname;
         m_flags = m_flags | lm_picfile;
+        touch();
 }
 
 const QString& Landmark::getTemplateFilename() const
@@ -117,6 +129,7 @@ void Landmark::setIsoValue(float iso)
 {
         m_iso_value = iso;
         m_flags = m_flags | lm_iso_value;
+        touch();
 }
 
 float Landmark::getIsoValue() const
@@ -77,6 +77,9 @@ private:
 
         void set_name(const QString& new_name);
 
+        // report a change to the list that holds the landmark
+        void touch();
+
         QString m_name;
         bool m_is_set;
         QString m_template_image_filename;
@@ -86,6 +89,8 @@ private:
 
         enum EFlags m_flags;
 
+        // revision counter of the list that holds the landmark, set by LandmarkList
+        std::shared_ptr<unsigned> m_list_revision;
 };
 
 
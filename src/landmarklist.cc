@@ -24,7 +24,53 @@
 #include <QDir>
 #include <cassert>
 
-using std::for_each;
+LandmarkList::const_iterator::const_iterator(std::vector<PLandmark>::const_iterator pos,
+                                             std::vector<PLandmark>::const_iterator end):
+        m_pos(pos),
+        m_end(end)
+{
+        skip_removed();
+}
+
+void LandmarkList::const_iterator::skip_removed()
+{
+        while (m_pos != m_end && !*m_pos)
+                ++m_pos;
+}
+
+LandmarkList::const_iterator::reference LandmarkList::const_iterator::operator *() const
+{
+        return *m_pos;
+}
+
+LandmarkList::const_iterator::pointer LandmarkList::const_iterator::operator ->() const
+{
+        return &*m_pos;
+}
+
+LandmarkList::const_iterator& LandmarkList::const_iterator::operator ++()
+{
+        ++m_pos;
+        skip_removed();
+        return *this;
+}
+
+LandmarkList::const_iterator LandmarkList::const_iterator::operator ++(int)
+{
+        const_iterator result(*this);
+        ++(*this);
+        return result;
+}
+
+bool LandmarkList::const_iterator::operator == (const const_iterator& other) const
+{
+        return m_pos == other.m_pos;
+}
+
+bool LandmarkList::const_iterator::operator != (const const_iterator& other) const
+{
+        return m_pos != other.m_pos;
+}
 
 LandmarkList::LandmarkList(const QString& name):
         m_name(name),
@@ -41,52 +87,159 @@ bool LandmarkList::dirty() const
 void LandmarkList::setDirtyFlag(bool d)
 {
         m_dirty = d;
+        if (d)
+                ++*m_revision;
+}
+
+unsigned LandmarkList::revision() const
+{
+        return *m_revision;
+}
+
+namespace {
+inline unsigned lowbit(unsigned i)
+{
+        return i & (~i + 1);
+}
+}
+
+void LandmarkList::append_used_slot()
+{
+        // the new element covers the slots (i - lowbit(i), i], the ones
+        // before the new slot are summed up by the elements it covers
+        unsigned i = m_used_slots.size() + 1;
+        unsigned count = 1;
+        for (unsigned j = i - 1; j > i - lowbit(i); j -= lowbit(j))
+                count += m_used_slots[j - 1];
+        m_used_slots.push_back(count);
+}
+
+unsigned LandmarkList::get_row(unsigned slot) const
+{
+        if (!m_removed)
+                return slot;
+
+        unsigned row = 0;
+        for (unsigned i = slot; i > 0; i -= lowbit(i))
+                row += m_used_slots[i - 1];
+        return row;
+}
+
+unsigned LandmarkList::get_slot(unsigned row) const
+{
+        if (!m_removed)
+                return row;
+
+        // find the largest number of slots that hold no more than row landmarks,
+        // the next slot is then the one of the landmark
+        const unsigned n = m_used_slots.size();
+        unsigned step = 1;
+        while (2 * step <= n)
+                step *= 2;
+
+        unsigned slot = 0;
+        for (; step; step /= 2) {
+                if (slot + step <= n && m_used_slots[slot + step - 1] <= row) {
+                        slot += step;
+                        row -= m_used_slots[slot - 1];
+                }
+        }
+        assert(slot < m_list.size() && m_list[slot]);
+        return slot;
+}
+
+void LandmarkList::remove_slot(unsigned slot)
+{
+        m_list[slot]->m_list_revision.reset();
+        m_list[slot].reset();
+        for (unsigned i = slot + 1; i <= m_used_slots.size(); i += lowbit(i))
+                --m_used_slots[i - 1];
+        ++m_removed;
+
+        // the compaction is paid for by the removals since the last one
+        if (m_removed > m_list.size() / 2)
+                compact();
+}
+
+void LandmarkList::compact()
+{
+        unsigned k = 0;
+        for (unsigned i = 0; i < m_list.size(); ++i) {
+                if (!m_list[i])
+                        continue;
+                if (k != i) {
+                        m_list[k] = std::move(m_list[i]);
+                        m_index_map[m_list[k]->getName()] = k;
+                }
+                ++k;
+        }
+        m_list.resize(k);
+        m_removed = 0;
+
+        // all slots are used again
+        m_used_slots.resize(k);
+        for (unsigned i = 1; i <= k; ++i)
+                m_used_slots[i - 1] = lowbit(i);
+}
+
+LandmarkList::Pointer LandmarkList::snapshot() const
+{
+        auto result = std::make_shared<LandmarkList>(m_name);
+        result->m_filename = m_filename;
+        result->m_list.reserve(size());
+        for (auto lm: *this)
+                result->add(std::make_shared<Landmark>(*lm));
+        result->m_dirty = m_dirty;
+        *result->m_revision = *m_revision;
+        return result;
 }
 
 PLandmark LandmarkList::operator [](const QString& name)
 {
         auto i = m_index_map.find(name);
         if (i != m_index_map.end()) {
-                assert(i->second < m_list.size());
-                return m_list[i->second];
+                assert(i.value() < m_list.size());
+                return m_list[i.value()];
         }
         return PLandmark();
 }
 
 const Landmark& LandmarkList::at(unsigned  i) const
 {
-        assert(i < m_list.size());
-        return *m_list[i];
+        assert(i < size());
+        return *m_list[get_slot(i)];
 }
 
 Landmark& LandmarkList::at(unsigned i)
 {
-        assert(i < m_list.size());
-        return *m_list[i];
+        assert(i < size());
+        return *m_list[get_slot(i)];
 }
 
 
 PLandmark LandmarkList::operator [](unsigned  i)
 {
-        assert(i < m_list.size());
-        return m_list[i];
+        assert(i < size());
+        return m_list[get_slot(i)];
 }
 
 bool LandmarkList::add(PLandmark landmark)
 {
-        auto i = m_index_map.find(landmark->getName());
-        if (i != m_index_map.end())
+        if (m_index_map.contains(landmark->getName()))
                 return false;
-        m_index_map[landmark->getName()] = m_list.size();
+        m_index_map.insert(landmark->getName(), m_list.size());
         m_list.push_back(landmark);
+        append_used_slot();
+        landmark->m_list_revision = m_revision;
 
         m_dirty = true;
+        ++*m_revision;
         return true;
 }
 
 size_t LandmarkList::size() const
 {
-        return m_list.size();
+        return m_list.size() - m_removed;
 }
 
 QString LandmarkList::getFilename() const
@@ -111,37 +264,35 @@ void LandmarkList::setName(const QString &name)
 
 void LandmarkList::remove(unsigned idx, unsigned count)
 {
-        unsigned end = idx + count;
+        assert(idx + count <= size());
 
-        for (unsigned  i = idx; i < end; ++i) {
-        m_index_map.erase(m_list[i]->getName());
+        // the following landmarks move up with each removal
+        for (unsigned  i = 0; i < count; ++i) {
+                unsigned slot = get_slot(idx);
+                m_index_map.remove(m_list[slot]->getName());
+                remove_slot(slot);
         }
 
-        m_list.erase(m_list.begin() + idx, m_list.begin() + end);
-
-        for_each(m_index_map.begin(), m_index_map.end(),
-                 [idx,count](std::map<QString, unsigned>::value_type& it){
-                if (it.second >= idx)
-                        it.second -= count;
-        });
         m_dirty = true;
+        ++*m_revision;
 }
 
 int LandmarkList::renameLandmark(const QString& old_name, const QString& new_name)
 {
         auto i = m_index_map.find(old_name);
-        int idx = i->second;
+        unsigned slot = i.value();
         if (old_name != new_name) {
                 // the new name is already used and it is not the old name
                 if (has(new_name))
                         return -1;
 
                 m_index_map.erase(i);
-                m_list[idx]->set_name(new_name);
-                m_index_map[new_name] = idx;
+                m_list[slot]->set_name(new_name);
+                m_index_map.insert(new_name, slot);
                 m_dirty = true;
         }
-        return idx;
+        // the caller gets the row of the landmark
+        return get_row(slot);
 }
 
 bool LandmarkList::remove(const QString& name)
@@ -150,38 +301,34 @@ bool LandmarkList::remove(const QString& name)
         if (i == m_index_map.end())
                 return false;
 
-        unsigned idx = i->second;
-        m_list.erase(m_list.begin() + idx);
+        // leave a tombstone, the following landmarks are not moved
+        unsigned slot = i.value();
         m_index_map.erase(i);
+        remove_slot(slot);
 
-        // correct index map
-        for_each(m_index_map.begin(), m_index_map.end(),
-                 [idx](std::map<QString, unsigned>::value_type& it){
-                if (it.second >= idx)
-                        --it.second;
-        });
         m_dirty = true;
+        ++*m_revision;
         return true;
 }
 
 bool LandmarkList::has(const QString& name) const
 {
-        return m_index_map.find(name) != m_index_map.end();
+        return m_index_map.contains(name);
 }
 
 LandmarkList::const_iterator LandmarkList::begin() const
 {
-        return m_list.begin();
+        return const_iterator(m_list.begin(), m_list.end());
 }
 
 LandmarkList::const_iterator LandmarkList::end() const
 {
-        return m_list.end();
+        return const_iterator(m_list.end(), m_list.end());
 }
 
 bool LandmarkList::hasTemplatePictures() const
 {
-        for (auto lm: m_list) {
+        for (auto lm: *this) {
                 if (lm->has(Landmark::lm_picfile))
                         return true;
         }
@@ -197,7 +344,7 @@ QString LandmarkList::getBaseDir() const
 
 void LandmarkList::clearAllLocations()
 {
-        for (auto lm: m_list) {
+        for (auto lm: *this) {
                 lm->clearFlag(Landmark::lm_location);
         }
         setDirtyFlag(true);
@@ -205,8 +352,8 @@ void LandmarkList::clearAllLocations()
 
 bool LandmarkList::clearLandmark(int idx)
 {
-        if (idx >= 0 && static_cast<size_t>(idx) < m_list.size()) {
-                PLandmark lm = m_list[idx];
+        if (idx >= 0 && static_cast<size_t>(idx) < size()) {
+                PLandmark lm = m_list[get_slot(idx)];
                 if (lm->has(Landmark::lm_location)) {
                         lm->clearFlag(Landmark::lm_location);
                         return true;
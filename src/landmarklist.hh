@@ -23,15 +23,51 @@
 #define LANDMARKLIST_HH
 
 #include <landmark.hh>
-#include <map>
+#include <QHash>
+#include <iterator>
 #include <memory>
-
+#include <vector>
+
+/**
+  \brief An ordered list of uniquely named landmarks
+
+  The landmarks are found by name through a hash index. Removing a
+  landmark only leaves a tombstone in its slot, so removal doesn't move
+  the other landmarks. A landmark is found by its position (row) through
+  a binary indexed tree that counts the used slots, and the tombstones
+  are only compacted when they make up more than half of the slots.
+  Hence access by name, adding and removing take constant amortized time
+  and access by position takes logarithmic time.
+*/
 class LandmarkList
 {
 public:
         typedef std::shared_ptr<LandmarkList> Pointer;
 
-        typedef std::vector<PLandmark>::const_iterator const_iterator;
+        /// iterates over the landmarks in their order, skipping removed ones
+        class const_iterator {
+        public:
+                typedef std::forward_iterator_tag iterator_category;
+                typedef PLandmark value_type;
+                typedef std::ptrdiff_t difference_type;
+                typedef const PLandmark *pointer;
+                typedef const PLandmark& reference;
+
+                const_iterator(std::vector<PLandmark>::const_iterator pos,
+                               std::vector<PLandmark>::const_iterator end);
+
+                reference operator *() const;
+                pointer operator ->() const;
+                const_iterator& operator ++();
+                const_iterator operator ++(int);
+                bool operator == (const const_iterator& other) const;
+                bool operator != (const const_iterator& other) const;
+        private:
+                void skip_removed();
+
+                std::vector<PLandmark>::const_iterator m_pos;
+                std::vector<PLandmark>::const_iterator m_end;
+        };
 
         LandmarkList() = default;
 
@@ -81,14 +117,46 @@ public:
 
         void clearAllLocations();
 
+        /**
+           \returns a counter that changes whenever landmarks are added, removed
+           or renamed, or one of the landmarks of the list is modified
+        */
+        unsigned revision() const;
+
+        /// \returns a deep copy of the list that can be handed to another thread
+        Pointer snapshot() const;
+
 private:
+        // remove the tombstones, afterwards the slot of a landmark is its position
+        void compact();
+
+        // mark the landmark in the slot as removed
+        void remove_slot(unsigned slot);
+
+        // the row of the landmark in the given slot
+        unsigned get_row(unsigned slot) const;
+
+        // the slot of the landmark in the given row
+        unsigned get_slot(unsigned row) const;
+
+        // add one to the number of used slots at the end
+        void append_used_slot();
+
         QString m_name;
         QString m_filename;
 
+        // removed landmarks leave a nullptr in their slot
         std::vector<PLandmark> m_list;
-        std::map<QString, unsigned> m_index_map;
+        QHash<QString, unsigned> m_index_map;
+        unsigned m_removed = 0;
+
+        // binary indexed tree over the number of used slots, element i (one based)
+        // holds the count of the slots (i - lowbit(i), i]
+        std::vector<unsigned> m_used_slots;
 
         bool m_dirty;
+        // shared with the landmarks of the list, so that their setters can count as change
+        std::shared_ptr<unsigned> m_revision = std::make_shared<unsigned>(0);
 };
 
 typedef LandmarkList::Pointer PLandmarkList;
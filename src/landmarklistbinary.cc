@@ -0,0 +1,251 @@
+/* -*- mia-c++  -*-
+ *
+ * This file is part of qtlmpick- a tool for landmark picking and
+ * visualization in volume data
+ * Copyright (c) Genoa 2017,  Gert Wollny
+ *
+ * qtlmpick is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with MIA; if not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include "landmarklistbinary.hh"
+#include "qruntimeexeption.hh"
+
+#include <QCoreApplication>
+#include <QFileInfo>
+#include <QSaveFile>
+#include <QFile>
+#include <QDebug>
+#include <cstring>
+#include <vector>
+
+using std::make_shared;
+
+namespace {
+
+inline QString _(const char *text)
+{
+        return QCoreApplication::translate("lmio", text);
+}
+
+const char list_magic[8] = {'L', 'M', 'P', 'L', 'M', 'B', 'I', 'N'};
+const quint32 list_version = 1;
+const quint32 byte_order_mark = 0x01020304;
+
+/* The file starts with the header, followed by the landmark records and
+ * the string table that holds the UTF-8 encoded names and file names. Like
+ * the volume cache the data is stored in native byte order, byte_order is
+ * used to reject files written on a machine with a different one. */
+struct ListHeader {
+        char magic[8];
+        quint32 version;
+        quint32 byte_order;
+        quint32 record_size;
+        quint32 n_landmarks;
+        quint64 records_offset;
+        quint64 strings_offset;
+        quint64 strings_bytes;
+        quint32 name_offset;
+        quint32 name_size;
+};
+
+// a string in the string table
+struct StringRef {
+        quint32 offset;
+        quint32 size;
+};
+
+struct LandmarkRecord {
+        quint32 flags;
+        StringRef name;
+        StringRef picfile;
+        float location[3];
+        float iso_value;
+        float camera_position[3];
+        float camera_rotation[4]; // x, y, z, scalar
+        float camera_zoom;
+};
+
+static_assert(sizeof(LandmarkRecord) == 68, "LandmarkRecord must be packed");
+
+const quint32 all_flags = Landmark::lm_name | Landmark::lm_picfile | Landmark::lm_location |
+                          Landmark::lm_iso_value | Landmark::lm_camera;
+
+// whether [offset, offset + bytes) lies within [0, end), written so that
+// the values read from a file can not overflow
+bool is_within(quint64 offset, quint64 bytes, quint64 end)
+{
+        return offset <= end && bytes <= end - offset;
+}
+
+StringRef add_string(QByteArray& strings, const QString& s)
+{
+        QByteArray utf8 = s.toUtf8();
+        StringRef ref{static_cast<quint32>(strings.size()), static_cast<quint32>(utf8.size())};
+        strings.append(utf8);
+        return ref;
+}
+
+}
+
+bool is_binary_landmarklist_filename(const QString& filename)
+{
+        return QFileInfo(filename).suffix() == "lmb";
+}
+
+PLandmarkList read_landmarklist_binary(const QString& filename)
+{
+        QFile file(filename);
+        if (!file.open(QIODevice::ReadOnly))
+                throw QRuntimeExeption(_("Unable to open file: %1").arg(filename));
+
+        const qint64 file_size = file.size();
+        if (file_size < static_cast<qint64>(sizeof(ListHeader)))
+                throw QRuntimeExeption(_("%1 is not a binary landmark list").arg(filename));
+
+        // the mapping is released when the file is closed
+        const uchar *mapped = file.map(0, file_size);
+        if (!mapped)
+                throw QRuntimeExeption(_("Unable to map file: %1").arg(filename));
+
+        ListHeader header;
+        memcpy(&header, mapped, sizeof(header));
+        if (memcmp(header.magic, list_magic, sizeof(list_magic)))
+                throw QRuntimeExeption(_("%1 is not a binary landmark list").arg(filename));
+
+        if (header.version != list_version ||
+            header.byte_order != byte_order_mark ||
+            header.record_size != sizeof(LandmarkRecord))
+                throw QRuntimeExeption(_("%1: unsupported version or byte order of the binary landmark list")
+                                       .arg(filename));
+
+        const quint64 records_bytes = quint64(header.n_landmarks) * sizeof(LandmarkRecord);
+        if (!is_within(header.records_offset, records_bytes, file_size) ||
+            !is_within(header.strings_offset, header.strings_bytes, file_size))
+                throw QRuntimeExeption(_("%1: the binary landmark list is truncated").arg(filename));
+
+        const char *strings = reinterpret_cast<const char *>(mapped + header.strings_offset);
+        auto get_string = [&](const StringRef& ref) {
+                if (!is_within(ref.offset, ref.size, header.strings_bytes))
+                        throw QRuntimeExeption(_("%1: corrupt string table").arg(filename));
+                return QString::fromUtf8(strings + ref.offset, ref.size);
+        };
+
+        PLandmarkList result = make_shared<LandmarkList>(get_string(StringRef{header.name_offset, header.name_size}));
+        result->setFilename(filename);
+
+        const uchar *records = mapped + header.records_offset;
+        for (quint32 i = 0; i < header.n_landmarks; ++i) {
+                LandmarkRecord r;
+                memcpy(&r, records + i * sizeof(LandmarkRecord), sizeof(r));
+
+                const Landmark::EFlags flags = static_cast<Landmark::EFlags>(r.flags & all_flags);
+                PLandmark lm = make_shared<Landmark>(get_string(r.name));
+
+                if (flags & Landmark::lm_picfile)
+                        lm->setTemplateImageFile(get_string(r.picfile));
+
+                QVector3D location(r.location[0], r.location[1], r.location[2]);
+                Camera camera(QVector3D(r.camera_position[0], r.camera_position[1], r.camera_position[2]),
+                              QQuaternion(r.camera_rotation[3], r.camera_rotation[0],
+                                          r.camera_rotation[1], r.camera_rotation[2]),
+                              r.camera_zoom);
+
+                // same as reading the XML format: a complete landmark is set at once
+                const auto complete = Landmark::lm_location | Landmark::lm_iso_value | Landmark::lm_camera;
+                if ((flags & complete) == complete) {
+                        lm->set(location, r.iso_value, camera);
+                } else {
+                        if (flags & Landmark::lm_location)
+                                lm->setLocation(location);
+                        if (flags & Landmark::lm_iso_value)
+                                lm->setIsoValue(r.iso_value);
+                        if (flags & Landmark::lm_camera)
+                                lm->setCamera(camera);
+                }
+                if (!(flags & Landmark::lm_name))
+                        lm->clearFlag(Landmark::lm_name);
+
+                if (!result->add(lm))
+                        qWarning() << filename << ": Skipped duplicate landmark" << lm->getName();
+        }
+        return result;
+}
+
+bool write_landmarklist_binary(const QString& filename, const LandmarkList& list)
+{
+        QSaveFile file(filename);
+        if (!file.open(QIODevice::WriteOnly))
+                throw QRuntimeExeption(_("Unable to open '%1'' for writing.").arg(filename));
+
+        QByteArray strings;
+        std::vector<LandmarkRecord> records;
+        records.reserve(list.size());
+
+        for (auto& plm: list) {
+                const Landmark& lm = *plm;
+                LandmarkRecord r;
+                memset(&r, 0, sizeof(r));
+
+                for (auto flag: {Landmark::lm_name, Landmark::lm_picfile, Landmark::lm_location,
+                                        Landmark::lm_iso_value, Landmark::lm_camera}) {
+                        if (lm.has(flag))
+                                r.flags |= flag;
+                }
+
+                r.name = add_string(strings, lm.getName());
+                if (lm.has(Landmark::lm_picfile))
+                        r.picfile = add_string(strings, lm.getTemplateFilename());
+
+                const QVector3D& loc = lm.getLocation();
+                r.location[0] = loc.x();
+                r.location[1] = loc.y();
+                r.location[2] = loc.z();
+                r.iso_value = lm.has(Landmark::lm_iso_value) ? lm.getIsoValue() : 0.0f;
+
+                const Camera& c = lm.getCamera();
+                r.camera_position[0] = c.get_position().x();
+                r.camera_position[1] = c.get_position().y();
+                r.camera_position[2] = c.get_position().z();
+                r.camera_rotation[0] = c.get_rotation().x();
+                r.camera_rotation[1] = c.get_rotation().y();
+                r.camera_rotation[2] = c.get_rotation().z();
+                r.camera_rotation[3] = c.get_rotation().scalar();
+                r.camera_zoom = c.get_zoom();
+
+                records.push_back(r);
+        }
+
+        ListHeader header;
+        memset(&header, 0, sizeof(header));
+        memcpy(header.magic, list_magic, sizeof(list_magic));
+        header.version = list_version;
+        header.byte_order = byte_order_mark;
+        header.record_size = sizeof(LandmarkRecord);
+        header.n_landmarks = records.size();
+
+        StringRef name = add_string(strings, list.getName());
+        header.name_offset = name.offset;
+        header.name_size = name.size;
+
+        header.records_offset = sizeof(header);
+        header.strings_offset = header.records_offset + records.size() * sizeof(LandmarkRecord);
+        header.strings_bytes = strings.size();
+
+        file.write(reinterpret_cast<const char *>(&header), sizeof(header));
+        file.write(reinterpret_cast<const char *>(records.data()), records.size() * sizeof(LandmarkRecord));
+        file.write(strings);
+
+        return file.commit();
+}
@@ -0,0 +1,47 @@
+/* -*- mia-c++  -*-
+ *
+ * This file is part of qtlmpick- a tool for landmark picking and
+ * visualization in volume data
+ * Copyright (c) Genoa 2017,  Gert Wollny
+ *
+ * qtlmpick is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with MIA; if not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef LANDMARKLISTBINARY_HH
+#define LANDMARKLISTBINARY_HH
+
+#include "landmarklist.hh"
+
+/**
+   Read a landmark list in the binary format. The file is mapped into
+   memory and the landmarks are created directly from the fixed size
+   records, only the names and file names are converted.
+   \throws QRuntimeExeption if the file can't be read or is not a valid binary landmark list
+*/
+PLandmarkList read_landmarklist_binary(const QString& filename);
+
+/**
+   Write the list in the binary format. All values are stored as they are
+   kept in memory, so a list read back is identical to the list written.
+   The file is first written to a temporary file that replaces the original
+   only if writing succeeded.
+   \throws QRuntimeExeption if the file can't be opened for writing
+*/
+bool write_landmarklist_binary(const QString& filename, const LandmarkList& list);
+
+/// \returns whether the file name has the suffix of the binary format
+bool is_binary_landmarklist_filename(const QString& filename);
+
+#endif // LANDMARKLISTBINARY_HH
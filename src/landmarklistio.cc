@@ -23,11 +23,18 @@
 #include "landmarklist.hh"
 #include "landmark.hh"
 #include "qruntimeexeption.hh"
+#include "numberformat.hh"
+#include "landmarklistbinary.hh"
 
 #include <QObject>
 #include <QCoreApplication>
 #include <QDomDocument>
+#include <QXmlStreamReader>
+#include <QXmlStreamWriter>
+#include <QSaveFile>
+#include <QHash>
 #include <QFile>
+#include <QByteArray>
 #include <cassert>
 
 using std::make_pair;
@@ -40,13 +47,33 @@ inline QString _(const char *text)
 }
 
 
+/*
+  The text of the child elements of a landmark and of its camera. As with
+  QDomElement::firstChildElement only the first element of a tag counts.
+  Both parser backends fill this, so the interpretation of the values is
+  the same for both.
+*/
+typedef QHash<QString, QString> TagValues;
+
+struct LandmarkTags {
+        LandmarkTags();
+        TagValues values;
+        bool has_camera;
+        TagValues camera;
+};
+
 class LandmarkReader : protected QObject {
 public:
         LandmarkReader(const QString& filename);
+
+        /// read the list from the DOM tree of the whole file
         PLandmarkList read(const QDomElement& root);
+
+        /// read the list while the file is parsed, the reader must be positioned at the <list> tag
+        PLandmarkList read(QXmlStreamReader& xml);
 private:
-        PLandmark read_landmark(const QDomElement& root);
-        virtual pair<bool, Camera> read_camera(const QDomElement& elm) = 0;
+        PLandmark read_landmark(const LandmarkTags& tags);
+        virtual pair<bool, Camera> read_camera(const LandmarkTags& tags) = 0;
         QString m_filename;
 
 };
@@ -55,27 +82,28 @@ class LandmarkReaderV1 : public LandmarkReader {
 public:
         using LandmarkReader::LandmarkReader;
 private:
-        pair<bool, Camera> read_camera(const QDomElement& elm) override;
+        pair<bool, Camera> read_camera(const LandmarkTags& tags) override;
 };
 
 class LandmarkReaderV2 : public LandmarkReader {
 public:
         using LandmarkReader::LandmarkReader;
 private:
-        pair<bool, Camera> read_camera(const QDomElement& elm) override;
+        pair<bool, Camera> read_camera(const LandmarkTags& tags) override;
 };
 
+static std::unique_ptr<LandmarkReader> create_reader(const QString& filename, int version)
+{
+        if (version < 2)
+                return std::unique_ptr<LandmarkReader>(new LandmarkReaderV1(filename));
+        else
+                return std::unique_ptr<LandmarkReader>(new LandmarkReaderV2(filename));
+}
 
-PLandmarkList read_landmarklist(const QString& filename)
+static PLandmarkList read_landmarklist_dom(QFile& file, const QString& filename)
 {
         QDomDocument reader;
 
-        QFile file(filename);
-        if (!file.open(QFile::ReadOnly | QFile::Text)) {
-                QString msg(_("Unable to open file: %1"));
-                throw QRuntimeExeption(msg.arg(filename));
-        }
-
         if (!reader.setContent(&file)) {
                 file.close();
                 QString msg(_("Unable to read file as XML: %1"));
@@ -91,14 +119,52 @@ PLandmarkList read_landmarklist(const QString& filename)
         // try to read version attribute
         int version = list_elm.attribute("version", "1").toInt();
 
-        std::unique_ptr<LandmarkReader> reader_backend;
+        return create_reader(filename, version)->read(list_elm);
+}
 
-        if (version < 2)
-                reader_backend.reset(new LandmarkReaderV1(filename));
-        else
-                reader_backend.reset(new LandmarkReaderV2(filename));
+static PLandmarkList read_landmarklist_stream(QFile& file, const QString& filename)
+{
+        QXmlStreamReader xml(&file);
+
+        if (!xml.readNextStartElement()) {
+                QString msg(_("Unable to read file as XML: %1"));
+                throw QRuntimeExeption(msg.arg(filename));
+        }
+
+        if (xml.name() != "list") {
+                QString msg(_("%1 not a landmark list file, got tag <%2> but expected <list>"));
+                throw QRuntimeExeption(msg.arg(filename).arg(xml.name().toString()));
+        }
+        // try to read version attribute
+        QString version_attr = xml.attributes().value("version").toString();
+        int version = version_attr.isEmpty() ? 1 : version_attr.toInt();
+
+        auto result = create_reader(filename, version)->read(xml);
+
+        // like the DOM parser reject files that are not well-formed after the list
+        while (!xml.atEnd())
+                xml.readNext();
+
+        if (xml.hasError()) {
+                QString msg(_("Unable to read file as XML: %1:%2: %3"));
+                throw QRuntimeExeption(msg.arg(filename).arg(xml.lineNumber()).arg(xml.errorString()));
+        }
+        return result;
+}
+
+PLandmarkList read_landmarklist(const QString& filename, ELandmarkParser parser)
+{
+        if (is_binary_landmarklist_filename(filename))
+                return read_landmarklist_binary(filename);
+
+        QFile file(filename);
+        if (!file.open(QFile::ReadOnly | QFile::Text)) {
+                QString msg(_("Unable to open file: %1"));
+                throw QRuntimeExeption(msg.arg(filename));
+        }
 
-        auto result = reader_backend->read(list_elm);
+        auto result = parser == lp_dom ? read_landmarklist_dom(file, filename) :
+                                         read_landmarklist_stream(file, filename);
 
         result->setFilename(filename);
         return result;
@@ -120,73 +186,121 @@ struct read_tag_dispatch<QString> {
         }
 };
 
+// large enough for the text of four floats
+static const int number_buffer_size = 128;
+
+/*
+  Parse exactly n numbers from the text, the characters are copied to a
+  buffer on the stack, only unusually long texts need an allocation.
+*/
+template <typename T>
+static bool parse_tag_numbers(const QString& value, T *values, int n)
+{
+        char buffer[number_buffer_size];
+        const int len = value.size();
+        if (len <= number_buffer_size) {
+                const QChar *text = value.constData();
+                for (int i = 0; i < len; ++i) {
+                        // non latin1 characters can't be part of a number
+                        buffer[i] = text[i].unicode() < 128 ? static_cast<char>(text[i].unicode()) : '?';
+                }
+                return parse_numbers(buffer, buffer + len, values, n) == n;
+        }
+        QByteArray text = value.toLatin1();
+        return parse_numbers(text.constData(), text.constData() + text.size(), values, n) == n;
+}
+
 template <>
 struct read_tag_dispatch<float> {
         static float apply(const QString& value) {
-                return value.toFloat();
+                float v;
+                if (!parse_tag_numbers(value, &v, 1)) {
+                        throw QRuntimeExeption(_("Failed to read '%1' as float").arg(value));
+                }
+                return v;
         }
 };
 
 template <>
 struct read_tag_dispatch<int> {
         static int apply(const QString& value) {
-                return value.toInt();
+                int v;
+                if (!parse_tag_numbers(value, &v, 1)) {
+                        throw QRuntimeExeption(_("Failed to read '%1' as int").arg(value));
+                }
+                return v;
         }
 };
 
 template <>
 struct read_tag_dispatch<QVector3D> {
         static QVector3D apply(const QString& value) {
-                QStringList v = value.split(" ");
-                if (v.length() != 3) {
+                float v[3];
+                if (!parse_tag_numbers(value, v, 3)) {
                         throw QRuntimeExeption(_("Failed to read '%1' as QVector3D").arg(value));
                 }
-                float x = v.at(0).toFloat();
-                float y = v.at(1).toFloat();
-                float z = v.at(2).toFloat();
-                return QVector3D(x,y,z);
+                return QVector3D(v[0], v[1], v[2]);
         }
 };
 
 template <>
 struct read_tag_dispatch<QQuaternion> {
         static QQuaternion apply(const QString& value) {
-                QStringList v = value.split(" ");
-                if (v.length() != 4) {
+                float v[4];
+                if (!parse_tag_numbers(value, v, 4)) {
                         throw QRuntimeExeption(_("Failed to read '%1' as QQuaternion").arg(value));
                 }
-                float x = v.at(0).toFloat();
-                float y = v.at(1).toFloat();
-                float z = v.at(2).toFloat();
-                float w = v.at(3).toFloat();
-                return QQuaternion(w, x, y, z);
+                return QQuaternion(v[3], v[0], v[1], v[2]);
         }
 };
 
 template <typename T>
-pair<bool, T> read_tag(const QDomElement& parent, const QString& tag)
+pair<bool, T> read_tag(const TagValues& values, const QString& tag)
 {
-        auto elm = parent.firstChildElement(tag);
-        if (elm.isNull())
+        auto elm = values.find(tag);
+        if (elm == values.end())
                 return make_pair(false, T());
 
-        T value = read_tag_dispatch<T>::apply(elm.text());
+        T value = read_tag_dispatch<T>::apply(elm.value());
         return make_pair(true, value);
 }
 
+static void collect_tags(const QDomElement& parent, TagValues& values)
+{
+        for (auto elm = parent.firstChildElement(); !elm.isNull(); elm = elm.nextSiblingElement()) {
+                if (!values.contains(elm.tagName()))
+                        values.insert(elm.tagName(), elm.text());
+        }
+}
+
+static void collect_tags(QXmlStreamReader& xml, TagValues& values)
+{
+        while (xml.readNextStartElement()) {
+                QString tag = xml.name().toString();
+                QString text = xml.readElementText(QXmlStreamReader::IncludeChildElements);
+                if (!values.contains(tag))
+                        values.insert(tag, text);
+        }
+}
+
+LandmarkTags::LandmarkTags():
+        has_camera(false)
+{
+}
+
 LandmarkReader::LandmarkReader(const QString& filename):
         m_filename(filename)
 {
 }
 
-pair<bool, Camera> LandmarkReaderV1::read_camera(const QDomElement& parent)
+pair<bool, Camera> LandmarkReaderV1::read_camera(const LandmarkTags& tags)
 {
         Camera camera;
 
-        auto elm = parent.firstChildElement("camera");
-        if (elm.isNull())
+        if (!tags.has_camera)
                 return make_pair(false, Camera());
 
+        auto& elm = tags.camera;
 
         auto loc = read_tag<QVector3D>(elm, "location");
         if (loc.first)
@@ -216,14 +330,14 @@ pair<bool, Camera> LandmarkReaderV1::read_camera(const QDomElement& parent)
         return make_pair(true, camera);
 }
 
-pair<bool, Camera> LandmarkReaderV2::read_camera(const QDomElement& parent)
+pair<bool, Camera> LandmarkReaderV2::read_camera(const LandmarkTags& tags)
 {
         Camera camera;
 
-        auto elm = parent.firstChildElement("camera");
-        if (elm.isNull())
+        if (!tags.has_camera)
                 return make_pair(false, Camera());
 
+        auto& elm = tags.camera;
 
         auto loc = read_tag<QVector3D>(elm, "location");
         if (loc.first)
@@ -257,7 +371,15 @@ PLandmarkList LandmarkReader::read(const QDomElement& root)
         auto landmark_elm = root.firstChildElement("landmark");
 
         while (!landmark_elm.isNull()) {
-                auto lm = read_landmark(landmark_elm);
+                LandmarkTags tags;
+                collect_tags(landmark_elm, tags.values);
+                auto camera_elm = landmark_elm.firstChildElement("camera");
+                if (!camera_elm.isNull()) {
+                        tags.has_camera = true;
+                        collect_tags(camera_elm, tags.camera);
+                }
+
+                auto lm = read_landmark(tags);
                 if (lm)
                         result->add(lm);
                 else
@@ -267,8 +389,50 @@ PLandmarkList LandmarkReader::read(const QDomElement& root)
         return result;
 }
 
-PLandmark LandmarkReader::read_landmark(const QDomElement& elm)
+PLandmarkList LandmarkReader::read(QXmlStreamReader& xml)
+{
+        PLandmarkList result = make_shared<LandmarkList>("(unknown)");
+        result->setFilename(m_filename);
+        bool has_name = false;
+
+        // the landmarks are created as their tags are parsed, so the
+        // document is never held in memory as a whole
+        while (xml.readNextStartElement()) {
+                if (xml.name() == "landmark") {
+                        LandmarkTags tags;
+                        while (xml.readNextStartElement()) {
+                                if (xml.name() == "camera" && !tags.has_camera) {
+                                        tags.has_camera = true;
+                                        collect_tags(xml, tags.camera);
+                                } else {
+                                        QString tag = xml.name().toString();
+                                        QString text = xml.readElementText(QXmlStreamReader::IncludeChildElements);
+                                        if (!tags.values.contains(tag))
+                                                tags.values.insert(tag, text);
+                                }
+                        }
+
+                        auto lm = read_landmark(tags);
+                        if (lm)
+                                result->add(lm);
+                        else
+                                qWarning() << m_filename << ": Skipped empty landmark tag";
+                } else if (xml.name() == "name" && !has_name) {
+                        result->setName(xml.readElementText(QXmlStreamReader::IncludeChildElements));
+                        has_name = true;
+                } else {
+                        xml.skipCurrentElement();
+                }
+        }
+
+        if (!has_name && !xml.hasError())
+                qWarning() << m_filename << ":List has no name entry, assign '(unknown)'";
+        return result;
+}
+
+PLandmark LandmarkReader::read_landmark(const LandmarkTags& tags)
 {
+        auto& elm = tags.values;
         auto name = read_tag<QString>(elm, "name");
         if (!name.first)
                 return PLandmark();
@@ -281,7 +445,7 @@ PLandmark LandmarkReader::read_landmark(const QDomElement& elm)
 
         auto isovalue = read_tag<float>(elm, "isovalue");
         auto location = read_tag<QVector3D>(elm, "location");
-        auto camera = read_camera(elm);
+        auto camera = read_camera(tags);
         bool complete = isovalue.first && location.first && camera.first;
         if (complete) {
                 result->set(location.second, isovalue.second, camera.second);
@@ -298,25 +462,36 @@ PLandmark LandmarkReader::read_landmark(const QDomElement& elm)
 
 class LandmarkSaver {
 public:
+        virtual ~LandmarkSaver() = default;
         bool save(const QString& filename, const LandmarkList& list);
 
-public:
-        void save_landmark(QDomDocument& xml, QDomElement& parent, const Landmark& lm);
-        virtual void save_camera(QDomDocument& xml, QDomElement& parent, const Camera& c) = 0;
+private:
+        void save_landmark(QXmlStreamWriter& xml, const Landmark& lm);
+        virtual void save_version(QXmlStreamWriter& xml) = 0;
+        virtual void save_camera(QXmlStreamWriter& xml, const Camera& c) = 0;
 };
 
 class LandmarkSaverV1 : public LandmarkSaver {
-        void save_camera(QDomDocument& xml, QDomElement& parent, const Camera& c) override;
+        void save_version(QXmlStreamWriter& xml) override;
+        void save_camera(QXmlStreamWriter& xml, const Camera& c) override;
+};
+
+class LandmarkSaverV2 : public LandmarkSaver {
+        void save_version(QXmlStreamWriter& xml) override;
+        void save_camera(QXmlStreamWriter& xml, const Camera& c) override;
 };
 
 bool write_landmarklist(const QString& filename, const LandmarkList& list, int prefer_version)
 {
+        if (is_binary_landmarklist_filename(filename))
+                return write_landmarklist_binary(filename, list);
+
         std::unique_ptr<LandmarkSaver> saver_backend;
 
         if (prefer_version == 1) {
                 saver_backend.reset(new LandmarkSaverV1);
         }else{
-                assert(0 && "Only landmark saver V1 implmented");
+                saver_backend.reset(new LandmarkSaverV2);
         }
 
         return saver_backend->save(filename, list);
@@ -325,32 +500,41 @@ bool write_landmarklist(const QString& filename, const LandmarkList& list, int p
 
 bool LandmarkSaver::save(const QString& filename, const LandmarkList& list)
 {
-        QFile save_file(filename);
+        // the data is written to a temporary file that only replaces
+        // the original file when everything was written
+        QSaveFile save_file(filename);
         if (!save_file.open(QFile::WriteOnly| QFile::Text)) {
                 throw QRuntimeExeption(_("Unable to open '%1'' for writing.").arg(filename));
         }
 
-        QDomDocument xml;
-        xml.createProcessingInstruction( "xml", "version=\"1.0\"" );
-        auto root = xml.createElement("list");
-        xml.appendChild(root);
+        QXmlStreamWriter xml(&save_file);
+        xml.setAutoFormatting(true);
+        xml.setAutoFormattingIndent(1);
+        xml.writeStartDocument();
 
-        auto  name = xml.createElement("name");
-        root.appendChild(name);
-        auto name_text = xml.createTextNode(list.getName());
-        name.appendChild(name_text);
+        xml.writeStartElement("list");
+        save_version(xml);
+        xml.writeTextElement("name", list.getName());
 
         for (auto i: list) {
-                save_landmark(xml, root, *i);
+                save_landmark(xml, *i);
         }
 
-        QTextStream s(&save_file);
-        s << xml.toString();
-        save_file.close();
+        xml.writeEndElement();
+        xml.writeEndDocument();
 
-        return s.status() == QTextStream::Ok;
+        if (xml.hasError()) {
+                save_file.cancelWriting();
+                return false;
+        }
+        return save_file.commit();
 }
 
+/*
+  The values are formatted with the shortest representation that reads back
+  to the same float into a buffer on the stack, only the resulting QString
+  that the XML writer needs is allocated.
+*/
 template <typename T>
 struct to_string {
         static QString apply(T value) {
@@ -359,33 +543,34 @@ struct to_string {
         }
 };
 
+template <typename T>
+static QString format_tag_numbers(const T *values, int n)
+{
+        char buffer[number_buffer_size];
+        char *end = format_numbers(buffer, buffer + number_buffer_size, values, n);
+        assert(end);
+        return QString::fromLatin1(buffer, end - buffer);
+}
+
 template <>
 struct to_string<float> {
         static QString apply(float value) {
-                QString s;
-                QTextStream ts(&s);
-                ts << value;
-                return s;
+                return format_tag_numbers(&value, 1);
         }
 };
 
 template <>
 struct to_string<int> {
         static QString apply(int value) {
-                QString s;
-                QTextStream ts(&s);
-                ts << value;
-                return s;
+                return format_tag_numbers(&value, 1);
         }
 };
 
 template <>
 struct to_string<QVector3D> {
         static QString apply(const QVector3D& v) {
-                QString s;
-                QTextStream ts(&s);
-                ts << v.x() << " " << v.y() << " " << v.z();
-                return s;
+                float values[3] = {v.x(), v.y(), v.z()};
+                return format_tag_numbers(values, 3);
         }
 };
 
@@ -393,77 +578,64 @@ struct to_string<QVector3D> {
 template <>
 struct to_string<QQuaternion> {
         static QString apply(const QQuaternion& v) {
-                QString s;
-                QTextStream ts(&s);
-                ts << v.x() << " " << v.y() << " " << v.z() << " " << v.scalar();
-                return s;
+                float values[4] = {v.x(), v.y(), v.z(), v.scalar()};
+                return format_tag_numbers(values, 4);
         }
 };
 
 
-void LandmarkSaver::save_landmark(QDomDocument& xml, QDomElement& parent, const Landmark& lm)
+void LandmarkSaver::save_landmark(QXmlStreamWriter& xml, const Landmark& lm)
 {
-        auto xml_lm = xml.createElement("landmark");
-        if (lm.has(Landmark::lm_name)) {
-                auto tag = xml.createElement("name");
-                auto content = xml.createTextNode(lm.getName());
-                tag.appendChild(content);
-                xml_lm.appendChild(tag);
-        }
-        if (lm.has(Landmark::lm_location)) {
-                auto tag = xml.createElement("location");
-                auto loc_string = to_string<QVector3D>::apply(lm.getLocation());
-                auto content = xml.createTextNode(loc_string);
-                tag.appendChild(content);
-                xml_lm.appendChild(tag);
-        }
-        if (lm.has(Landmark::lm_picfile)) {
-                auto tag = xml.createElement("picfile");
-                auto content = xml.createTextNode(lm.getTemplateFilename());
-                tag.appendChild(content);
-                xml_lm.appendChild(tag);
-        }
-        if (lm.has(Landmark::lm_iso_value)) {
-                auto tag = xml.createElement("isovalue");
-                auto iso_string = to_string<float>::apply(lm.getIsoValue());
-                auto content = xml.createTextNode(iso_string);
-                tag.appendChild(content);
-                xml_lm.appendChild(tag);
-        }
-        if (lm.has(Landmark::lm_camera)) {
-                save_camera(xml, xml_lm, lm.getCamera());
-        }
-        parent.appendChild(xml_lm);
+        xml.writeStartElement("landmark");
+        if (lm.has(Landmark::lm_name))
+                xml.writeTextElement("name", lm.getName());
+
+        if (lm.has(Landmark::lm_location))
+                xml.writeTextElement("location", to_string<QVector3D>::apply(lm.getLocation()));
+
+        if (lm.has(Landmark::lm_picfile))
+                xml.writeTextElement("picfile", lm.getTemplateFilename());
+
+        if (lm.has(Landmark::lm_iso_value))
+                xml.writeTextElement("isovalue", to_string<float>::apply(lm.getIsoValue()));
+
+        if (lm.has(Landmark::lm_camera))
+                save_camera(xml, lm.getCamera());
+
+        xml.writeEndElement();
+}
+
+void LandmarkSaverV1::save_version(QXmlStreamWriter& xml)
+{
+        // version 1 files have no version attribute
+        Q_UNUSED(xml);
 }
 
-void LandmarkSaverV1::save_camera(QDomDocument& xml, QDomElement& parent, const Camera& c)
+void LandmarkSaverV1::save_camera(QXmlStreamWriter& xml, const Camera& c)
 {
-        auto xml_camera = xml.createElement("camera");
+        xml.writeStartElement("camera");
 
-        auto loc_tag = xml.createElement("location");
         QVector3D loc(c.get_position().x(), c.get_position().y(), 0);
-        auto loc_string = to_string<QVector3D>::apply(loc);
-        auto loc_content = xml.createTextNode(loc_string);
-        loc_tag.appendChild(loc_content);
-        xml_camera.appendChild(loc_tag);
-
-        auto rot_tag = xml.createElement("rotation");
-        auto rot_string = to_string<QQuaternion>::apply(c.get_rotation().inverted());
-        auto rot_content = xml.createTextNode(rot_string);
-        rot_tag.appendChild(rot_content);
-        xml_camera.appendChild(rot_tag);
-
-        auto zoom_tag = xml.createElement("zoom");
-        auto zoom_string = to_string<float>::apply(c.get_zoom());
-        auto zoom_content = xml.createTextNode(zoom_string);
-        zoom_tag.appendChild(zoom_content);
-        xml_camera.appendChild(zoom_tag);
-
-        auto dist_tag = xml.createElement("distance");
-        auto dist_string = to_string<float>::apply(-c.get_position().z());
-        auto dist_content = xml.createTextNode(dist_string);
-        dist_tag.appendChild(dist_content);
-        xml_camera.appendChild(dist_tag);
-
-        parent.appendChild(xml_camera);
+        xml.writeTextElement("location", to_string<QVector3D>::apply(loc));
+
+        // the old code uses the inverse rotation and the negated distance
+        xml.writeTextElement("rotation", to_string<QQuaternion>::apply(c.get_rotation().inverted()));
+        xml.writeTextElement("zoom", to_string<float>::apply(c.get_zoom()));
+        xml.writeTextElement("distance", to_string<float>::apply(-c.get_position().z()));
+
+        xml.writeEndElement();
+}
+
+void LandmarkSaverV2::save_version(QXmlStreamWriter& xml)
+{
+        xml.writeAttribute("version", "2");
+}
+
+void LandmarkSaverV2::save_camera(QXmlStreamWriter& xml, const Camera& c)
+{
+        xml.writeStartElement("camera");
+        xml.writeTextElement("location", to_string<QVector3D>::apply(c.get_position()));
+        xml.writeTextElement("rotation", to_string<QQuaternion>::apply(c.get_rotation()));
+        xml.writeTextElement("zoom", to_string<float>::apply(c.get_zoom()));
+        xml.writeEndElement();
 }
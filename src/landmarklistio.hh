@@ -26,8 +26,23 @@
 
 class LandmarkList;
 
-PLandmarkList read_landmarklist(const QString& filename);
+/// The XML parser used for reading landmark lists
+enum ELandmarkParser {
+        lp_stream, /**< create the landmarks while the file is parsed */
+        lp_dom     /**< parse the whole file into a DOM tree first */
+};
 
+/**
+   Read a landmark list, files with the suffix .lmb are read in the binary
+   format (see read_landmarklist_binary), all others as XML.
+*/
+PLandmarkList read_landmarklist(const QString& filename, ELandmarkParser parser = lp_stream);
+
+/**
+   Write the list in the given XML format version (1 or 2), or in the binary
+   format if the file name has the suffix .lmb. The file is first written
+   to a temporary file that replaces the original only if writing succeeded.
+*/
 bool write_landmarklist(const QString& filename, const LandmarkList& list, int prefer_version = 1);
 
 #endif // LANDMARKLISTIO_HH
@@ -22,12 +22,18 @@
 #include "landmarklistpainter.hh"
 #include "landmarklist.hh"
 #include "sphere.hh"
+#include "gpuprofiler.hh"
 #include <cassert>
 
+static const QVector4D active_color(1, 0, 0, 0.9);
+static const QVector4D normal_color(0, 0.5, 1, 0.8);
+
 struct LandmarkListPainterImpl {
 
         LandmarkListPainterImpl();
 
+        void update_instances();
+
         PLandmarkList m_the_list;
         int m_active_index;
 
@@ -37,6 +43,14 @@ struct LandmarkListPainterImpl {
         QVector3D m_viewspace_shift;
         bool m_viewspace_is_startup;
 
+        // with GLSL 3.30 all landmarks are drawn with one instanced call,
+        // the instances are only rebuilt when the list changes
+        SphereSet m_spheres;
+        bool m_use_instancing;
+        bool m_instances_valid;
+        unsigned m_list_revision;
+        int m_instanced_active;
+        std::vector<int> m_instance_index;
 };
 
 LandmarkListPainter::LandmarkListPainter()
@@ -56,12 +70,19 @@ void LandmarkListPainter::set_viewspace_correction(const QVector3D& scale, const
         impl->m_viewspace_scale = scale;
         impl->m_viewspace_shift = shift;
         impl->m_viewspace_is_startup = false;
+        impl->m_instances_valid = false;
+}
+
+void LandmarkListPainter::set_use_impostors(bool enable)
+{
+        impl->m_spheres.set_mode(enable ? SphereSet::sm_impostor : SphereSet::sm_mesh);
 }
 
 void LandmarkListPainter::set_landmark_list(PLandmarkList list)
 {
         impl->m_the_list = list;
         impl->m_active_index = -1;
+        impl->m_instances_valid = false;
 
         if (impl->m_viewspace_is_startup) {
                 // get landmarks cover area and adjust viewspace so that all fit in a [0,1]^3 cube
@@ -94,12 +115,20 @@ void LandmarkListPainter::do_detach_gl()
 {
         impl->m_active_sphere.detach_gl();
         impl->m_normal_sphere.detach_gl();
+        if (impl->m_use_instancing)
+                impl->m_spheres.detach_gl();
 }
 
 void LandmarkListPainter::do_attach_gl()
 {
         impl->m_active_sphere.attach_gl(get_context());
         impl->m_normal_sphere.attach_gl(get_context());
+
+        impl->m_use_instancing = get_shader_version() >= 330;
+        if (impl->m_use_instancing) {
+                impl->m_spheres.attach_gl(get_context());
+                impl->m_instances_valid = false;
+        }
 }
 
 void LandmarkListPainter::do_draw(const GlobalSceneState& state)
@@ -107,11 +136,19 @@ void LandmarkListPainter::do_draw(const GlobalSceneState& state)
         if (!impl->m_the_list)
                 return;
 
+        GpuProfiler::Scope timer(get_gpu_profiler(), GpuProfiler::gs_landmarks);
+        if (impl->m_use_instancing) {
+                impl->update_instances();
+                impl->m_spheres.draw(state);
+                return;
+        }
+
         GlobalSceneState local_state = state;
-        for (int i = 0; i < static_cast<int>(impl->m_the_list->size()); ++i) {
-                auto lm = (*impl->m_the_list)[i];
-                if (lm->has(Landmark::lm_location)) {
-                        auto offset = lm->getLocation() * impl->m_viewspace_scale - impl->m_viewspace_shift;
+        const LandmarkList& list = *impl->m_the_list;
+        int i = 0;
+        for (auto lm = list.begin(); lm != list.end(); ++lm, ++i) {
+                if ((*lm)->has(Landmark::lm_location)) {
+                        auto offset = (*lm)->getLocation() * impl->m_viewspace_scale - impl->m_viewspace_shift;
                         local_state.set_offset(offset);
                         if (i == impl->m_active_index) {
                                 impl->m_active_sphere.draw(local_state);
@@ -127,7 +164,8 @@ const QString LandmarkListPainter::get_active_landmark_name() const
         if (impl->m_active_index < 0 ||
             static_cast<size_t>(impl->m_active_index) >= impl->m_the_list->size())
                 return QString();
-        return (*impl->m_the_list)[impl->m_active_index]->getName();
+        const LandmarkList& list = *impl->m_the_list;
+        return list.at(impl->m_active_index).getName();
 }
 
 Landmark& LandmarkListPainter::get_active_landmark()
@@ -146,10 +184,54 @@ void LandmarkListPainter::set_active_landmark(int idx)
 LandmarkListPainterImpl::LandmarkListPainterImpl():
         m_the_list(new LandmarkList),
         m_active_index(-1),
-        m_active_sphere(QVector4D(1, 0, 0, 0.9)),
-        m_normal_sphere(QVector4D(0, 0.5, 1, 0.8)),
+        m_active_sphere(active_color),
+        m_normal_sphere(normal_color),
         m_viewspace_scale(1,1,1),
         m_viewspace_shift(0,0,0),
-        m_viewspace_is_startup(true)
+        m_viewspace_is_startup(true),
+        m_use_instancing(false),
+        m_instances_valid(false),
+        m_list_revision(0),
+        m_instanced_active(-1)
 {
 }
+
+void LandmarkListPainterImpl::update_instances()
+{
+        const LandmarkList& list = *m_the_list;
+
+        if (m_instances_valid && m_list_revision == list.revision()) {
+                // only the colors of the old and the new active landmark change
+                if (m_instanced_active != m_active_index) {
+                        auto set_color = [this](int lm_idx, const QVector4D& color) {
+                                if (lm_idx >= 0 && static_cast<size_t>(lm_idx) < m_instance_index.size() &&
+                                    m_instance_index[lm_idx] >= 0)
+                                        m_spheres.set_instance_color(m_instance_index[lm_idx], color);
+                        };
+                        set_color(m_instanced_active, normal_color);
+                        set_color(m_active_index, active_color);
+                        m_instanced_active = m_active_index;
+                }
+                return;
+        }
+
+        std::vector<SphereInstance> instances;
+        instances.reserve(list.size());
+        m_instance_index.assign(list.size(), -1);
+
+        int i = 0;
+        for (auto lm = list.begin(); lm != list.end(); ++lm, ++i) {
+                if ((*lm)->has(Landmark::lm_location)) {
+                        m_instance_index[i] = instances.size();
+                        SphereInstance instance;
+                        instance.offset = (*lm)->getLocation() * m_viewspace_scale - m_viewspace_shift;
+                        instance.color = i == m_active_index ? active_color : normal_color;
+                        instances.push_back(instance);
+                }
+        }
+        m_spheres.set_instances(instances);
+
+        m_list_revision = list.revision();
+        m_instanced_active = m_active_index;
+        m_instances_valid = true;
+}
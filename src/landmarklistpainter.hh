@@ -34,6 +34,12 @@ public:
         void set_landmark_list(PLandmarkList list);
         void set_viewspace_correction(const QVector3D& scale, const QVector3D& shift);
 
+        /**
+           Draw the landmarks as ray cast sphere impostors instead of triangle
+           meshes, only available with GLSL 3.30
+        */
+        void set_use_impostors(bool enable);
+
         Landmark& get_active_landmark();
         void set_active_landmark(int idx);
         const QString get_active_landmark_name() const;
@@ -65,11 +65,13 @@ QVariant LandmarkTableModel::data(const QModelIndex &index, int role) const
         if (!index.isValid() || !m_the_list)
                 return QVariant();
 
-        if (static_cast<size_t>(index.row()) >= m_the_list->size() || index.row() < 0)
+        // reading must not count as a change of the list
+        const LandmarkList& list = *m_the_list;
+        if (static_cast<size_t>(index.row()) >= list.size() || index.row() < 0)
                 return QVariant();
 
         if (role == Qt::DisplayRole) {
-                Landmark lm = m_the_list->at(index.row());
+                const Landmark& lm = list.at(index.row());
                 if (index.column() == 0)
                         return lm.getName();
                 else {
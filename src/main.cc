@@ -20,12 +20,43 @@
  */
 
 #include "mainwindow.hh"
+#include "batchrenderer.hh"
+#include "landmarklistio.hh"
+#include "qruntimeexeption.hh"
 #include <QApplication>
+#include <QDebug>
+#include <cstring>
 
-int main(int argc, char *argv[])
+static bool has_option(int argc, char *argv[], const char *option)
 {
-        QApplication a(argc, argv);
+        for (int i = 1; i < argc; ++i) {
+                if (!strcmp(argv[i], option))
+                        return true;
+        }
+        return false;
+}
+
+/* --convert <in> <out>: convert a landmark list between the XML and
+   the binary format, the format of each file is given by its suffix */
+static int convert_landmarklist(const QStringList& arguments)
+{
+        int idx = arguments.indexOf("--convert");
+        if (idx + 2 >= arguments.size()) {
+                qWarning() << "Usage: --convert <input list> <output list>";
+                return 1;
+        }
+        try {
+                auto list = read_landmarklist(arguments[idx + 1]);
+                return write_landmarklist(arguments[idx + 2], *list, 2) ? 0 : 1;
+        }
+        catch (QRuntimeExeption& x) {
+                qWarning() << x.qwhat();
+        }
+        return 1;
+}
 
+int main(int argc, char *argv[])
+{
         QSurfaceFormat format;
         format.setDepthBufferSize(32);
         format.setVersion(3, 3);
@@ -33,6 +64,18 @@ int main(int argc, char *argv[])
         format.setProfile(QSurfaceFormat::CoreProfile);
         QSurfaceFormat::setDefaultFormat(format);
 
+        if (has_option(argc, argv, "--convert")) {
+                QCoreApplication a(argc, argv);
+                return convert_landmarklist(a.arguments());
+        }
+
+        // the batch mode doesn't need widgets, so it also runs with the offscreen platforms
+        if (has_option(argc, argv, "--batch")) {
+                QGuiApplication a(argc, argv);
+                return batch_main(a.arguments());
+        }
+
+        QApplication a(argc, argv);
 
         MainWindow w;
         w.show();
@@ -34,6 +34,7 @@
 #include <QMatrix4x4>
 #include <QMenu>
 #include <QInputDialog>
+#include <QPainter>
 #include <cassert>
 #include <memory>
 #include <cmath>
@@ -42,7 +43,8 @@ using mia::C3DFVector;
 
 MainopenGLView::MainopenGLView(QWidget *parent):
         QOpenGLWidget(parent),
-        m_rendering(nullptr)
+        m_rendering(nullptr),
+        m_show_gpu_timings(false)
 {
         m_rendering = new RenderingThread(this);
         setMouseTracking( true );
@@ -57,9 +59,8 @@ MainopenGLView::MainopenGLView(QWidget *parent):
 
 void MainopenGLView::setVolume(VolumeData::Pointer volume)
 {
-        makeCurrent();
         m_rendering->set_volume(volume);
-        doneCurrent();
+        update();
 }
 
 void MainopenGLView::setLandmarkModel(LandmarkTableModel *model)
@@ -76,9 +77,8 @@ void MainopenGLView::selected_landmark_changed(int row)
 
 void MainopenGLView::setLandmarkList(PLandmarkList list)
 {
-        makeCurrent();
         m_rendering->set_landmark_list(list);
-        doneCurrent();
+        update();
 }
 
 void MainopenGLView::set_volume_isovalue(int value)
@@ -87,6 +87,48 @@ void MainopenGLView::set_volume_isovalue(int value)
         update();
 }
 
+void MainopenGLView::redraw()
+{
+        m_rendering->invalidate();
+        update();
+}
+
+void MainopenGLView::set_gpu_timings_overlay(bool enable)
+{
+        m_show_gpu_timings = enable;
+        update();
+}
+
+QString MainopenGLView::dump_gpu_timings() const
+{
+        return m_rendering->dump_gpu_statistics();
+}
+
+void MainopenGLView::draw_gpu_timings()
+{
+        QStringList lines;
+        for (auto& s: m_rendering->get_gpu_statistics()) {
+                lines << QString("%1: %2 ms (%3 - %4)").arg(s.stage, -10)
+                        .arg(s.mean_ms, 0, 'f', 2).arg(s.min_ms, 0, 'f', 2).arg(s.max_ms, 0, 'f', 2);
+        }
+        if (lines.isEmpty())
+                return;
+
+        QPainter painter(this);
+        painter.setFont(QFont("Monospace", 9));
+        QRect area = painter.boundingRect(rect().adjusted(8, 8, -8, -8), Qt::AlignLeft | Qt::AlignTop,
+                                          lines.join("\n"));
+        painter.fillRect(area.adjusted(-4, -4, 4, 4), QColor(0, 0, 0, 160));
+        painter.setPen(Qt::white);
+        painter.drawText(area, Qt::AlignLeft | Qt::AlignTop, lines.join("\n"));
+}
+
+void MainopenGLView::set_landmark_impostors(bool enable)
+{
+        m_rendering->set_landmark_impostors(enable);
+        update();
+}
+
 MainopenGLView::~MainopenGLView()
 {
         delete m_rendering;
@@ -109,8 +151,15 @@ void MainopenGLView::initializeGL()
 
 void MainopenGLView::paintGL()
 {
+        // the frame is rendered in the render thread, a new frame triggers an update
         m_rendering->paint();
 
+        if (m_show_gpu_timings)
+                draw_gpu_timings();
+
+        // keep painting until the snapshot read backs are handed to the encoders
+        if (m_rendering->has_pending_snapshots())
+                update();
 }
 
 void MainopenGLView::resizeGL(int w, int h)
@@ -133,6 +182,9 @@ void MainopenGLView::mouseReleaseEvent(QMouseEvent *ev)
         if (!m_rendering->mouse_release(ev)) {
                 // handle mouse here
 
+        }else{
+                // redraw in full resolution after the interaction
+                update();
         }
 }
 
@@ -157,6 +209,9 @@ void MainopenGLView::contextMenuEvent ( QContextMenuEvent * event)
 {
         QMenu context(tr("Landmarks"), this);
 
+        // start reading back the picked coordinate while the menu is shown
+        m_rendering->request_pick(event->pos());
+
         QString active_landmark = m_rendering->get_active_landmark_name();
         if (!active_landmark.isEmpty()) {
                 m_set_landmark_action->setText(tr("Set location of landmark '") + active_landmark + "'");
@@ -196,7 +251,8 @@ void MainopenGLView::on_add_landmark()
                         qDebug() << "Will add landmark ..." << name;
                         QVariant data = m_add_landmark_action->data();
                         qDebug() << "... from " << data.toPoint();
-                        if (m_rendering->add_landmark(name, data.toPoint())){
+                        bool added = m_rendering->add_landmark(name, data.toPoint());
+                        if (added) {
                                 emit availabledata_changed();
                                 update();
                                 break;
@@ -211,7 +267,9 @@ void MainopenGLView::on_add_landmark()
 
 void MainopenGLView::snapshot(const QString& filename)
 {
+        // only the read back is started here, the image is written in the background
+        makeCurrent();
+        m_rendering->snapshot(filename);
+        doneCurrent();
         update();
-        QImage img  = grabFramebuffer();
-        img.save(filename);
 }
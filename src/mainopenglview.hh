@@ -44,6 +44,9 @@ public:
         void selected_landmark_changed(int row);
 
         void snapshot(const QString& filename);
+
+        /// \returns the GPU time statistics of the rendering stages as CSV
+        QString dump_gpu_timings() const;
 signals:
         void isovalue_changed();
         void availabledata_changed();
@@ -52,6 +55,14 @@ public slots:
         void set_volume_isovalue(int value);
         void detachGL();
 
+        /// render the scene again, e.g. after the rendering options of the volume were changed
+        void redraw();
+
+        void set_landmark_impostors(bool enable);
+
+        /// show the GPU time of the rendering stages on top of the view
+        void set_gpu_timings_overlay(bool enable);
+
 private slots:
 
         void on_set_landmark();
@@ -67,9 +78,12 @@ private:
 	
         void contextMenuEvent ( QContextMenuEvent * event );
 
+        void draw_gpu_timings();
+
         RenderingThread *m_rendering;
         QAction *m_add_landmark_action;
         QAction *m_set_landmark_action;
+        bool m_show_gpu_timings;
 
 };
 
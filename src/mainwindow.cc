@@ -25,13 +25,21 @@
 #include "ui_mainwindow.h"
 #include "qruntimeexeption.hh"
 #include "aboutdialog.hh"
+#include "volumeloader.hh"
+#include "offscreenrenderer.hh"
 
 #include <QFileDialog>
+#include <QFile>
 #include <QMessageBox>
 #include <QInputDialog>
 #include <QCloseEvent>
 #include <QSortFilterProxyModel>
 #include <QScrollBar>
+#include <QProgressBar>
+#include <QProgressDialog>
+#include <QPushButton>
+#include <QStatusBar>
+#include <QApplication>
 
 #include <mia/3d/imageio.hh>
 #include <sstream>
@@ -92,6 +100,7 @@ MainWindow::MainWindow(QWidget *parent) :
         QMainWindow(parent),
         ui(new Ui::MainWindow),
         m_landmark_lm(new LandmarkTableModel(this)),
+        m_volume_loader(nullptr),
         m_volume_name(tr("(none)")),
         m_snapshot_serial_number(0)
 {
@@ -118,6 +127,16 @@ MainWindow::MainWindow(QWidget *parent) :
         m_landmark_tv->addAction(ui->action_Delete);
 
         m_glview->setLandmarkModel(m_landmark_lm);
+
+        // progress of loading a volume in the background
+        m_load_progress = new QProgressBar(this);
+        m_load_progress->setMaximumWidth(200);
+        m_load_cancel = new QPushButton(tr("Cancel"), this);
+        statusBar()->addPermanentWidget(m_load_progress);
+        statusBar()->addPermanentWidget(m_load_cancel);
+        m_load_progress->hide();
+        m_load_cancel->hide();
+
 #ifdef INITIAL_TESTING
         m_current_landmarklist = create_debug_list();
 
@@ -154,9 +173,10 @@ void MainWindow::landmarkSelectionChanged(const QModelIndex& idx, const QModelIn
         Q_UNUSED(other_idx);
         auto mapped_index = m_landmark_sort_proxy->mapToSource(idx);
         m_glview->selected_landmark_changed(mapped_index.row());
-        const Landmark& lm = m_current_landmarklist->at(mapped_index.row());
+        const LandmarkList& list = *m_current_landmarklist;
+        const Landmark& lm = list.at(mapped_index.row());
         if (lm.has(Landmark::lm_picfile)) {
-                QString imagefile = m_current_landmarklist->getBaseDir() + "/" + lm.getTemplateFilename();
+                QString imagefile = list.getBaseDir() + "/" + lm.getTemplateFilename();
                 auto i = m_image_cache.find(imagefile);
                 if (i == m_image_cache.end()) {
                         QPixmap image(imagefile);
@@ -196,6 +216,10 @@ void MainWindow::availableDataChanged()
 
 MainWindow::~MainWindow()
 {
+        if (m_volume_loader) {
+                m_volume_loader->cancel();
+                m_volume_loader->wait();
+        }
         delete ui;
 }
 
@@ -214,24 +238,146 @@ void MainWindow::on_actionOpen_Volume_triggered()
                 filetypes << "*." << i.c_str() << " ";
         filetypes << ")";
         QString filename = QFileDialog::getOpenFileName(this, "Open volume data set", ".", filetypes.str().c_str());
-        if (!filename.isEmpty()) {
-                try {
-                        auto volume = mia::load_image3d(filename.toStdString());
-                        m_current_volume = std::make_shared<VolumeData>(volume);
-                        auto intensity_range = m_current_volume->get_intensity_range();
-                        m_glview->setVolume(m_current_volume);
-                        m_iso_slider->setRange(intensity_range.first+1, intensity_range.second);
-                        m_iso_slider->setValue((intensity_range.second - intensity_range.first) / 2);
-                        QFileInfo fileInfo(filename);
-                        m_volume_name = fileInfo.fileName();
-                        availableDataChanged();
-                }
-                catch (std::exception& x) {
-                        QMessageBox box(QMessageBox::Information, "Error loading volume data", x.what(),
-                                        QMessageBox::Ok);
+        if (!filename.isEmpty() && !m_volume_loader) {
+                // read and prepare the volume in the background, the current
+                // volume and landmarks can still be worked on meanwhile
+                m_volume_loader = new VolumeLoader(filename, this);
+                connect(m_volume_loader, &VolumeLoader::finished, this, &MainWindow::volume_loading_finished);
+                m_volume_loader->set_create_gradients(ui->action_PrecomputedNormals->isChecked());
+
+                QFileInfo fileInfo(filename);
+                start_volume_loader(tr("Loading %1").arg(fileInfo.fileName()));
+        }
+}
+
+void MainWindow::start_volume_loader(const QString& message)
+{
+        connect(m_volume_loader, &VolumeLoader::progress, this, &MainWindow::volume_loading_progress);
+        connect(m_load_cancel, &QPushButton::clicked, m_volume_loader, &VolumeLoader::cancel);
+
+        // only one volume is prepared at a time
+        ui->actionOpen_Volume->setEnabled(false);
+        ui->action_PrecomputedNormals->setEnabled(false);
+        statusBar()->showMessage(message);
+        m_load_progress->show();
+        m_load_cancel->show();
+        m_volume_loader->start();
+}
+
+void MainWindow::finish_volume_loader()
+{
+        m_load_progress->hide();
+        m_load_cancel->hide();
+        statusBar()->clearMessage();
+        ui->actionOpen_Volume->setEnabled(true);
+        ui->action_PrecomputedNormals->setEnabled(true);
+}
+
+void MainWindow::volume_loading_progress(int percent)
+{
+        // busy indicator while the file is read
+        if (percent < 0) {
+                m_load_progress->setRange(0, 0);
+        } else {
+                m_load_progress->setRange(0, 100);
+                m_load_progress->setValue(percent);
+        }
+}
+
+void MainWindow::volume_loading_finished()
+{
+        assert(m_volume_loader);
+        finish_volume_loader();
+
+        auto volume = m_volume_loader->get_result();
+        if (volume) {
+                // only the texture upload is done here
+                m_current_volume = volume;
+                m_current_volume->set_use_gradient_volume(ui->action_PrecomputedNormals->isChecked());
+                auto intensity_range = m_current_volume->get_intensity_range();
+                m_glview->setVolume(m_current_volume);
+                m_iso_slider->setRange(intensity_range.first+1, intensity_range.second);
+                m_iso_slider->setValue((intensity_range.second - intensity_range.first) / 2);
+                QFileInfo fileInfo(m_volume_loader->get_filename());
+                m_volume_name = fileInfo.fileName();
+                availableDataChanged();
+        } else if (m_volume_loader->was_cancelled()) {
+                statusBar()->showMessage(tr("Loading volume data cancelled"), 5000);
+        } else {
+                QMessageBox box(QMessageBox::Information, "Error loading volume data",
+                                m_volume_loader->get_error(), QMessageBox::Ok);
+                box.exec();
+        }
+
+        m_volume_loader->deleteLater();
+        m_volume_loader = nullptr;
+}
+
+void MainWindow::on_action_PrecomputedNormals_toggled(bool checked)
+{
+        if (!m_current_volume)
+                return;
+
+        if (checked && !m_current_volume->has_gradient_volume()) {
+                // the normals are used when the evaluation in the background finished
+                m_volume_loader = new VolumeLoader(m_current_volume, this);
+                connect(m_volume_loader, &VolumeLoader::finished, this, &MainWindow::normals_evaluation_finished);
+                start_volume_loader(tr("Evaluating the normals"));
+                return;
+        }
+        m_current_volume->set_use_gradient_volume(checked);
+        m_glview->redraw();
+}
+
+void MainWindow::normals_evaluation_finished()
+{
+        assert(m_volume_loader);
+        finish_volume_loader();
+
+        if (m_volume_loader->get_result()) {
+                m_current_volume->set_use_gradient_volume(ui->action_PrecomputedNormals->isChecked());
+                m_glview->redraw();
+        } else {
+                // without the normals the option can't stay enabled
+                ui->action_PrecomputedNormals->setChecked(false);
+                if (m_volume_loader->was_cancelled()) {
+                        statusBar()->showMessage(tr("Evaluating the normals cancelled"), 5000);
+                } else {
+                        QMessageBox box(QMessageBox::Information, "Error evaluating the normals",
+                                        m_volume_loader->get_error(), QMessageBox::Ok);
                         box.exec();
                 }
         }
+
+        m_volume_loader->deleteLater();
+        m_volume_loader = nullptr;
+}
+
+void MainWindow::on_action_SphereImpostors_toggled(bool checked)
+{
+        m_glview->set_landmark_impostors(checked);
+}
+
+void MainWindow::on_action_GpuTimings_toggled(bool checked)
+{
+        m_glview->set_gpu_timings_overlay(checked);
+}
+
+void MainWindow::on_action_SaveGpuTimings_triggered()
+{
+        QString filename = QFileDialog::getSaveFileName(this, tr("Save GPU timings"), QString(),
+                                                        tr("CSV files (*.csv)"));
+        if (filename.isEmpty())
+                return;
+
+        QFile file(filename);
+        if (!file.open(QIODevice::WriteOnly | QIODevice::Text)) {
+                QMessageBox box(QMessageBox::Information, tr("Error saving GPU timings"),
+                                tr("Unable to open '%1' for writing.").arg(filename), QMessageBox::Ok);
+                box.exec();
+                return;
+        }
+        file.write(m_glview->dump_gpu_timings().toUtf8());
 }
 
 void MainWindow::on_action_Add_triggered()
@@ -264,7 +410,7 @@ void MainWindow::on_action_Add_triggered()
 void MainWindow::on_action_Open_landmarkset_triggered()
 {
         QString filename = QFileDialog::getOpenFileName(this, tr("Open landmark list"),
-                                                        ".", "(MIA landmark list *.lmx)");
+                                                        ".", tr("Landmark lists (*.lmx *.lmb)"));
 
         if (!filename.isEmpty()) {
                 try {
@@ -291,7 +437,8 @@ void MainWindow::isovalue_changed()
 
 void MainWindow::on_actionSave_landmark_set_As_triggered()
 {
-        auto fileName = QFileDialog::getSaveFileName(this, "Save landmark list as", ".", "(MIA landmark list *.lmx)");
+        auto fileName = QFileDialog::getSaveFileName(this, "Save landmark list as", ".",
+                                                     tr("MIA landmark list (*.lmx);;Binary landmark list (*.lmb)"));
 
         if (!fileName.isEmpty() ) {
                 try {
@@ -389,7 +536,8 @@ void MainWindow::on_action_Edit_triggered()
         if (active_index < 0)
                 return;
 
-        QString active_landmark = m_current_landmarklist->at(active_index).getName();
+        const LandmarkList& list = *m_current_landmarklist;
+        QString active_landmark = list.at(active_index).getName();
         bool ok = true;
         int idx = -1;
         while (ok && idx == -1) {
@@ -442,22 +590,24 @@ void MainWindow::on_action_CreateTemplate_triggered()
                 }
 
                 try {
-                        QString lm_picfile_name_template("/template_%1.png");
-                        for (unsigned i = 0; i < m_current_landmarklist->size(); ++i) {
-                                Landmark& lm = m_current_landmarklist->at(i);
-                                if (lm.has(Landmark::lm_camera) &&
-                                    lm.has(Landmark::lm_iso_value) &&
-                                    lm.has(Landmark::lm_location)) {
-                                        QString lm_picfile_name = lm_picfile_name_template.arg(lm.getName());
-                                        QString snapshot_name = out_dir + "/" + lm_picfile_name;
-                                        m_glview->set_volume_isovalue(lm.getIsoValue());
-                                        m_glview->selected_landmark_changed(i);
-                                        m_glview->snapshot(snapshot_name);
-                                        lm.setTemplateImageFile(lm_picfile_name);
-                                }else{
-                                        qDebug() << "No snapshot for" << lm.getName();
-                                }
+                        // render in an own context so that the view isn't touched
+                        OffscreenRenderer renderer(m_glview->size() * m_glview->devicePixelRatio());
+                        if (m_current_volume) {
+                                auto volume = make_shared<VolumeData>(m_current_volume->get_host_data());
+                                volume->set_use_gradient_volume(m_current_volume->get_use_gradient_volume());
+                                renderer.set_volume(volume);
                         }
+                        renderer.set_landmark_list(m_current_landmarklist);
+
+                        QProgressDialog progress(tr("Creating templates"), tr("Cancel"), 0,
+                                                 m_current_landmarklist->size(), this);
+                        progress.setWindowModality(Qt::WindowModal);
+                        renderer.create_templates(*m_current_landmarklist, out_dir,
+                                                  [&progress](int done, int total) {
+                                                          progress.setMaximum(total);
+                                                          progress.setValue(done);
+                                                          return !progress.wasCanceled();
+                                                  });
 
                         write_landmarklist(out_dir + "/template.lmx", *m_current_landmarklist);
                         break;
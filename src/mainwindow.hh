@@ -34,6 +34,9 @@
 
 
 class QLabel;
+class QProgressBar;
+class QPushButton;
+class VolumeLoader;
 
 namespace Ui {
 class MainWindow;
@@ -78,6 +81,17 @@ private slots:
 
         void on_action_Delete_triggered();
 
+        void volume_loading_progress(int percent);
+
+        void volume_loading_finished();
+
+        void normals_evaluation_finished();
+
+        void on_action_PrecomputedNormals_toggled(bool checked);
+        void on_action_SphereImpostors_toggled(bool checked);
+        void on_action_GpuTimings_toggled(bool checked);
+        void on_action_SaveGpuTimings_triggered();
+
 protected:
         void closeEvent(QCloseEvent *event) override;
 
@@ -85,6 +99,9 @@ protected:
 private:
         int  getSelectedLandmarkIndex(QModelIndex *idx) const;
 
+        void start_volume_loader(const QString& message);
+        void finish_volume_loader();
+
 
         Ui::MainWindow *ui;
         MainopenGLView *m_glview;
@@ -93,6 +110,9 @@ private:
         LandmarkTableModel *m_landmark_lm;
         QSortFilterProxyModel *m_landmark_sort_proxy;
         QLabel *m_template_view;
+        QProgressBar *m_load_progress;
+        QPushButton *m_load_cancel;
+        VolumeLoader *m_volume_loader;
 
         PVolumeData m_current_volume;
         PLandmarkList m_current_landmarklist;
@@ -0,0 +1,85 @@
+/* -*- mia-c++  -*-
+ *
+ * This file is part of qtlmpick- a tool for landmark picking and
+ * visualization in volume data
+ * Copyright (c) Genoa 2017,  Gert Wollny
+ *
+ * qtlmpick is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with MIA; if not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef NUMBERFORMAT_HH
+#define NUMBERFORMAT_HH
+
+#include <charconv>
+#include <system_error>
+
+/**
+  Write the shortest representation of the value that is parsed back to
+  exactly the same value, nothing is allocated.
+  \returns the end of the written characters, or nullptr if [first, last) is too small
+*/
+template <typename T>
+char *format_number(char *first, char *last, T value)
+{
+        auto result = std::to_chars(first, last, value);
+        return result.ec == std::errc() ? result.ptr : nullptr;
+}
+
+/**
+  Write the values separated by single spaces.
+  \returns the end of the written characters, or nullptr if [first, last) is too small
+*/
+template <typename T>
+char *format_numbers(char *first, char *last, const T *values, int n)
+{
+        for (int i = 0; i < n && first; ++i) {
+                if (i > 0) {
+                        if (first == last)
+                                return nullptr;
+                        *first++ = ' ';
+                }
+                first = format_number(first, last, values[i]);
+        }
+        return first;
+}
+
+/**
+  Parse up to max_values numbers separated by white space, nothing is allocated.
+  \returns the number of values read, or -1 if the text holds more values or
+  something that isn't a number
+*/
+template <typename T>
+int parse_numbers(const char *first, const char *last, T *values, int max_values)
+{
+        auto is_space = [](char c) {return c == ' ' || c == '\t' || c == '\n' || c == '\r';};
+
+        int n = 0;
+        while (true) {
+                while (first != last && is_space(*first))
+                        ++first;
+                if (first == last)
+                        return n;
+                if (n == max_values)
+                        return -1;
+
+                auto result = std::from_chars(first, last, values[n]);
+                if (result.ec != std::errc() || (result.ptr != last && !is_space(*result.ptr)))
+                        return -1;
+                first = result.ptr;
+                ++n;
+        }
+}
+
+#endif // NUMBERFORMAT_HH
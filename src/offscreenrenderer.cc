@@ -0,0 +1,229 @@
+/* -*- mia-c++  -*-
+ *
+ * This file is part of qtlmpick- a tool for landmark picking and
+ * visualization in volume data
+ * Copyright (c) Genoa 2017,  Gert Wollny
+ *
+ * qtlmpick is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with MIA; if not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include "offscreenrenderer.hh"
+#include "qruntimeexeption.hh"
+
+#include <QOpenGLContext>
+#include <QOpenGLFunctions>
+#include <QOffscreenSurface>
+#include <QOpenGLFramebufferObject>
+#include <QThread>
+#include <QDebug>
+
+// a paged volume may need several frames until all pages it needs are resident
+static const int max_paging_frames = 64;
+
+OffscreenRenderer::OffscreenRenderer(const QSize& size, const QSurfaceFormat& format):
+        m_context(new QOpenGLContext),
+        m_surface(new QOffscreenSurface),
+        m_size(size)
+{
+        m_surface->setFormat(format);
+        m_surface->create();
+
+        m_context->setFormat(format);
+        if (!m_context->create() || !m_context->makeCurrent(m_surface)) {
+                delete m_context;
+                delete m_surface;
+                throw QRuntimeExeption(QObject::tr("Unable to create an OpenGL context for offscreen rendering"));
+        }
+        qDebug() << "OpenGL offscreen: " << (char*)m_context->functions()->glGetString(GL_VERSION);
+
+        // the shader set must be known before drawables are attached in other threads
+        Drawable::select_shader_set(m_context);
+        done_current();
+}
+
+OffscreenRenderer::~OffscreenRenderer()
+{
+        if (m_lmp && make_current()) {
+                detach();
+                done_current();
+        }
+        delete m_context;
+        delete m_surface;
+}
+
+void OffscreenRenderer::move_to_thread(QThread *thread)
+{
+        m_context->moveToThread(thread);
+}
+
+void OffscreenRenderer::release(QThread *context_thread)
+{
+        if (m_lmp && make_current()) {
+                detach();
+                done_current();
+        }
+        m_context->moveToThread(context_thread);
+}
+
+void OffscreenRenderer::detach()
+{
+        if (m_volume)
+                m_volume->detach_gl();
+        m_volume.reset();
+
+        m_lmp->detach_gl();
+        m_lmp.reset();
+        m_target.reset();
+}
+
+bool OffscreenRenderer::make_current()
+{
+        if (!m_context->makeCurrent(m_surface))
+                return false;
+
+        // the painter is created by the thread that renders
+        if (!m_lmp) {
+                m_lmp.reset(new LandmarkListPainter);
+                m_lmp->attach_gl(m_context);
+                if (m_landmarks)
+                        m_lmp->set_landmark_list(m_landmarks);
+        }
+        return true;
+}
+
+void OffscreenRenderer::done_current()
+{
+        m_context->doneCurrent();
+}
+
+void OffscreenRenderer::set_size(const QSize& size)
+{
+        m_size = size;
+}
+
+const QSize& OffscreenRenderer::get_size() const
+{
+        return m_size;
+}
+
+void OffscreenRenderer::set_volume(PVolumeData volume)
+{
+        if (!make_current()) {
+                qWarning() << "OffscreenRenderer: unable to make the OpenGL context current";
+                return;
+        }
+
+        if (m_volume)
+                m_volume->detach_gl();
+
+        m_volume = volume;
+        if (m_volume) {
+                m_volume->attach_gl(m_context);
+
+                // render with the quality of the converged on-screen image
+                m_volume->set_sampling(0.5f, 4);
+                m_lmp->set_viewspace_correction(m_volume->get_viewspace_scale(),
+                                                m_volume->get_viewspace_shift());
+        }
+        done_current();
+}
+
+void OffscreenRenderer::set_landmark_list(PLandmarkList list)
+{
+        m_landmarks = list;
+        if (m_lmp)
+                m_lmp->set_landmark_list(list);
+}
+
+QImage OffscreenRenderer::render(const Camera& camera, float iso_value, int active_landmark)
+{
+        if (m_size.isEmpty() || !make_current()) {
+                qWarning() << "OffscreenRenderer: unable to render a view of size" << m_size;
+                return QImage();
+        }
+        auto gl = m_context->functions();
+
+        if (!m_target || m_target->size() != m_size) {
+                m_target.reset(new QOpenGLFramebufferObject(m_size, QOpenGLFramebufferObject::CombinedDepthStencil));
+                if (m_volume)
+                        m_volume->resize_viewport(m_size);
+        }
+
+        GlobalSceneState state;
+        state.camera = camera;
+        state.viewport = m_size;
+        state.update_projection();
+
+        m_target->bind();
+        int frames = 0;
+        do {
+                gl->glViewport(0, 0, m_size.width(), m_size.height());
+                gl->glClearColor(0.1,0.1,0.1,1);
+                gl->glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+
+                gl->glEnable(GL_DEPTH_TEST);
+                gl->glDepthFunc(GL_LESS);
+                gl->glDepthMask(GL_TRUE);
+
+                if (m_volume) {
+                        m_volume->set_iso_value(iso_value);
+                        m_volume->draw(state);
+                }
+
+                m_lmp->set_active_landmark(active_landmark);
+                m_lmp->draw(state);
+        } while (m_volume && !m_volume->is_complete() && ++frames < max_paging_frames);
+
+        if (frames == max_paging_frames)
+                qWarning() << "OffscreenRenderer: the volume pages needed for the view didn't all become resident";
+
+        // the alpha channel holds the depth of the volume surface
+        QImage result = m_target->toImage().convertToFormat(QImage::Format_RGB32);
+        m_target->release();
+        done_current();
+        return result;
+}
+
+int OffscreenRenderer::create_templates(LandmarkList& list, const QString& out_dir, ProgressCallback progress)
+{
+        QString lm_picfile_name_template("/template_%1.png");
+        const LandmarkList& clist = list;
+        int written = 0;
+
+        for (unsigned i = 0; i < clist.size(); ++i) {
+                if (progress && !progress(i, clist.size()))
+                        throw QRuntimeExeption(QObject::tr("Creating the templates was cancelled"));
+
+                const Landmark& lm = clist.at(i);
+                if (!lm.has(Landmark::lm_camera) ||
+                    !lm.has(Landmark::lm_iso_value) ||
+                    !lm.has(Landmark::lm_location)) {
+                        qDebug() << "No snapshot for" << lm.getName();
+                        continue;
+                }
+
+                QString lm_picfile_name = lm_picfile_name_template.arg(lm.getName());
+                QString snapshot_name = out_dir + "/" + lm_picfile_name;
+                QImage image = render(lm.getCamera(), lm.getIsoValue(), i);
+                if (image.isNull() || !image.save(snapshot_name))
+                        throw QRuntimeExeption(QObject::tr("Unable to write template image '%1'").arg(snapshot_name));
+
+                list.at(i).setTemplateImageFile(lm_picfile_name);
+                ++written;
+        }
+        if (progress)
+                progress(clist.size(), clist.size());
+        return written;
+}
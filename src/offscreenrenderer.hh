@@ -0,0 +1,130 @@
+/* -*- mia-c++  -*-
+ *
+ * This file is part of qtlmpick- a tool for landmark picking and
+ * visualization in volume data
+ * Copyright (c) Genoa 2017,  Gert Wollny
+ *
+ * qtlmpick is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with MIA; if not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef OFFSCREENRENDERER_HH
+#define OFFSCREENRENDERER_HH
+
+#include "volumedata.hh"
+#include "landmarklistpainter.hh"
+#include "camera.hh"
+
+#include <QImage>
+#include <QSize>
+#include <QSurfaceFormat>
+#include <functional>
+#include <memory>
+
+class QOpenGLContext;
+class QOffscreenSurface;
+class QOpenGLFramebufferObject;
+class QThread;
+
+/**
+  \brief Renders landmark views without a window
+
+  The renderer uses its own OpenGL context with an offscreen surface
+  and draws into a frame buffer object, so it neither needs a visible
+  widget nor a display (e.g. Mesa llvmpipe on a render node).
+  It must be created and destroyed in the GUI thread. To render from
+  another thread move it there with move_to_thread() and hand it back
+  with release() when done, the OpenGL objects are created by the
+  thread that renders first.
+*/
+class OffscreenRenderer {
+public:
+        /**
+           Callback to report the progress of rendering the templates by the
+           number of landmarks processed and the total number, if it returns
+           false rendering is cancelled.
+        */
+        typedef std::function<bool(int, int)> ProgressCallback;
+
+        /**
+           Create the OpenGL context.
+           \throws QRuntimeExeption if no context can be created for the offscreen surface
+        */
+        OffscreenRenderer(const QSize& size, const QSurfaceFormat& format = QSurfaceFormat::defaultFormat());
+        ~OffscreenRenderer();
+
+        /**
+           Move the context to the thread that will render, must be called
+           from the thread the renderer currently belongs to.
+        */
+        void move_to_thread(QThread *thread);
+
+        /**
+           Free the OpenGL objects and move the context to the given thread,
+           must be called from the thread that rendered.
+        */
+        void release(QThread *context_thread);
+
+        /// Set the size of the rendered images
+        void set_size(const QSize& size);
+
+        const QSize& get_size() const;
+
+        /**
+           Set the volume to be rendered, it is attached to the context of
+           this renderer and must not be used by another context. To render a
+           volume that is shown on screen create a new one from its host data.
+        */
+        void set_volume(PVolumeData volume);
+
+        /// Set the landmarks drawn on top of the volume
+        void set_landmark_list(PLandmarkList list);
+
+        /**
+           Render the volume and the landmarks as seen with the given camera
+           \param camera the view
+           \param iso_value the iso value of the volume surface
+           \param active_landmark the index of the landmark to highlight, or -1
+           \returns the image
+        */
+        QImage render(const Camera& camera, float iso_value, int active_landmark = -1);
+
+        /**
+           Render the view of each landmark that has a location, a camera,
+           and an iso value, save it to the output directory and set it
+           as template image of the landmark.
+           \param list the landmarks, must be the list set by set_landmark_list
+           \param out_dir the output directory
+           \param progress optional progress report
+           \returns the number of template images written
+           \throws QRuntimeExeption if an image could not be saved or rendering was cancelled
+        */
+        int create_templates(LandmarkList& list, const QString& out_dir,
+                             ProgressCallback progress = ProgressCallback());
+
+private:
+        bool make_current();
+        void done_current();
+        void detach();
+
+        QOpenGLContext *m_context;
+        QOffscreenSurface *m_surface;
+        std::unique_ptr<QOpenGLFramebufferObject> m_target;
+        std::unique_ptr<LandmarkListPainter> m_lmp;
+        PLandmarkList m_landmarks;
+        PVolumeData m_volume;
+        QSize m_size;
+};
+
+#endif // OFFSCREENRENDERER_HH
@@ -0,0 +1,77 @@
+/* -*- mia-c++  -*-
+ *
+ * This file is part of qtlmpick- a tool for landmark picking and
+ * visualization in volume data
+ * Copyright (c) Genoa 2017,  Gert Wollny
+ *
+ * qtlmpick is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with MIA; if not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef PARALLEL_HH
+#define PARALLEL_HH
+
+#include <algorithm>
+#include <atomic>
+#include <thread>
+#include <vector>
+
+/**
+  Process the blocks [0, n_blocks) by calling body(block) using all available
+  hardware threads. The calling thread takes part in the work and calls
+  progress(fraction_done) after each block it finished, hence progress is
+  always called from the calling thread. If progress throws, the remaining
+  blocks are skipped, the worker threads are joined, and the exception is
+  passed on. body must not throw.
+*/
+template <typename Body, typename Progress>
+void parallel_blocks(unsigned n_blocks, Body body, Progress progress)
+{
+        std::atomic<unsigned> next_block(0);
+        std::atomic<unsigned> blocks_done(0);
+        std::atomic<bool> abort(false);
+
+        auto worker = [&]() {
+                unsigned block;
+                while (!abort && (block = next_block++) < n_blocks) {
+                        body(block);
+                        ++blocks_done;
+                }
+        };
+
+        unsigned n_threads = std::min(std::max(std::thread::hardware_concurrency(), 1u), n_blocks);
+        std::vector<std::thread> threads;
+        for (unsigned i = 1; i < n_threads; ++i)
+                threads.emplace_back(worker);
+
+        try {
+                unsigned block;
+                while ((block = next_block++) < n_blocks) {
+                        body(block);
+                        ++blocks_done;
+                        progress(float(blocks_done) / n_blocks);
+                }
+        }
+        catch (...) {
+                abort = true;
+                for (auto& t: threads)
+                        t.join();
+                throw;
+        }
+
+        for (auto& t: threads)
+                t.join();
+}
+
+#endif // PARALLEL_HH
@@ -22,6 +22,9 @@
 #include "renderingthread.hh"
 
 #include <QMouseEvent>
+#include <QOpenGLContext>
+#include <QOffscreenSurface>
+#include <QCoreApplication>
 
 using std::make_shared;
 RenderingThread::RenderingThread(QWidget *parent):
@@ -30,13 +33,28 @@ RenderingThread::RenderingThread(QWidget *parent):
         m_context(nullptr),
         m_mouse_lb_is_down(false),
         m_mouse_mb_is_down(false),
-        m_landmark_tm(nullptr)
+        m_worker(nullptr),
+        m_worker_context(nullptr),
+        m_worker_surface(nullptr),
+        m_present_fbo(0),
+        m_scene_changed(true),
+        m_landmarks_sent(false),
+        m_landmark_revision(0),
+        m_frame_budget(40.0f),
+        m_landmark_tm(nullptr),
+        m_active_landmark(-1),
+        m_landmark_impostors(false)
 {
 
 }
 
 RenderingThread::~RenderingThread()
 {
+        if (m_thread.isRunning()) {
+                m_thread.quit();
+                m_thread.wait();
+        }
+        delete m_worker;
 }
 
 void RenderingThread::attach_gl()
@@ -47,34 +65,66 @@ void RenderingThread::attach_gl()
 
         qDebug() << "OpenGL: " << (char*)glGetString(GL_VERSION);
 
-        if (m_volume)
-                m_volume->attach_gl(m_context);
+        glGenFramebuffers(1, &m_present_fbo);
+        m_snapshots.attach_gl();
+
+        // the surface must be created in the GUI thread, the context is
+        // handed over to the render thread
+        m_worker_surface = new QOffscreenSurface();
+        m_worker_surface->setFormat(m_context->format());
+        m_worker_surface->create();
+
+        m_worker_context = new QOpenGLContext();
+        m_worker_context->setFormat(m_context->format());
+        m_worker_context->setShareContext(m_context);
+        if (!m_worker_context->create())
+                qWarning() << "RenderingThread: unable to create the OpenGL context of the render thread";
+        m_worker_context->moveToThread(&m_thread);
+
+        m_worker = new RenderWorker(m_worker_context, m_worker_surface, &m_frames);
+        m_worker->moveToThread(&m_thread);
+        connect(m_worker, &RenderWorker::frame_ready, m_parent, [this]() {m_parent->update();});
+
+        m_thread.start();
 
-        m_lmp.attach_gl(m_context);
+        auto worker = m_worker;
+        QMetaObject::invokeMethod(worker, [worker]() {worker->initialize();}, Qt::QueuedConnection);
 
+        if (m_landmark_impostors)
+                set_landmark_impostors(true);
+
+        if (m_volume) {
+                m_volume->move_to_thread(&m_thread);
+                auto volume = m_volume;
+                QMetaObject::invokeMethod(worker, [worker, volume]() {worker->set_volume(volume);},
+                                          Qt::QueuedConnection);
+        }
+        m_landmarks_sent = false;
+        m_scene_changed = true;
 }
 
 void RenderingThread::set_volume(VolumeData::Pointer volume)
 {
-        std::swap(m_volume, volume);
-        if (m_is_gl_attached) {
-                if (volume)
-                        volume->detach_gl();
-
-                if (m_volume) {
-                        m_volume->attach_gl(m_context);
-                }
-        }
-        if (m_volume) {
-                m_lmp.set_viewspace_correction(m_volume->get_viewspace_scale(),
-                                               m_volume->get_viewspace_shift());
+        m_volume = volume;
+        m_scene_changed = true;
+
+        if (m_worker) {
+                // the OpenGL objects of the volume are used in the render thread only
+                if (m_volume)
+                        m_volume->move_to_thread(&m_thread);
+                auto worker = m_worker;
+                QMetaObject::invokeMethod(worker, [worker, volume]() {worker->set_volume(volume);},
+                                          Qt::QueuedConnection);
         }
 }
 
 void RenderingThread::set_selected_landmark(int idx)
 {
-        m_lmp.set_active_landmark(idx);
-        auto& lm = m_lmp.get_active_landmark();
+        m_active_landmark = idx;
+        m_scene_changed = true;
+
+        const LandmarkList& list = *m_current_landmarks;
+        auto& lm = list.at(idx);
 
         if (lm.has(Landmark::lm_camera)) {
                 m_state.camera = lm.getCamera();
@@ -93,16 +143,51 @@ void RenderingThread::set_landmark_model(LandmarkTableModel *ltm)
 void RenderingThread::set_landmark_list(PLandmarkList list)
 {
         assert(m_landmark_tm);
-        m_lmp.set_landmark_list(list);
         m_current_landmarks = list;
+        m_active_landmark = -1;
+        m_landmarks_sent = false;
         m_landmark_tm->setLandmarkList(list);
 }
 
+void RenderingThread::set_landmark_impostors(bool enable)
+{
+        m_landmark_impostors = enable;
+        if (m_worker) {
+                auto worker = m_worker;
+                QMetaObject::invokeMethod(worker, [worker, enable]() {worker->set_landmark_impostors(enable);},
+                                          Qt::QueuedConnection);
+        }
+}
+
+void RenderingThread::request_pick(const QPoint& loc)
+{
+        if (m_volume && m_worker) {
+                auto worker = m_worker;
+                QMetaObject::invokeMethod(worker, [worker, loc]() {worker->request_pick(loc);},
+                                          Qt::QueuedConnection);
+        }
+}
+
+std::pair<bool, QVector3D> RenderingThread::get_surface_coordinate(const QPoint& loc)
+{
+        std::pair<bool, QVector3D> result(false, QVector3D(-1, -1, -1));
+        if (!m_volume || !m_worker)
+                return result;
+
+        // the read back was started by request_pick, so this normally doesn't
+        // wait longer than the frame that is currently rendered
+        auto worker = m_worker;
+        QMetaObject::invokeMethod(worker, [worker, loc, &result]() {
+                        result = worker->get_surface_coordinate(loc);
+                }, Qt::BlockingQueuedConnection);
+        return result;
+}
+
 void RenderingThread::set_active_landmark_details(const QPoint& loc)
 {
-        auto& lm = m_lmp.get_active_landmark();
+        auto& lm = m_current_landmarks->at(m_active_landmark);
 
-        auto location = m_volume->get_surface_coordinate(loc);
+        auto location = get_surface_coordinate(loc);
         if (location.first) {
                 float iso = m_volume->get_iso_value();
                 Camera c = m_state.camera;
@@ -116,23 +201,140 @@ void RenderingThread::set_active_landmark_details(const QPoint& loc)
 
 void RenderingThread::set_volume_iso_value(int value)
 {
-        if (m_volume)
+        if (m_volume) {
                 m_volume->set_iso_value(value);
+                m_scene_changed = true;
+        }
 }
 
 void RenderingThread::paint()
 {
-        glClearColor(0.1,0.1,0.1,1);
-        glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+        post_request();
+        present();
+        m_snapshots.poll();
+}
+
+void RenderingThread::finish_frame()
+{
+        post_request();
+        if (m_worker) {
+                auto worker = m_worker;
+                QMetaObject::invokeMethod(worker, [worker]() {worker->render_converged();},
+                                          Qt::BlockingQueuedConnection);
+        }
+}
 
-        glEnable(GL_DEPTH_TEST);
-        glDepthFunc(GL_LESS);
-        glDepthMask(GL_TRUE);
+void RenderingThread::invalidate()
+{
+        m_scene_changed = true;
+}
 
-        if (m_volume)
-                m_volume->draw(m_state);
+void RenderingThread::post_request()
+{
+        if (!m_worker)
+                return;
+
+        // the render thread gets its own copy of the landmarks whenever they were changed
+        if (m_current_landmarks &&
+            (!m_landmarks_sent || m_current_landmarks->revision() != m_landmark_revision)) {
+                m_landmark_revision = m_current_landmarks->revision();
+                m_landmarks_sent = true;
+                m_scene_changed = true;
+
+                auto worker = m_worker;
+                auto snapshot = m_current_landmarks->snapshot();
+                QMetaObject::invokeMethod(worker, [worker, snapshot]() {worker->set_landmark_list(snapshot);},
+                                          Qt::QueuedConnection);
+        }
 
-        m_lmp.draw(m_state);
+        if (!m_scene_changed)
+                return;
+        m_scene_changed = false;
+
+        RenderWorker::Request request;
+        request.state = m_state;
+        request.iso_value = m_volume ? m_volume->get_iso_value() : 0.0f;
+        request.active_landmark = m_active_landmark;
+        request.interacting = m_mouse_lb_is_down || m_mouse_mb_is_down;
+        request.frame_budget = m_frame_budget;
+        m_worker->post(request);
+}
+
+bool RenderingThread::bind_frame(FrameQueue::Frame& frame)
+{
+        if (!m_frames.acquire(frame))
+                return false;
+
+        // only the GPU waits for the render thread to finish the frame
+        if (frame.fence) {
+                glWaitSync(frame.fence, 0, GL_TIMEOUT_IGNORED);
+                glDeleteSync(frame.fence);
+        }
+
+        glBindFramebuffer(GL_READ_FRAMEBUFFER, m_present_fbo);
+        glFramebufferTexture2D(GL_READ_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, frame.texture, 0);
+        return true;
+}
+
+void RenderingThread::release_frame()
+{
+        // the render thread must not draw to the frame before the GPU read it
+        GLsync read_fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+        glFlush();
+        GLsync stale = m_frames.release(read_fence);
+        if (stale)
+                glDeleteSync(stale);
+}
+
+void RenderingThread::present()
+{
+        GLint target_fbo = 0;
+        glGetIntegerv(GL_DRAW_FRAMEBUFFER_BINDING, &target_fbo);
+
+        FrameQueue::Frame frame;
+        if (!bind_frame(frame)) {
+                glClearColor(0.1,0.1,0.1,1);
+                glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+                return;
+        }
+
+        // while the view is resized the last frame is stretched to the new size
+        glBlitFramebuffer(0, 0, frame.size.width(), frame.size.height(),
+                          0, 0, m_state.viewport.width(), m_state.viewport.height(),
+                          GL_COLOR_BUFFER_BIT, GL_LINEAR);
+        release_frame();
+
+        glFramebufferTexture2D(GL_READ_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, 0, 0);
+        glBindFramebuffer(GL_READ_FRAMEBUFFER, target_fbo);
+}
+
+void RenderingThread::snapshot(const QString& filename)
+{
+        finish_frame();
+
+        GLint read_fbo = 0;
+        glGetIntegerv(GL_READ_FRAMEBUFFER_BINDING, &read_fbo);
+
+        FrameQueue::Frame frame;
+        if (!bind_frame(frame)) {
+                qWarning() << "RenderingThread: no frame available for the snapshot" << filename;
+                return;
+        }
+        m_snapshots.read(frame.size, filename);
+        release_frame();
+
+        glFramebufferTexture2D(GL_READ_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, 0, 0);
+        glBindFramebuffer(GL_READ_FRAMEBUFFER, read_fbo);
+}
+
+bool RenderingThread::has_pending_snapshots() const
+{
+        return m_snapshots.has_pending();
+}
+
+void RenderingThread::set_frame_budget(float ms)
+{
+        m_frame_budget = ms;
 }
 
 QVector3D RenderingThread::get_mapped_point(const QPointF& localPos) const
@@ -173,12 +375,17 @@ bool RenderingThread::mouse_release(QMouseEvent *ev)
                 if (!m_mouse_lb_is_down)
                         return false;
                 m_mouse_lb_is_down = false;
+                m_scene_changed = true;
                 update_rotation(ev);
                 m_mouse_old_position = ev->localPos();
                 break;
         }
         case Qt::MiddleButton: {
+                if (!m_mouse_mb_is_down)
+                        return false;
                 m_mouse_mb_is_down = false;
+                m_scene_changed = true;
+                break;
         }
         default:
                 return false;
@@ -191,11 +398,13 @@ bool RenderingThread::mouse_press(QMouseEvent *ev)
         switch (ev->button()) {
         case Qt::LeftButton:{
                 m_mouse_lb_is_down = true;
+                m_scene_changed = true;
                 m_mouse_old_position = ev->localPos();
                 break;
         }
         case Qt::MiddleButton: {
                 m_mouse_mb_is_down = true;
+                m_scene_changed = true;
                 m_mouse_old_position = ev->localPos();
                 break;
         }
@@ -217,6 +426,7 @@ bool RenderingThread::mouse_tracking(QMouseEvent *ev)
                 update_shift(ev);
         }
         m_mouse_old_position = ev->localPos();
+        m_scene_changed = true;
         return true;
 
 }
@@ -235,6 +445,7 @@ bool RenderingThread::mouse_wheel(QWheelEvent *ev)
                 return false;
 
         update_projection();
+        m_scene_changed = true;
         return true;
 }
 
@@ -242,37 +453,63 @@ void RenderingThread::resize(int w, int h)
 {
         glViewport(0,0,w,h);
         m_viewport = QVector2D(w, h);
-        update_projection();
         m_state.viewport = QSize(w,h);
+        update_projection();
+        m_scene_changed = true;
 }
 
 void RenderingThread::update_projection()
 {
-        m_state.projection.setToIdentity();
-        float zw, zh;
-        if (m_viewport.x() > m_viewport.y()) {
-                zw = m_state.camera.get_zoom() * m_viewport.x() / m_viewport.y();
-                zh = m_state.camera.get_zoom();
-        }else{
-                zh = m_state.camera.get_zoom()* m_viewport.y() / m_viewport.x();
-                zw = m_state.camera.get_zoom();
-        }
-        m_state.projection.frustum(-zw, zw, -zh, zh, 248, 252);
+        m_state.update_projection();
+}
+
+std::vector<GpuProfiler::Statistics> RenderingThread::get_gpu_statistics() const
+{
+        if (!m_worker)
+                return std::vector<GpuProfiler::Statistics>();
+        return m_worker->get_gpu_statistics();
+}
+
+QString RenderingThread::dump_gpu_statistics() const
+{
+        if (!m_worker)
+                return QString();
+        return m_worker->dump_gpu_statistics();
 }
 
 void RenderingThread::detach_gl()
 {
         m_is_gl_attached = false;
         qDebug() << "Detach";
-        if (m_volume)
-                m_volume->detach_gl();
-
-        m_lmp.detach_gl();
+        if (m_worker) {
+                auto worker = m_worker;
+                auto gui_thread = QThread::currentThread();
+                QMetaObject::invokeMethod(worker, [worker, gui_thread]() {worker->shutdown(gui_thread);},
+                                          Qt::BlockingQueuedConnection);
+                m_thread.quit();
+                m_thread.wait();
+
+                delete m_worker;
+                m_worker = nullptr;
+                delete m_worker_context;
+                m_worker_context = nullptr;
+                delete m_worker_surface;
+                m_worker_surface = nullptr;
+        }
+        m_snapshots.detach_gl();
+        if (m_present_fbo) {
+                glDeleteFramebuffers(1, &m_present_fbo);
+                m_present_fbo = 0;
+        }
 }
 
 const QString RenderingThread::get_active_landmark_name() const
 {
-        return m_lmp.get_active_landmark_name();
+        if (!m_current_landmarks || m_active_landmark < 0 ||
+            static_cast<size_t>(m_active_landmark) >= m_current_landmarks->size())
+                return QString();
+        const LandmarkList& list = *m_current_landmarks;
+        return list.at(m_active_landmark).getName();
 }
 
 bool RenderingThread::add_landmark(const QString& name, const QPoint& mouse_loc)
@@ -283,7 +520,7 @@ bool RenderingThread::add_landmark(const QString& name, const QPoint& mouse_loc)
         if (lml->has(name))
                 return false;
 
-        auto location = m_volume->get_surface_coordinate(mouse_loc);
+        auto location = get_surface_coordinate(mouse_loc);
         if (location.first) {
                 float iso = m_volume->get_iso_value();
                 Camera c = m_state.camera;
@@ -23,20 +23,32 @@
 #define RENDERINGTHREAD_HH
 
 #include "volumedata.hh"
-#include "landmarklistpainter.hh"
+#include "renderworker.hh"
+#include "snapshotwriter.hh"
 #include "landmarktablemodel.hh"
 
 #include "octaeder.hh"
 
 #include <QImage>
 #include <QObject>
-#include <QOpenGLFunctions>
+#include <QThread>
+#include <QOpenGLExtraFunctions>
 
 
 class QMouseEvent;
 class QWheelEvent;
-
-class RenderingThread : public QObject, private QOpenGLFunctions {
+class QOffscreenSurface;
+
+/**
+  \brief Keeps the scene state of the view and runs the rendering in a separate thread
+
+  The camera, the iso value, and the landmarks are maintained in the GUI
+  thread. The frames are rendered by a RenderWorker in its own thread with
+  an OpenGL context that shares its objects with the context of the widget,
+  and the widget only shows the newest finished frame. This way the GUI stays
+  responsive even if rendering a frame takes longer than a screen refresh.
+*/
+class RenderingThread : public QObject, private QOpenGLExtraFunctions {
 public:
         RenderingThread(QWidget *widget);
 
@@ -48,8 +60,25 @@ public:
 
         void run();
 
+        /// post the scene state to the render thread if it changed and show the newest frame
         void paint();
 
+        /// wait until the current scene state is rendered in the final quality, e.g. before taking a snapshot
+        void finish_frame();
+
+        /**
+          Save the current scene state rendered in the final quality to the given
+          file. Only the read back is started, the image is encoded and written in
+          the background when the transfer has finished.
+        */
+        void snapshot(const QString& filename);
+
+        /// \returns whether snapshots still wait for their read back, paint must be called again
+        bool has_pending_snapshots() const;
+
+        /// render the scene again, even though the scene state did not change
+        void invalidate();
+
         void resize(int w, int h);
 
         bool mouse_release(QMouseEvent *ev);
@@ -66,8 +95,13 @@ public:
 
         void set_landmark_model(LandmarkTableModel *ltm);
 
+        /// draw the landmarks as ray cast sphere impostors instead of meshes
+        void set_landmark_impostors(bool enable);
+
         void set_volume_iso_value(int value);
 
+        void request_pick(const QPoint& loc);
+
         void set_active_landmark_details(const QPoint& loc);
 
         const QString get_active_landmark_name() const;
@@ -76,6 +110,18 @@ public:
 
         void set_selected_landmark(int idx);
 
+        /// \returns the GPU time statistics of the rendering stages, empty if not rendering
+        std::vector<GpuProfiler::Statistics> get_gpu_statistics() const;
+
+        /// \returns the GPU time statistics as CSV
+        QString dump_gpu_statistics() const;
+
+        /**
+          Set the time in milliseconds a frame may take while the view is
+          rotated or moved, coarser volume resolutions are used to stay within.
+        */
+        void set_frame_budget(float ms);
+
 private:
         void update_rotation(QMouseEvent *ev);
 
@@ -85,6 +131,15 @@ private:
 
         void update_projection();
 
+        void post_request();
+
+        void present();
+
+        bool bind_frame(FrameQueue::Frame& frame);
+        void release_frame();
+
+        std::pair<bool, QVector3D> get_surface_coordinate(const QPoint& loc);
+
 
         QWidget *m_parent;
 
@@ -99,12 +154,26 @@ private:
         QPointF m_mouse_old_position;
         QVector2D m_viewport;
 
+        // the render thread and the frames it hands over to the widget
+        QThread m_thread;
+        RenderWorker *m_worker;
+        QOpenGLContext *m_worker_context;
+        QOffscreenSurface *m_worker_surface;
+        FrameQueue m_frames;
+        GLuint m_present_fbo;
+        SnapshotWriter m_snapshots;
+        bool m_scene_changed;
+        bool m_landmarks_sent;
+        unsigned m_landmark_revision;
+        float m_frame_budget;
+
         // Data to display
         VolumeData::Pointer m_volume;
         LandmarkTableModel *m_landmark_tm;
 
         PLandmarkList m_current_landmarks;
-        LandmarkListPainter m_lmp;
+        int m_active_landmark;
+        bool m_landmark_impostors;
 
         bool m_snapshot_pending;
         QImage m_last_snapshot;
@@ -0,0 +1,153 @@
+/* -*- mia-c++  -*-
+ *
+ * This file is part of qtlmpick- a tool for landmark picking and
+ * visualization in volume data
+ * Copyright (c) Genoa 2017,  Gert Wollny
+ *
+ * qtlmpick is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with MIA; if not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include "rendertargetpool.hh"
+#include <QOpenGLExtraFunctions>
+#include <QOpenGLFramebufferObjectFormat>
+#include <memory>
+#include <cassert>
+
+using std::unique_ptr;
+
+struct RenderTargetPoolImpl {
+        RenderTargetPoolImpl();
+
+        void allocate(const QSize& size, bool ray_targets);
+        void release_targets();
+
+        QOpenGLContext *m_context;
+        QSize m_size;
+
+        unique_ptr<QOpenGLFramebufferObject> m_ray_start;
+        unique_ptr<QOpenGLFramebufferObject> m_ray_end;
+        unique_ptr<QOpenGLFramebufferObject> m_volume;
+        GLuint m_space_coord_rb;
+
+        unsigned m_allocations;
+};
+
+RenderTargetPool::RenderTargetPool()
+{
+        impl = new RenderTargetPoolImpl();
+}
+
+RenderTargetPool::~RenderTargetPool()
+{
+        delete impl;
+}
+
+void RenderTargetPool::attach_gl(QOpenGLContext *context)
+{
+        impl->m_context = context;
+}
+
+void RenderTargetPool::detach_gl()
+{
+        impl->release_targets();
+        impl->m_context = nullptr;
+}
+
+bool RenderTargetPool::resize(const QSize& size, bool ray_targets)
+{
+        assert(impl->m_context);
+        bool has_ray_targets = impl->m_ray_start != nullptr;
+        if (impl->m_volume && size == impl->m_size && has_ray_targets == ray_targets)
+                return false;
+
+        impl->release_targets();
+        impl->allocate(size, ray_targets);
+        return true;
+}
+
+const QSize& RenderTargetPool::get_size() const
+{
+        return impl->m_size;
+}
+
+QOpenGLFramebufferObject& RenderTargetPool::get_ray_start()
+{
+        assert(impl->m_ray_start);
+        return *impl->m_ray_start;
+}
+
+QOpenGLFramebufferObject& RenderTargetPool::get_ray_end()
+{
+        assert(impl->m_ray_end);
+        return *impl->m_ray_end;
+}
+
+QOpenGLFramebufferObject& RenderTargetPool::get_volume()
+{
+        assert(impl->m_volume);
+        return *impl->m_volume;
+}
+
+unsigned RenderTargetPool::get_allocation_count() const
+{
+        return impl->m_allocations;
+}
+
+RenderTargetPoolImpl::RenderTargetPoolImpl():
+        m_context(nullptr),
+        m_space_coord_rb(0),
+        m_allocations(0)
+{
+}
+
+void RenderTargetPoolImpl::allocate(const QSize& size, bool ray_targets)
+{
+        QOpenGLFramebufferObjectFormat fbformat;
+        fbformat.setTextureTarget(GL_TEXTURE_2D);
+        fbformat.setInternalTextureFormat(GL_RGBA32F);
+
+        if (ray_targets) {
+                m_ray_start.reset(new QOpenGLFramebufferObject(size, fbformat));
+                m_ray_end.reset(new QOpenGLFramebufferObject(size, fbformat));
+                m_allocations += 2;
+        }
+        m_volume.reset(new QOpenGLFramebufferObject(size, fbformat));
+
+        // attach a renderbuffer for writing the texture coordinates
+        auto glex = m_context->extraFunctions();
+        m_volume->bind();
+        glex->glGenRenderbuffers(1, &m_space_coord_rb);
+        glex->glBindRenderbuffer(GL_RENDERBUFFER, m_space_coord_rb);
+        glex->glRenderbufferStorage(GL_RENDERBUFFER, GL_RGBA, size.width(), size.height());
+        glex->glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT1,
+                                        GL_RENDERBUFFER, m_space_coord_rb);
+        glex->glBindRenderbuffer(GL_RENDERBUFFER, 0);
+        m_volume->release();
+
+        m_size = size;
+        m_allocations += 2;
+}
+
+void RenderTargetPoolImpl::release_targets()
+{
+        if (m_space_coord_rb) {
+                m_context->extraFunctions()->glDeleteRenderbuffers(1, &m_space_coord_rb);
+                m_space_coord_rb = 0;
+        }
+        m_ray_start.reset();
+        m_ray_end.reset();
+        m_volume.reset();
+        m_size = QSize();
+}
@@ -0,0 +1,73 @@
+/* -*- mia-c++  -*-
+ *
+ * This file is part of qtlmpick- a tool for landmark picking and
+ * visualization in volume data
+ * Copyright (c) Genoa 2017,  Gert Wollny
+ *
+ * qtlmpick is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with MIA; if not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef RENDERTARGETPOOL_HH
+#define RENDERTARGETPOOL_HH
+
+#include <QOpenGLFramebufferObject>
+#include <QOpenGLContext>
+#include <QSize>
+
+/**
+  \brief Persistent set of off-screen render targets used by the volume renderer
+
+  The volume ray caster needs two float targets for the ray start and end
+  texture coordinates and one target that receives the shaded surface with the
+  picked texture coordinates attached as second color buffer. Creating these
+  per frame is expensive for large viewports, hence they are kept here and only
+  re-allocated when the viewport size changes.
+*/
+class RenderTargetPool
+{
+public:
+        RenderTargetPool();
+        ~RenderTargetPool();
+
+        void attach_gl(QOpenGLContext *context);
+
+        void detach_gl();
+
+        /**
+          Ensure that the render targets have the given size.
+          \param size the viewport size
+          \param ray_targets whether the ray start and end targets are needed,
+                 they are not used by the single pass ray caster
+          \returns true if the targets had to be (re-)allocated
+        */
+        bool resize(const QSize& size, bool ray_targets);
+
+        const QSize& get_size() const;
+
+        QOpenGLFramebufferObject& get_ray_start();
+
+        QOpenGLFramebufferObject& get_ray_end();
+
+        /// target for the shaded surface, color attachment 1 holds the texture coordinates
+        QOpenGLFramebufferObject& get_volume();
+
+        /// number of render target allocations since construction
+        unsigned get_allocation_count() const;
+
+private:
+        struct RenderTargetPoolImpl *impl;
+};
+
+#endif // RENDERTARGETPOOL_HH
@@ -0,0 +1,440 @@
+/* -*- mia-c++  -*-
+ *
+ * This file is part of qtlmpick- a tool for landmark picking and
+ * visualization in volume data
+ * Copyright (c) Genoa 2017,  Gert Wollny
+ *
+ * qtlmpick is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with MIA; if not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include "renderworker.hh"
+
+#include <QOpenGLContext>
+#include <QOffscreenSurface>
+#include <QOpenGLFramebufferObject>
+#include <QElapsedTimer>
+#include <QThread>
+#include <QDebug>
+#include <cassert>
+
+namespace {
+struct RefinementStage {
+        float resolution_scale;
+        int lod;
+        float step_scale;
+        int hit_refinement;
+};
+}
+
+// The first frame after a change is cast with a quarter of the rays on a
+// coarser level so that its cost doesn't depend on the size of the volume,
+// the following frames restore and then exceed the quality of a single pass
+static const RefinementStage refinement_stages[] = {
+        {0.5f, 1, 1.0f, 0},
+        {1.0f, 0, 1.0f, 0},
+        {1.0f, 0, 0.5f, 4}
+};
+
+static const int n_refinement_stages = sizeof(refinement_stages) / sizeof(refinement_stages[0]);
+
+bool RenderWorker::Request::same_volume_view(const Request& other) const
+{
+        return state.get_modelview_matrix() == other.state.get_modelview_matrix() &&
+                state.projection == other.state.projection &&
+                state.viewport == other.state.viewport &&
+                state.light_source == other.state.light_source &&
+                iso_value == other.iso_value;
+}
+
+FrameQueue::FrameQueue():
+        m_displayed(-1),
+        m_ready(-1)
+{
+        for (auto& frame: m_frames)
+                frame = Frame{0, QSize(), 0};
+        for (auto& fence: m_read_fences)
+                fence = 0;
+}
+
+int FrameQueue::get_render_target(GLsync& read_fence)
+{
+        std::lock_guard<std::mutex> lock(m_mutex);
+        for (int i = 0; i < n_frames; ++i) {
+                if (i != m_displayed && i != m_ready) {
+                        read_fence = m_read_fences[i];
+                        m_read_fences[i] = 0;
+                        return i;
+                }
+        }
+        assert(0 && "FrameQueue: with three frames one is always free");
+        return 0;
+}
+
+GLsync FrameQueue::publish(int idx, GLuint texture, const QSize& size, GLsync fence)
+{
+        std::lock_guard<std::mutex> lock(m_mutex);
+        GLsync stale = 0;
+
+        // the frame that was not shown in time is dropped
+        if (m_ready >= 0) {
+                stale = m_frames[m_ready].fence;
+                m_frames[m_ready].fence = 0;
+        }
+        m_frames[idx] = Frame{texture, size, fence};
+        m_ready = idx;
+        return stale;
+}
+
+bool FrameQueue::acquire(Frame& frame)
+{
+        std::lock_guard<std::mutex> lock(m_mutex);
+        if (m_ready >= 0) {
+                m_displayed = m_ready;
+                m_ready = -1;
+        }
+        if (m_displayed < 0)
+                return false;
+
+        frame = m_frames[m_displayed];
+
+        // the fence only needs to be waited for when the frame is shown the first time
+        m_frames[m_displayed].fence = 0;
+        return true;
+}
+
+GLsync FrameQueue::release(GLsync read_fence)
+{
+        std::lock_guard<std::mutex> lock(m_mutex);
+        if (m_displayed < 0)
+                return read_fence;
+
+        // only the last read of the frame must be waited for
+        std::swap(read_fence, m_read_fences[m_displayed]);
+        return read_fence;
+}
+
+std::vector<GLsync> FrameQueue::clear()
+{
+        std::lock_guard<std::mutex> lock(m_mutex);
+        std::vector<GLsync> fences;
+        for (auto& frame: m_frames) {
+                if (frame.fence)
+                        fences.push_back(frame.fence);
+                frame = Frame{0, QSize(), 0};
+        }
+        for (auto& fence: m_read_fences) {
+                if (fence)
+                        fences.push_back(fence);
+                fence = 0;
+        }
+        m_displayed = m_ready = -1;
+        return fences;
+}
+
+RenderWorker::RenderWorker(QOpenGLContext *context, QOffscreenSurface *surface, FrameQueue *frames):
+        m_context(context),
+        m_surface(surface),
+        m_frames(frames),
+        m_gl(nullptr),
+        m_has_request(false),
+        m_render_queued(false),
+        m_request_changed(false),
+        m_refinement_stage(0),
+        m_interaction_lod(0),
+        m_frame_time(0.0f)
+{
+}
+
+void RenderWorker::post(const Request& request)
+{
+        std::lock_guard<std::mutex> lock(m_request_mutex);
+
+        // if only the landmarks changed the refined volume image is kept
+        if (!m_has_request || !m_request.same_volume_view(request))
+                m_request_changed = true;
+        m_request = request;
+        m_has_request = true;
+        schedule();
+}
+
+void RenderWorker::schedule()
+{
+        // must be called with the request mutex locked, states that arrive
+        // before the frame is started are merged into this one
+        if (m_render_queued)
+                return;
+        m_render_queued = true;
+        QMetaObject::invokeMethod(this, [this]() {render_pending();}, Qt::QueuedConnection);
+}
+
+void RenderWorker::render_pending()
+{
+        Request request;
+        {
+                std::lock_guard<std::mutex> lock(m_request_mutex);
+                if (!m_render_queued)
+                        return;
+                m_render_queued = false;
+                request = m_request;
+
+                // start over with a preview when the scene changed
+                if (m_request_changed) {
+                        m_refinement_stage = 0;
+                        m_request_changed = false;
+                }
+        }
+        draw(request);
+}
+
+void RenderWorker::render_converged()
+{
+        Request request;
+        {
+                std::lock_guard<std::mutex> lock(m_request_mutex);
+                if (!m_has_request)
+                        return;
+                m_render_queued = false;
+                m_request_changed = false;
+                request = m_request;
+        }
+        m_refinement_stage = n_refinement_stages - 1;
+        draw(request);
+}
+
+void RenderWorker::initialize()
+{
+        if (!m_context->makeCurrent(m_surface)) {
+                qWarning() << "RenderWorker: unable to make the OpenGL context current, nothing will be drawn";
+                return;
+        }
+        m_gl = m_context->extraFunctions();
+        qDebug() << "OpenGL render thread: " << (char*)m_gl->glGetString(GL_VERSION);
+
+        m_profiler.attach_gl();
+
+        m_lmp.reset(new LandmarkListPainter);
+        m_lmp->attach_gl(m_context);
+        m_lmp->set_gpu_profiler(&m_profiler);
+
+        // data that arrived before the context was available
+        if (m_landmarks)
+                m_lmp->set_landmark_list(m_landmarks);
+
+        if (m_volume) {
+                PVolumeData volume;
+                std::swap(volume, m_volume);
+                set_volume(volume);
+        }
+}
+
+void RenderWorker::shutdown(QThread *context_thread)
+{
+        if (m_gl) {
+                if (m_volume)
+                        m_volume->detach_gl();
+                m_lmp->detach_gl();
+                m_lmp.reset();
+                m_profiler.detach_gl();
+
+                for (auto& target: m_targets)
+                        target.reset();
+
+                for (auto fence: m_frames->clear())
+                        m_gl->glDeleteSync(fence);
+
+                m_context->doneCurrent();
+                m_gl = nullptr;
+        }
+        // the context must be destroyed in the thread of its surface
+        m_context->moveToThread(context_thread);
+}
+
+void RenderWorker::set_volume(PVolumeData volume)
+{
+        std::swap(m_volume, volume);
+        m_interaction_lod = 0;
+        m_frame_time = 0.0f;
+
+        if (!m_gl)
+                return;
+
+        if (volume) {
+                volume->detach_gl();
+                volume->set_gpu_profiler(nullptr);
+        }
+
+        if (m_volume) {
+                m_volume->attach_gl(m_context);
+                m_volume->set_gpu_profiler(&m_profiler);
+                if (!m_viewport.isEmpty())
+                        m_volume->resize_viewport(m_viewport);
+                m_lmp->set_viewspace_correction(m_volume->get_viewspace_scale(),
+                                                m_volume->get_viewspace_shift());
+        }
+
+        std::lock_guard<std::mutex> lock(m_request_mutex);
+        if (m_has_request) {
+                m_request_changed = true;
+                schedule();
+        }
+}
+
+void RenderWorker::set_landmark_list(PLandmarkList list)
+{
+        m_landmarks = list;
+        if (!m_gl)
+                return;
+
+        m_lmp->set_landmark_list(m_landmarks);
+
+        std::lock_guard<std::mutex> lock(m_request_mutex);
+        if (m_has_request)
+                schedule();
+}
+
+void RenderWorker::set_landmark_impostors(bool enable)
+{
+        if (!m_gl)
+                return;
+
+        m_lmp->set_use_impostors(enable);
+
+        std::lock_guard<std::mutex> lock(m_request_mutex);
+        if (m_has_request)
+                schedule();
+}
+
+std::vector<GpuProfiler::Statistics> RenderWorker::get_gpu_statistics() const
+{
+        return m_profiler.get_statistics();
+}
+
+QString RenderWorker::dump_gpu_statistics() const
+{
+        return m_profiler.dump();
+}
+
+void RenderWorker::request_pick(const QPoint& loc)
+{
+        if (m_volume && m_gl)
+                m_volume->request_pick(loc);
+}
+
+std::pair<bool, QVector3D> RenderWorker::get_surface_coordinate(const QPoint& loc)
+{
+        if (!m_volume || !m_gl)
+                return std::make_pair(false, QVector3D(-1, -1, -1));
+        return m_volume->get_surface_coordinate(loc);
+}
+
+void RenderWorker::draw(const Request& request)
+{
+        const QSize& size = request.state.viewport;
+        if (!m_gl || size.isEmpty())
+                return;
+
+        if (size != m_viewport) {
+                m_viewport = size;
+                if (m_volume)
+                        m_volume->resize_viewport(m_viewport);
+        }
+
+        // the frames are only re-created when the view was resized
+        GLsync read_fence = 0;
+        int idx = m_frames->get_render_target(read_fence);
+
+        // the widget may still be reading the frame on the GPU
+        if (read_fence) {
+                m_gl->glWaitSync(read_fence, 0, GL_TIMEOUT_IGNORED);
+                m_gl->glDeleteSync(read_fence);
+        }
+
+        auto& target = m_targets[idx];
+        if (!target || target->size() != size)
+                target.reset(new QOpenGLFramebufferObject(size, QOpenGLFramebufferObject::CombinedDepthStencil));
+
+        target->bind();
+        m_gl->glViewport(0, 0, size.width(), size.height());
+
+        m_gl->glClearColor(0.1,0.1,0.1,1);
+        m_gl->glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+
+        m_gl->glEnable(GL_DEPTH_TEST);
+        m_gl->glDepthFunc(GL_LESS);
+        m_gl->glDepthMask(GL_TRUE);
+
+        const RefinementStage& stage = refinement_stages[m_refinement_stage];
+        if (m_volume) {
+                m_volume->set_lod(std::max(stage.lod, request.interacting ? m_interaction_lod : 0));
+                m_volume->set_resolution_scale(stage.resolution_scale);
+                m_volume->set_sampling(stage.step_scale, stage.hit_refinement);
+                if (request.interacting) {
+                        // wait for the volume to be drawn to measure the time it takes
+                        QElapsedTimer timer;
+                        timer.start();
+                        m_volume->draw(request.state);
+                        m_gl->glFinish();
+                        update_interaction_lod(timer.nsecsElapsed() * 1e-6f, request.frame_budget);
+                } else {
+                        m_volume->draw(request.state);
+                }
+        }
+
+        m_lmp->set_active_landmark(request.active_landmark);
+        m_lmp->draw(request.state);
+        target->release();
+
+        // the widget waits for the fence on the GPU before it shows the frame
+        GLsync fence = m_gl->glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+        m_gl->glFlush();
+        GLsync stale = m_frames->publish(idx, target->texture(), size, fence);
+        if (stale)
+                m_gl->glDeleteSync(stale);
+
+        emit frame_ready();
+
+        // only the results that are already available are read
+        m_profiler.collect();
+
+        if (!m_volume)
+                return;
+
+        // keep drawing while the volume pages are streamed in, and refine
+        // the image while the view is not moved
+        if (!m_volume->is_complete()) {
+                std::lock_guard<std::mutex> lock(m_request_mutex);
+                schedule();
+        } else if (!request.interacting && m_refinement_stage < n_refinement_stages - 1) {
+                ++m_refinement_stage;
+                std::lock_guard<std::mutex> lock(m_request_mutex);
+                schedule();
+        }
+}
+
+void RenderWorker::update_interaction_lod(float frame_time, float frame_budget)
+{
+        // smooth the measured time to avoid switching levels on single slow frames
+        m_frame_time = m_frame_time > 0.0f ? 0.7f * m_frame_time + 0.3f * frame_time : frame_time;
+
+        // each level halves the number of steps along the rays, so the
+        // time per frame is expected to roughly halve as well
+        if (m_frame_time > frame_budget && m_interaction_lod < m_volume->get_lod_levels() - 1) {
+                ++m_interaction_lod;
+                m_frame_time *= 0.5f;
+        } else if (2.5f * m_frame_time < frame_budget && m_interaction_lod > 0) {
+                --m_interaction_lod;
+                m_frame_time *= 2.0f;
+        }
+}
@@ -0,0 +1,204 @@
+/* -*- mia-c++  -*-
+ *
+ * This file is part of qtlmpick- a tool for landmark picking and
+ * visualization in volume data
+ * Copyright (c) Genoa 2017,  Gert Wollny
+ *
+ * qtlmpick is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with MIA; if not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef RENDERWORKER_HH
+#define RENDERWORKER_HH
+
+#include "volumedata.hh"
+#include "landmarklistpainter.hh"
+#include "globalscenestate.hh"
+#include "gpuprofiler.hh"
+
+#include <QObject>
+#include <QOpenGLExtraFunctions>
+#include <QPoint>
+#include <QSize>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+class QOpenGLContext;
+class QOffscreenSurface;
+class QOpenGLFramebufferObject;
+
+/**
+  \brief Hands finished frames from the render thread to the widget
+
+  Three frames are used: one shown by the widget, one finished and
+  waiting to be shown, and one the render thread draws to. A fence is
+  attached to every finished frame, the widget waits for it on the GPU
+  before reading the frame. In turn the widget attaches a fence after
+  reading the shown frame, and the render thread waits for it on the GPU
+  before drawing to the frame again, so neither thread blocks the other.
+*/
+class FrameQueue {
+public:
+        static const int n_frames = 3;
+
+        struct Frame {
+                GLuint texture;
+                QSize size;
+                GLsync fence;
+        };
+
+        FrameQueue();
+
+        /**
+           \param[out] read_fence the fence of the last read of the frame, the
+           render thread must wait for it and delete it if it is not 0
+           \returns the index of the frame that is neither shown nor waiting to be shown
+        */
+        int get_render_target(GLsync& read_fence);
+
+        /**
+           Publish a finished frame, it replaces the frame that is waiting to be shown.
+           \returns the fence of the replaced frame that must be deleted by the caller, or 0
+        */
+        GLsync publish(int idx, GLuint texture, const QSize& size, GLsync fence);
+
+        /**
+           Switch to the newest finished frame if there is one.
+           \param[out] frame the frame to show, its fence must be waited for
+           and deleted by the caller if it is not 0
+           \returns false if no frame was finished yet
+        */
+        bool acquire(Frame& frame);
+
+        /**
+           Attach a fence to the shown frame after reading it was issued.
+           \returns the fence that must be deleted by the caller, or 0
+        */
+        GLsync release(GLsync read_fence);
+
+        /// remove all frames, \returns the fences that were not waited for
+        std::vector<GLsync> clear();
+
+private:
+        mutable std::mutex m_mutex;
+        int m_displayed;
+        int m_ready;
+        Frame m_frames[n_frames];
+        GLsync m_read_fences[n_frames];
+};
+
+/**
+  \brief Does all the OpenGL work of the view in a dedicated thread
+
+  The worker lives in its own thread with an OpenGL context that shares
+  its objects with the context of the widget. The scene state is posted
+  by the GUI thread, if several states arrive while a frame is drawn, only
+  the latest one is rendered. A new state is first rendered as a quick
+  preview, while no new state arrives the image is refined in further
+  frames until the final quality is reached. All other methods must be
+  called in the thread of the worker, i.e. by using QMetaObject::invokeMethod.
+*/
+class RenderWorker : public QObject
+{
+        Q_OBJECT
+public:
+        struct Request {
+                GlobalSceneState state;
+                float iso_value;
+                int active_landmark;
+                bool interacting;
+                float frame_budget;
+
+                /// \returns true if the volume is seen the same way in both requests
+                bool same_volume_view(const Request& other) const;
+        };
+
+        RenderWorker(QOpenGLContext *context, QOffscreenSurface *surface, FrameQueue *frames);
+
+        /// thread safe: render the given state as soon as possible
+        void post(const Request& request);
+
+        /// make the context current in the worker thread and attach the drawables
+        void initialize();
+
+        /// release all OpenGL resources and hand the context back to the given thread
+        void shutdown(QThread *context_thread);
+
+        void set_volume(PVolumeData volume);
+
+        /// set the landmarks to be drawn, the list must not be shared with another thread
+        void set_landmark_list(PLandmarkList list);
+
+        /// draw the landmarks as sphere impostors instead of meshes
+        void set_landmark_impostors(bool enable);
+
+        /// render the latest posted state if it was not rendered yet
+        void render_pending();
+
+        /// render the latest posted state in the final quality
+        void render_converged();
+
+        void request_pick(const QPoint& loc);
+
+        std::pair<bool, QVector3D> get_surface_coordinate(const QPoint& loc);
+
+        /// thread safe: the GPU time statistics of the rendering stages
+        std::vector<GpuProfiler::Statistics> get_gpu_statistics() const;
+
+        /// thread safe: the GPU time statistics as CSV
+        QString dump_gpu_statistics() const;
+
+signals:
+        /// a new frame is available in the frame queue
+        void frame_ready();
+
+private:
+        void schedule();
+
+        void draw(const Request& request);
+
+        void update_interaction_lod(float frame_time, float frame_budget);
+
+        QOpenGLContext *m_context;
+        QOffscreenSurface *m_surface;
+        FrameQueue *m_frames;
+        QOpenGLExtraFunctions *m_gl;
+
+        // the mail box for the scene state
+        std::mutex m_request_mutex;
+        Request m_request;
+        bool m_has_request;
+        bool m_render_queued;
+        bool m_request_changed;
+
+        // the current step of the progressive refinement
+        int m_refinement_stage;
+
+        std::unique_ptr<QOpenGLFramebufferObject> m_targets[FrameQueue::n_frames];
+
+        PVolumeData m_volume;
+        // created in the worker thread, because its OpenGL objects are QObjects
+        std::unique_ptr<LandmarkListPainter> m_lmp;
+        PLandmarkList m_landmarks;
+        QSize m_viewport;
+
+        // level of detail used while a mouse button is down
+        int m_interaction_lod;
+        float m_frame_time;
+
+        GpuProfiler m_profiler;
+};
+
+#endif // RENDERWORKER_HH
@@ -0,0 +1,161 @@
+/* -*- mia-c++  -*-
+ *
+ * This file is part of qtlmpick- a tool for landmark picking and
+ * visualization in volume data
+ * Copyright (c) Genoa 2017,  Gert Wollny
+ *
+ * qtlmpick is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with MIA; if not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include "snapshotwriter.hh"
+
+#include <QRunnable>
+#include <QImage>
+#include <QThread>
+#include <QDebug>
+#include <algorithm>
+
+namespace {
+class EncodeImage : public QRunnable {
+public:
+        EncodeImage(const QImage& image, const QString& filename, QSemaphore& queue_slots):
+                m_image(image),
+                m_filename(filename),
+                m_queue_slots(queue_slots)
+        {
+        }
+
+        void run() override
+        {
+                // OpenGL stores the rows bottom up, and the alpha channel holds the volume depth
+                QImage image = m_image.mirrored().convertToFormat(QImage::Format_RGB32);
+                if (!image.save(m_filename))
+                        qWarning() << "Unable to save snapshot" << m_filename;
+                m_queue_slots.release();
+        }
+private:
+        QImage m_image;
+        QString m_filename;
+        QSemaphore& m_queue_slots;
+};
+}
+
+SnapshotWriter::SnapshotWriter(int n_buffers, int max_queued):
+        m_is_attached(false),
+        m_n_buffers(n_buffers),
+        m_queue_slots(max_queued)
+{
+        // leave one core to the GUI and the render thread
+        m_encoders.setMaxThreadCount(std::max(QThread::idealThreadCount() - 1, 1));
+}
+
+SnapshotWriter::~SnapshotWriter()
+{
+        m_encoders.waitForDone();
+}
+
+void SnapshotWriter::attach_gl()
+{
+        initializeOpenGLFunctions();
+        m_free_buffers.resize(m_n_buffers);
+        glGenBuffers(m_n_buffers, m_free_buffers.data());
+        m_is_attached = true;
+}
+
+void SnapshotWriter::detach_gl()
+{
+        if (!m_is_attached)
+                return;
+
+        while (!m_pending.empty()) {
+                complete(m_pending.front());
+                m_pending.pop_front();
+        }
+        glDeleteBuffers(m_free_buffers.size(), m_free_buffers.data());
+        m_free_buffers.clear();
+        m_is_attached = false;
+}
+
+void SnapshotWriter::read(const QSize& size, const QString& filename)
+{
+        if (!m_is_attached || size.isEmpty())
+                return;
+
+        // all buffers in flight: wait for the oldest transfer
+        if (m_free_buffers.empty()) {
+                complete(m_pending.front());
+                m_pending.pop_front();
+        }
+
+        Readback readback{m_free_buffers.back(), 0, size, filename};
+        m_free_buffers.pop_back();
+
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, readback.buffer);
+        glBufferData(GL_PIXEL_PACK_BUFFER, 4 * size.width() * size.height(), nullptr, GL_STREAM_READ);
+        glPixelStorei(GL_PACK_ALIGNMENT, 4);
+        glReadPixels(0, 0, size.width(), size.height(), GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+
+        readback.fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+        glFlush();
+        m_pending.push_back(readback);
+}
+
+bool SnapshotWriter::poll()
+{
+        while (!m_pending.empty()) {
+                GLenum status = glClientWaitSync(m_pending.front().fence, 0, 0);
+                if (status != GL_ALREADY_SIGNALED && status != GL_CONDITION_SATISFIED)
+                        break;
+                complete(m_pending.front());
+                m_pending.pop_front();
+        }
+        return !m_pending.empty();
+}
+
+bool SnapshotWriter::has_pending() const
+{
+        return !m_pending.empty();
+}
+
+void SnapshotWriter::complete(Readback& readback)
+{
+        glClientWaitSync(readback.fence, GL_SYNC_FLUSH_COMMANDS_BIT, GL_TIMEOUT_IGNORED);
+        glDeleteSync(readback.fence);
+
+        const int w = readback.size.width();
+        const int h = readback.size.height();
+
+        // the buffer is reused, so the pixels are copied before encoding
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, readback.buffer);
+        auto pixels = static_cast<const uchar *>(glMapBufferRange(GL_PIXEL_PACK_BUFFER, 0, 4 * w * h,
+                                                                  GL_MAP_READ_BIT));
+        QImage image;
+        if (pixels) {
+                image = QImage(pixels, w, h, 4 * w, QImage::Format_RGBA8888).copy();
+                glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+        } else {
+                qWarning() << "SnapshotWriter: unable to map the pixel buffer of" << readback.filename;
+        }
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+        m_free_buffers.push_back(readback.buffer);
+
+        if (image.isNull())
+                return;
+
+        // back-pressure: wait for an encoder if too many images are queued
+        m_queue_slots.acquire();
+        m_encoders.start(new EncodeImage(image, readback.filename, m_queue_slots));
+}
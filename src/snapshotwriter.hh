@@ -0,0 +1,98 @@
+/* -*- mia-c++  -*-
+ *
+ * This file is part of qtlmpick- a tool for landmark picking and
+ * visualization in volume data
+ * Copyright (c) Genoa 2017,  Gert Wollny
+ *
+ * qtlmpick is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with MIA; if not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef SNAPSHOTWRITER_HH
+#define SNAPSHOTWRITER_HH
+
+#include <QOpenGLExtraFunctions>
+#include <QSemaphore>
+#include <QThreadPool>
+#include <QString>
+#include <QSize>
+#include <deque>
+#include <vector>
+
+/**
+  \brief Saves snapshots of frames without stalling the rendering
+
+  The frame is read back into a pixel buffer object, so the read
+  returns as soon as the transfer is queued. Once the transfer has
+  finished the pixels are copied from the buffer and encoded and
+  written by a pool of worker threads.
+
+  The number of transfers in flight and of images waiting to be encoded
+  is bounded: if all pixel buffers are in use, reading waits for the oldest
+  transfer, and if the encoders fall behind, handing over an image waits
+  for one of them to finish. All methods but the destructor require the
+  OpenGL context the writer was attached to to be current.
+*/
+class SnapshotWriter : private QOpenGLExtraFunctions {
+public:
+        /**
+           \param n_buffers number of pixel buffers, i.e. transfers in flight
+           \param max_queued maximal number of images waiting for or being encoded
+        */
+        SnapshotWriter(int n_buffers = 3, int max_queued = 4);
+
+        /// waits until all images handed to the encoders are written
+        ~SnapshotWriter();
+
+        void attach_gl();
+
+        /// finish the pending transfers and free the pixel buffers
+        void detach_gl();
+
+        /**
+           Start reading back the color buffer of the bound read frame buffer
+           \param size size of the region to read, starting at the origin
+           \param filename the file to save the image to, the format is deduced from the suffix
+        */
+        void read(const QSize& size, const QString& filename);
+
+        /**
+           Hand the finished transfers over to the encoders
+           \returns whether transfers are still pending, i.e. poll must be called again
+        */
+        bool poll();
+
+        /// \returns whether transfers are pending
+        bool has_pending() const;
+
+private:
+        struct Readback {
+                GLuint buffer;
+                GLsync fence;
+                QSize size;
+                QString filename;
+        };
+
+        void complete(Readback& readback);
+
+        bool m_is_attached;
+        int m_n_buffers;
+        std::vector<GLuint> m_free_buffers;
+        std::deque<Readback> m_pending;
+
+        QThreadPool m_encoders;
+        QSemaphore m_queue_slots;
+};
+
+#endif // SNAPSHOTWRITER_HH
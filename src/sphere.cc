@@ -25,12 +25,27 @@
 #include <QOpenGLBuffer>
 #include <QOpenGLShaderProgram>
 #include <QOpenGLVertexArrayObject>
+#include <QOpenGLExtraFunctions>
 #include <vector>
 #include <cassert>
+#include <cstddef>
 
 using std::vector;
 using std::transform;
 
+struct Triangle {
+        Triangle(unsigned short  _a, unsigned short  _b, unsigned short  _c):
+                a(_a), b(_b), c(_c){}
+        unsigned short a,b,c;
+};
+
+struct VNVertex {
+        QVector3D v;
+        QVector3D n;
+};
+
+static void create_sphere_geometry(float r, vector<VNVertex>& vnarray, vector<Triangle>& triangles);
+
 struct SphereImpl {
 
         SphereImpl(float r);
@@ -110,17 +125,6 @@ SphereImpl::SphereImpl(float r):
 {
 }
 
-struct Triangle {
-        Triangle(unsigned short  _a, unsigned short  _b, unsigned short  _c):
-                a(_a), b(_b), c(_c){}
-        unsigned short a,b,c;
-};
-
-struct VNVertex {
-        QVector3D v;
-        QVector3D n;
-};
-
 void SphereImpl::attach_gl()
 {
 
@@ -182,12 +186,24 @@ void SphereImpl::detach_gl()
 
 
 void SphereImpl::create_sphere(float r)
+{
+        vector<VNVertex> vnarray;
+        vector<Triangle> triangles;
+        create_sphere_geometry(r, vnarray, triangles);
+
+        m_arrayBuf.allocate(&vnarray[0], vnarray.size() * sizeof(VNVertex));
+        m_indexBuf.allocate(&triangles[0], triangles.size() * sizeof(Triangle));
+
+        m_n_triangles = triangles.size();
+}
+
+static void create_sphere_geometry(float r, vector<VNVertex>& vnarray, vector<Triangle>& triangles)
 {
         vector<QVector3D> points({{1,0,0}, {0, 1, 0}, {0, 0, 1},
                                   {-1, 0, 0}, {0,-1, 0}, {0, 0,-1}});
 
-        vector<Triangle> triangles({{0,2,1}, {0,4,2}, {0,5,4}, {4,5,3},
-                                    {3,2,4}, {2,3,1}, {3,5,1}, {1,5,0}});
+        triangles = vector<Triangle>({{0,2,1}, {0,4,2}, {0,5,4}, {4,5,3},
+                                      {3,2,4}, {2,3,1}, {3,5,1}, {1,5,0}});
 
         // subdivide the triangles
         const int sub_rounds = 3;
@@ -226,18 +242,13 @@ void SphereImpl::create_sphere(float r)
                 }
         }
 
-        vector<VNVertex> vnarray(points.size());
+        vnarray.resize(points.size());
         transform(points.begin(), points.end(), vnarray.begin(), [r](const QVector3D& p){
                 VNVertex vn;
                 vn.n = -p.normalized();
                 vn.v = r * vn.n;
                 return vn;
         });
-        m_arrayBuf.allocate(&vnarray[0], vnarray.size() * sizeof(VNVertex));
-        m_indexBuf.allocate(&triangles[0], triangles.size() * sizeof(Triangle));
-
-        m_n_triangles = triangles.size();
-
 }
 
 void SphereImpl::draw(const GlobalSceneState& state, QOpenGLContext& context, const QVector4D& color)
@@ -273,3 +284,294 @@ void SphereImpl::draw(const GlobalSceneState& state, QOpenGLContext& context, co
         m_indexBuf.release();
         m_vao.release();
 }
+
+struct SphereSetImpl {
+
+        SphereSetImpl(float r);
+
+        void attach_gl(QOpenGLContext& context);
+
+        void detach_gl();
+
+        void set_instance_attributes(QOpenGLShaderProgram& program, QOpenGLContext& context);
+
+        void draw(const GlobalSceneState& state, QOpenGLContext& context);
+
+        float m_radius;
+
+        QOpenGLBuffer m_arrayBuf;
+        QOpenGLBuffer m_indexBuf;
+        QOpenGLBuffer m_instanceBuf;
+        QOpenGLShaderProgram m_program;
+        QOpenGLVertexArrayObject m_vao;
+
+        // screen aligned quads for the impostors
+        QOpenGLBuffer m_quadBuf;
+        QOpenGLBuffer m_quadIndexBuf;
+        QOpenGLShaderProgram m_impostor_program;
+        QOpenGLVertexArrayObject m_impostor_vao;
+
+        int m_light_direction_param;
+        int m_view_matrix_param;
+        int m_normal_matrix_param;
+        int m_n_triangles;
+        SphereSet::EMode m_mode;
+
+        // the instances and what of them must be uploaded with the next draw
+        vector<SphereInstance> m_instances;
+        bool m_upload_all;
+        vector<unsigned> m_changed;
+};
+
+SphereSet::SphereSet()
+{
+        impl = new SphereSetImpl(0.015);
+}
+
+SphereSet::~SphereSet()
+{
+        delete impl;
+}
+
+void SphereSet::set_instances(const std::vector<SphereInstance>& instances)
+{
+        impl->m_instances = instances;
+        impl->m_upload_all = true;
+        impl->m_changed.clear();
+}
+
+void SphereSet::set_instance_color(unsigned idx, const QVector4D& color)
+{
+        assert(idx < impl->m_instances.size());
+        if (impl->m_instances[idx].color == color)
+                return;
+        impl->m_instances[idx].color = color;
+        if (!impl->m_upload_all)
+                impl->m_changed.push_back(idx);
+}
+
+void SphereSet::set_mode(EMode mode)
+{
+        impl->m_mode = mode;
+}
+
+SphereSet::EMode SphereSet::get_mode() const
+{
+        return impl->m_mode;
+}
+
+size_t SphereSet::get_instance_count() const
+{
+        return impl->m_instances.size();
+}
+
+void SphereSet::do_attach_gl()
+{
+        impl->attach_gl(*get_context());
+}
+
+void SphereSet::do_detach_gl()
+{
+        impl->detach_gl();
+}
+
+void SphereSet::do_draw(const GlobalSceneState& state)
+{
+        impl->draw(state, *get_context());
+}
+
+SphereSetImpl::SphereSetImpl(float r):
+        m_radius(r),
+        m_arrayBuf(QOpenGLBuffer::VertexBuffer),
+        m_indexBuf(QOpenGLBuffer::IndexBuffer),
+        m_instanceBuf(QOpenGLBuffer::VertexBuffer),
+        m_quadBuf(QOpenGLBuffer::VertexBuffer),
+        m_quadIndexBuf(QOpenGLBuffer::IndexBuffer),
+        m_light_direction_param(-1),
+        m_view_matrix_param(-1),
+        m_normal_matrix_param(-1),
+        m_n_triangles(0),
+        m_mode(SphereSet::sm_mesh),
+        m_upload_all(true)
+{
+}
+
+void SphereSetImpl::attach_gl(QOpenGLContext& context)
+{
+        vector<VNVertex> vnarray;
+        vector<Triangle> triangles;
+        create_sphere_geometry(m_radius, vnarray, triangles);
+        m_n_triangles = triangles.size();
+
+        m_arrayBuf.create();
+        m_indexBuf.create();
+        m_instanceBuf.create();
+        m_instanceBuf.setUsagePattern(QOpenGLBuffer::DynamicDraw);
+        m_vao.create();
+        m_vao.bind();
+
+        m_arrayBuf.bind();
+        m_arrayBuf.allocate(&vnarray[0], vnarray.size() * sizeof(VNVertex));
+        m_indexBuf.bind();
+        m_indexBuf.allocate(&triangles[0], triangles.size() * sizeof(Triangle));
+
+        Drawable::compile_and_link(m_program, "shere_instanced_vtx.glsl", "basic_frag.glsl");
+
+        // the sphere geometry is the same for all instances
+        int vertexLocation = m_program.attributeLocation("qt_vertex");
+        if (vertexLocation == -1)
+                qWarning() << "vertex loction attribute not found";
+        m_program.enableAttributeArray(vertexLocation);
+        m_program.setAttributeBuffer(vertexLocation, GL_FLOAT, 0, 3, sizeof(VNVertex));
+
+        int normalLocation = m_program.attributeLocation("qt_normal");
+        if (normalLocation != -1) {
+                m_program.enableAttributeArray(normalLocation);
+                m_program.setAttributeBuffer(normalLocation, GL_FLOAT, sizeof(QVector3D), 3, sizeof(VNVertex));
+        }else
+                qWarning() << "'normal' loction attribute not found";
+
+        set_instance_attributes(m_program, context);
+
+        m_vao.release();
+        m_arrayBuf.release();
+        m_indexBuf.release();
+
+        // impostors: two triangles per sphere, the corners are expanded in the vertex shader
+        static const GLfloat corners[] = {-1, -1,  1, -1,  1, 1,  -1, 1};
+        static const GLushort quad[] = {0, 1, 2,  0, 2, 3};
+
+        m_quadBuf.create();
+        m_quadIndexBuf.create();
+        m_impostor_vao.create();
+        m_impostor_vao.bind();
+
+        m_quadBuf.bind();
+        m_quadBuf.allocate(corners, sizeof(corners));
+        m_quadIndexBuf.bind();
+        m_quadIndexBuf.allocate(quad, sizeof(quad));
+
+        Drawable::compile_and_link(m_impostor_program, "shere_impostor_vtx.glsl", "shere_impostor_frag.glsl");
+
+        int cornerLocation = m_impostor_program.attributeLocation("qt_corner");
+        if (cornerLocation == -1)
+                qWarning() << "corner loction attribute not found";
+        m_impostor_program.enableAttributeArray(cornerLocation);
+        m_impostor_program.setAttributeBuffer(cornerLocation, GL_FLOAT, 0, 2, 2 * sizeof(GLfloat));
+
+        set_instance_attributes(m_impostor_program, context);
+
+        m_impostor_vao.release();
+        m_quadBuf.release();
+        m_quadIndexBuf.release();
+
+        m_light_direction_param = m_program.uniformLocation("qt_light_direction");
+        assert(m_light_direction_param != -1);
+
+        m_view_matrix_param = m_program.uniformLocation("qt_view_matrix");
+        assert(m_view_matrix_param != -1);
+
+        m_normal_matrix_param = m_program.uniformLocation("qt_normal_matrix");
+        assert(m_normal_matrix_param != -1);
+
+        // a new buffer needs all the data
+        m_upload_all = true;
+        m_changed.clear();
+}
+
+void SphereSetImpl::set_instance_attributes(QOpenGLShaderProgram& program, QOpenGLContext& context)
+{
+        // center and color advance once per sphere
+        auto glex = context.extraFunctions();
+        m_instanceBuf.bind();
+
+        int offsetLocation = program.attributeLocation("instance_offset");
+        assert(offsetLocation != -1);
+        program.enableAttributeArray(offsetLocation);
+        program.setAttributeBuffer(offsetLocation, GL_FLOAT, offsetof(SphereInstance, offset), 3,
+                                   sizeof(SphereInstance));
+        glex->glVertexAttribDivisor(offsetLocation, 1);
+
+        int colorLocation = program.attributeLocation("instance_color");
+        assert(colorLocation != -1);
+        program.enableAttributeArray(colorLocation);
+        program.setAttributeBuffer(colorLocation, GL_FLOAT, offsetof(SphereInstance, color), 4,
+                                   sizeof(SphereInstance));
+        glex->glVertexAttribDivisor(colorLocation, 1);
+
+        m_instanceBuf.release();
+}
+
+void SphereSetImpl::detach_gl()
+{
+        m_arrayBuf.destroy();
+        m_indexBuf.destroy();
+        m_instanceBuf.destroy();
+        m_vao.destroy();
+        m_quadBuf.destroy();
+        m_quadIndexBuf.destroy();
+        m_impostor_vao.destroy();
+}
+
+void SphereSetImpl::draw(const GlobalSceneState& state, QOpenGLContext& context)
+{
+        if (m_instances.empty())
+                return;
+
+        auto glex = context.extraFunctions();
+
+        // only upload what changed since the last draw
+        m_instanceBuf.bind();
+        if (m_upload_all) {
+                m_instanceBuf.allocate(&m_instances[0], m_instances.size() * sizeof(SphereInstance));
+                m_upload_all = false;
+        } else {
+                for (auto idx: m_changed)
+                        m_instanceBuf.write(idx * sizeof(SphereInstance), &m_instances[idx], sizeof(SphereInstance));
+        }
+        m_changed.clear();
+        m_instanceBuf.release();
+
+        QMatrix4x4 modelview = state.get_modelview_matrix();
+
+        glex->glEnable(GL_DEPTH_TEST);
+        glex->glDepthFunc(GL_LESS);
+
+        glex->glEnable(GL_BLEND);
+        glex->glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+
+        if (m_mode == SphereSet::sm_impostor) {
+                m_impostor_vao.bind();
+                m_impostor_program.bind();
+
+                m_impostor_program.setUniformValue("qt_modelview", modelview);
+                m_impostor_program.setUniformValue("qt_projection", state.projection);
+                m_impostor_program.setUniformValue("qt_light_direction", state.light_source);
+                m_impostor_program.setUniformValue("radius", m_radius);
+
+                // the quads face the viewer, their winding doesn't matter
+                glex->glDisable(GL_CULL_FACE);
+                glex->glDrawElementsInstanced(GL_TRIANGLES, 6, GL_UNSIGNED_SHORT, 0, m_instances.size());
+
+                m_impostor_program.release();
+                m_impostor_vao.release();
+        } else {
+                m_vao.bind();
+                m_program.bind();
+
+                m_program.setUniformValue(m_view_matrix_param, state.projection * modelview);
+                m_program.setUniformValue(m_normal_matrix_param, modelview.normalMatrix());
+                m_program.setUniformValue(m_light_direction_param, state.light_source);
+
+                glex->glEnable(GL_CULL_FACE);
+                glex->glCullFace(GL_BACK);
+
+                glex->glDrawElementsInstanced(GL_TRIANGLES, 3 * m_n_triangles, GL_UNSIGNED_SHORT, 0,
+                                              m_instances.size());
+
+                m_program.release();
+                m_vao.release();
+        }
+
+        glex->glDisable(GL_BLEND);
+}
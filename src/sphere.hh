@@ -23,6 +23,7 @@
 #define SPHERE_HH
 
 #include "drawable.hh"
+#include <vector>
 
 class Sphere : public Drawable
 {
@@ -40,4 +41,51 @@ private:
         static struct SphereImpl *impl;
 };
 
+/// center and color of one sphere drawn by a SphereSet
+struct SphereInstance {
+        QVector3D offset;
+        QVector4D color;
+};
+
+/**
+  \brief Draws many spheres with one instanced draw call
+
+  The centers and colors are kept in a per-instance buffer that is only
+  uploaded when the instances change, changing the color of single spheres
+  only updates their entries. The spheres are either drawn as triangle
+  meshes, or as impostors, i.e. quads on which the sphere surface and its
+  depth are evaluated per pixel. Requires GLSL 3.30, i.e. Drawable::get_shader_version()
+  must return at least 330.
+*/
+class SphereSet : public Drawable
+{
+public:
+        enum EMode {
+                sm_mesh,
+                sm_impostor
+        };
+
+        SphereSet();
+        ~SphereSet();
+
+        void set_mode(EMode mode);
+
+        EMode get_mode() const;
+
+        /// replace all spheres, the buffer is uploaded with the next draw
+        void set_instances(const std::vector<SphereInstance>& instances);
+
+        /// change the color of one sphere
+        void set_instance_color(unsigned idx, const QVector4D& color);
+
+        size_t get_instance_count() const;
+
+private:
+        void do_attach_gl() override;
+        void do_draw(const GlobalSceneState& state) override;
+        void do_detach_gl() override;
+
+        struct SphereSetImpl *impl;
+};
+
 #endif // SPHERE_HH
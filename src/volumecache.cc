@@ -0,0 +1,230 @@
+/* -*- mia-c++  -*-
+ *
+ * This file is part of qtlmpick- a tool for landmark picking and
+ * visualization in volume data
+ * Copyright (c) Genoa 2017,  Gert Wollny
+ *
+ * qtlmpick is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with MIA; if not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include "volumecache.hh"
+#include <QCryptographicHash>
+#include <QDateTime>
+#include <QDebug>
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QSaveFile>
+#include <QStandardPaths>
+#include <cstring>
+
+namespace {
+
+const char cache_magic[8] = {'L', 'M', 'P', 'V', 'O', 'L', 'C', 0};
+const quint32 cache_version = 1;
+
+// voxel data starts at a page aligned offset so that it can be uploaded directly from the mapping
+const qint64 voxel_alignment = 4096;
+
+/* The header of a cache file, it is followed by the brick grid and, at the
+ * next aligned offset, the voxel data. The cache is local to the machine,
+ * so the data is stored in native byte order and byte_order is only used to
+ * reject files written on a machine with a different one. */
+struct CacheHeader {
+        char magic[8];
+        quint32 version;
+        quint32 byte_order;
+        quint32 texel_type;
+        quint32 size[3];
+        float voxel_size[3];
+        float min;
+        float max;
+        float intensity_scale;
+        float intensity_shift;
+        quint32 brick_grid_size[3];
+        quint64 brick_offset;
+        quint64 voxel_offset;
+        quint64 voxel_bytes;
+};
+
+const quint32 byte_order_mark = 0x01020304;
+
+qint64 aligned(qint64 offset)
+{
+        return (offset + voxel_alignment - 1) / voxel_alignment * voxel_alignment;
+}
+
+// number of elements of a grid, fails if there are more than limit
+bool get_element_count(const quint32 size[3], quint64 limit, quint64& count)
+{
+        count = 1;
+        for (int i = 0; i < 3; ++i) {
+                if (size[i] && count > limit / size[i])
+                        return false;
+                count *= size[i];
+        }
+        return count <= limit;
+}
+
+// whether [offset, offset + bytes) lies within [0, end), written so that
+// the values read from a file can not overflow
+bool is_within(quint64 offset, quint64 bytes, quint64 end)
+{
+        return offset <= end && bytes <= end - offset;
+}
+
+}
+
+VolumeCache::VolumeCache(const QString& directory):
+        m_directory(directory)
+{
+        if (m_directory.isEmpty())
+                m_directory = QStandardPaths::writableLocation(QStandardPaths::CacheLocation) + "/volumes";
+}
+
+QString VolumeCache::get_cache_filename(const QString& source) const
+{
+        QFileInfo info(source);
+        QCryptographicHash hash(QCryptographicHash::Sha1);
+        hash.addData(info.absoluteFilePath().toUtf8());
+        hash.addData(QByteArray::number(info.size()));
+        hash.addData(QByteArray::number(info.lastModified().toMSecsSinceEpoch()));
+        return m_directory + "/" + QString::fromLatin1(hash.result().toHex()) + ".lmvc";
+}
+
+PVolumeData VolumeCache::load(const QString& source) const
+{
+        auto filename = get_cache_filename(source);
+        auto file = std::make_shared<QFile>(filename);
+        if (!file->open(QIODevice::ReadOnly))
+                return PVolumeData();
+
+        const qint64 file_size = file->size();
+        if (file_size < static_cast<qint64>(sizeof(CacheHeader)))
+                return PVolumeData();
+
+        // the mapping stays valid as long as the file object exists
+        const uchar *mapped = file->map(0, file_size);
+        if (!mapped) {
+                qWarning() << "VolumeCache: unable to map" << filename << ":" << file->errorString();
+                return PVolumeData();
+        }
+
+        CacheHeader header;
+        memcpy(&header, mapped, sizeof(header));
+        if (memcmp(header.magic, cache_magic, sizeof(cache_magic)) ||
+            header.version != cache_version ||
+            header.byte_order != byte_order_mark ||
+            header.texel_type > VolumeData::tt_float) {
+                qWarning() << "VolumeCache: ignore incompatible cache file" << filename;
+                return PVolumeData();
+        }
+
+        VolumeData::HostData host;
+        host.size = mia::C3DBounds(header.size[0], header.size[1], header.size[2]);
+        host.voxel_size = mia::C3DFVector(header.voxel_size[0], header.voxel_size[1], header.voxel_size[2]);
+        host.min = header.min;
+        host.max = header.max;
+        host.intensity_scale = header.intensity_scale;
+        host.intensity_shift = header.intensity_shift;
+        host.texel_type = static_cast<VolumeData::ETexelType>(header.texel_type);
+        host.brick_grid_size = mia::C3DBounds(header.brick_grid_size[0], header.brick_grid_size[1],
+                                              header.brick_grid_size[2]);
+
+        // each voxel and brick needs at least one byte of the file, this
+        // also keeps the sizes evaluated below from overflowing
+        const quint64 end = file_size;
+        quint64 n_voxels = 0;
+        quint64 n_bricks = 0;
+        if (!get_element_count(header.size, end, n_voxels) ||
+            !get_element_count(header.brick_grid_size, end / sizeof(QVector2D), n_bricks)) {
+                qWarning() << "VolumeCache: ignore corrupt cache file" << filename;
+                return PVolumeData();
+        }
+
+        const quint64 brick_bytes = n_bricks * sizeof(QVector2D);
+        if (header.voxel_bytes != host.get_voxel_bytes() ||
+            header.voxel_offset % voxel_alignment ||
+            !is_within(header.brick_offset, brick_bytes, header.voxel_offset) ||
+            !is_within(header.voxel_offset, header.voxel_bytes, end)) {
+                qWarning() << "VolumeCache: ignore corrupt cache file" << filename;
+                return PVolumeData();
+        }
+
+        host.brick_minmax.resize(n_bricks);
+        if (n_bricks)
+                memcpy(&host.brick_minmax[0], mapped + header.brick_offset, brick_bytes);
+
+        // the voxels are used from the mapping, the pointer keeps the file open
+        host.voxels = std::shared_ptr<const void>(file, mapped + header.voxel_offset);
+
+        qDebug() << "VolumeCache: mapped" << source << "from" << filename;
+        return std::make_shared<VolumeData>(host);
+}
+
+bool VolumeCache::store(const QString& source, const VolumeData& volume) const
+{
+        if (!QDir().mkpath(m_directory)) {
+                qWarning() << "VolumeCache: unable to create" << m_directory;
+                return false;
+        }
+
+        const auto& host = volume.get_host_data();
+        auto filename = get_cache_filename(source);
+
+        CacheHeader header;
+        memset(&header, 0, sizeof(header));
+        memcpy(header.magic, cache_magic, sizeof(cache_magic));
+        header.version = cache_version;
+        header.byte_order = byte_order_mark;
+        header.texel_type = host.texel_type;
+        header.size[0] = host.size.x;
+        header.size[1] = host.size.y;
+        header.size[2] = host.size.z;
+        header.voxel_size[0] = host.voxel_size.x;
+        header.voxel_size[1] = host.voxel_size.y;
+        header.voxel_size[2] = host.voxel_size.z;
+        header.min = host.min;
+        header.max = host.max;
+        header.intensity_scale = host.intensity_scale;
+        header.intensity_shift = host.intensity_shift;
+        header.brick_grid_size[0] = host.brick_grid_size.x;
+        header.brick_grid_size[1] = host.brick_grid_size.y;
+        header.brick_grid_size[2] = host.brick_grid_size.z;
+
+        const qint64 brick_bytes = host.brick_minmax.size() * sizeof(QVector2D);
+        header.brick_offset = sizeof(header);
+        header.voxel_offset = aligned(header.brick_offset + brick_bytes);
+        header.voxel_bytes = host.get_voxel_bytes();
+
+        // write to a temporary file first, so that an interrupted write never leaves a broken entry
+        QSaveFile file(filename);
+        if (!file.open(QIODevice::WriteOnly)) {
+                qWarning() << "VolumeCache: unable to open" << filename << ":" << file.errorString();
+                return false;
+        }
+
+        QByteArray padding(header.voxel_offset - header.brick_offset - brick_bytes, 0);
+        file.write(reinterpret_cast<const char *>(&header), sizeof(header));
+        file.write(reinterpret_cast<const char *>(&host.brick_minmax[0]), brick_bytes);
+        file.write(padding);
+        file.write(static_cast<const char *>(host.voxels.get()), header.voxel_bytes);
+
+        if (!file.commit()) {
+                qWarning() << "VolumeCache: unable to write" << filename << ":" << file.errorString();
+                return false;
+        }
+        return true;
+}
@@ -0,0 +1,59 @@
+/* -*- mia-c++  -*-
+ *
+ * This file is part of qtlmpick- a tool for landmark picking and
+ * visualization in volume data
+ * Copyright (c) Genoa 2017,  Gert Wollny
+ *
+ * qtlmpick is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with MIA; if not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef VOLUMECACHE_HH
+#define VOLUMECACHE_HH
+
+#include "volumedata.hh"
+#include <QString>
+
+/**
+  \brief On-disk cache of preprocessed volume data
+
+  The cache stores the normalized voxel data together with the intensity
+  range, the scaling, the voxel size, and the brick grid of a volume so that
+  re-opening the same file only requires mapping the cache file into memory.
+  Entries are keyed by the absolute path, the size, and the modification time
+  of the source file, hence a changed source file will not hit a stale entry.
+*/
+class VolumeCache
+{
+public:
+        /**
+          Create the cache in the given directory, if the directory is empty
+          the "volumes" sub-directory of the user's cache location is used.
+        */
+        VolumeCache(const QString& directory = QString());
+
+        /// \returns the volume created from the cache entry of source, or an empty pointer
+        PVolumeData load(const QString& source) const;
+
+        /// Store the preprocessed data of the volume read from source, failures are only reported
+        bool store(const QString& source, const VolumeData& volume) const;
+
+        /// \returns the name of the cache file for the given source file
+        QString get_cache_filename(const QString& source) const;
+
+private:
+        QString m_directory;
+};
+
+#endif // VOLUMECACHE_HH
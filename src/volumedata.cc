@@ -20,37 +20,91 @@
  */
 
 #include "volumedata.hh"
+#include "rendertargetpool.hh"
+#include "qruntimeexeption.hh"
+#include "parallel.hh"
+#include "intensitynormalization.hh"
+#include "volumepager.hh"
+#include "gpuprofiler.hh"
 #include <mia/core/filter.hh>
 #include <mia/3d/imageio.hh>
 #include <QOpenGLFramebufferObject>
 #include <QOpenGLExtraFunctions>
-#include <QOpenGLFramebufferObjectFormat>
 #include <QOpenGLTexture>
+#include <QOpenGLPixelTransferOptions>
 #include <QOpenGLShaderProgram>
 #include <QMatrix3x3>
 #include <QPainter>
+#include <atomic>
 #include <cassert>
+#include <cmath>
+#include <limits>
 
-using mia::C3DFImage;
 using mia::accumulate;
 
-using std::unique_ptr;
 using std::transform;
 using std::vector;
 using std::make_pair;
 
+/**
+   Everything the result of the ray casting depends on besides the volume
+   itself, the result is only cast again if the key changes.
+*/
+struct RenderKey {
+        QMatrix4x4 modelview;
+        QMatrix4x4 projection;
+        QVector3D light_source;
+        QSize size;
+        float iso_value;
+        int lod;
+        float resolution_scale;
+        float step_scale;
+        int hit_refinement;
+        bool single_pass;
+        bool use_gradients;
+
+        bool operator == (const RenderKey& other) const {
+                return modelview == other.modelview && projection == other.projection &&
+                        light_source == other.light_source && size == other.size &&
+                        iso_value == other.iso_value && lod == other.lod &&
+                        resolution_scale == other.resolution_scale &&
+                        step_scale == other.step_scale && hit_refinement == other.hit_refinement &&
+                        single_pass == other.single_pass && use_gradients == other.use_gradients;
+        }
+};
+
 struct VolumeDataImpl {
 
-        VolumeDataImpl(mia::P3DImage data);
+        VolumeDataImpl(const VolumeData::HostData& host);
         ~VolumeDataImpl();
 
-        void detach_gl();
-        void do_draw(const GlobalSceneState& state, QOpenGLContext& context);
+        void detach_gl(QOpenGLContext& context);
+        void do_draw(const GlobalSceneState& state, QOpenGLContext& context, GpuProfiler *profiler);
+        void cast_rays(const GlobalSceneState& state, QOpenGLContext& context, const RenderKey& key,
+                       RenderTargetPool& targets, GLint target_fbo, GpuProfiler *profiler);
         void do_attach_gl(QOpenGLContext& context);
-
-        unique_ptr<C3DFImage> m_image;
-
-        float m_iso_value;
+        void resize_viewport(const QSize& size);
+        QSize get_target_size(const QSize& viewport) const;
+        bool use_single_pass() const;
+        void create_volume_texture(QOpenGLContext& context);
+        void create_gradient_texture();
+        void request_pick(const QPoint& location, QOpenGLContext& context, GpuProfiler *profiler);
+        std::pair<bool, QVector3D> resolve_pick(QOpenGLContext& context);
+
+        // the voxel data as uploaded to the texture, either the original
+        // 8 or 16 bit image, or the image converted to float in [0,1]
+        VolumeData::HostData m_host;
+        QOpenGLTexture::TextureFormat m_tex_format;
+        QOpenGLTexture::PixelType m_tex_pixel_type;
+
+        // maps the normalized iso value to the texture value range
+        float m_tex_iso_scale;
+        float m_tex_iso_shift;
+
+        // set from the GUI thread while the render thread draws
+        std::atomic<float> m_iso_value;
+        int m_lod;
+        int m_lod_levels;
         float m_min;
         float m_max;
         float m_intenisity_scale;
@@ -62,6 +116,9 @@ struct VolumeDataImpl {
         QOpenGLShaderProgram m_prep_program;
         QOpenGLShaderProgram m_volume_program;
         QOpenGLShaderProgram m_blit_program;
+        QOpenGLShaderProgram m_raycast_program;
+        QOpenGLShaderProgram m_paged_program;
+        VolumeData::ERaycastMode m_raycast_mode;
 
         QOpenGLTexture m_volume_tex;
 
@@ -77,54 +134,296 @@ struct VolumeDataImpl {
         GLint m_ray_start_param;
         GLint m_ray_end_param;
         QVector3D m_gradient_delta;
-        GLint m_iso_value_param;
         GLint m_volume_blit_texture_param;
 
         int m_width;
         int m_height;
-        vector<QVector4D> m_tex_coordinates;
         QVector3D m_physical_size;
+
+        // asynchronous read back of the picked texture coordinates
+        QOpenGLBuffer m_pick_buffer;
+        GLsync m_pick_fence;
+        QPoint m_pick_location;
+        QPoint m_pick_center;
+        QRect m_pick_rect;
+
+        // quality of the ray casting, reduced for quick previews
+        float m_resolution_scale;
+        float m_step_scale;
+        int m_hit_refinement;
+
+        // the targets for full and for reduced resolution are kept separately
+        // to avoid re-allocations when switching between them
+        RenderTargetPool m_targets;
+        RenderTargetPool m_reduced_targets;
+        RenderTargetPool *m_drawn_targets;
+        float m_drawn_scale;
+
+        // the ray casting result of the last frame is reused if the key is unchanged
+        RenderKey m_cache_key;
+        bool m_cache_valid;
+        unsigned m_cache_hits;
+        unsigned m_cache_misses;
+        bool m_is_gl_attached;
+
+        // min/max intensities of the bricks used for empty space skipping
+        QOpenGLTexture m_brick_tex;
+
+        // precomputed normals
+        QOpenGLTexture m_gradient_tex;
+        std::atomic<bool> m_use_gradients;
+
+        // streaming of volumes that don't fit into one texture
+        VolumePager m_pager;
+        bool m_paged;
+        bool m_paging_complete;
+        size_t m_texture_budget;
+};
+
+// edge length of the bricks used for empty space skipping in voxels
+static const unsigned brick_edge = 8;
+
+// default texture memory budget for the volume, larger volumes are paged
+static const size_t default_texture_budget = size_t(1) << 30;
+
+// number of pages streamed into the atlas per frame
+static const unsigned max_page_uploads = 32;
+
+// maximum number of resolution levels of the volume texture, and the minimal
+// size of the smallest dimension of the coarsest level
+static const int max_lod_levels = 4;
+static const unsigned min_lod_size = 16;
+
+/* Forwards the progress of one preprocessing step to the overall progress
+ * callback. The step covers the range [start, end] of the overall progress.
+ * If the callback asks for cancelling an exception is thrown. */
+class ProgressStep {
+public:
+        ProgressStep(const VolumeData::ProgressCallback& progress, float start, float end):
+                m_progress(progress),
+                m_start(start),
+                m_range(end - start)
+        {
+        }
+
+        void operator()(float fraction) const {
+                if (m_progress && !m_progress(m_start + fraction * m_range))
+                        throw QRuntimeExeption(QObject::tr("Loading of volume data cancelled"));
+        }
+private:
+        const VolumeData::ProgressCallback& m_progress;
+        float m_start;
+        float m_range;
+};
+
+/* scale from the voxel values to the values the shaders see when reading the
+ * texture, integer textures are read as normalized values */
+template <typename T>
+struct texture_value {
+        static float scale() {
+                return 1.0f;
+        }
+};
+
+template <>
+struct texture_value<unsigned char> {
+        static float scale() {
+                return 1.0f / std::numeric_limits<unsigned char>::max();
+        }
 };
 
-/* convert the input image to a float valued picture that
- * optimally uses the intensity range [0,1]; */
-struct GetFloat01Picture: public mia::TFilter<mia::C3DFImage *> {
+template <>
+struct texture_value<unsigned short> {
+        static float scale() {
+                return 1.0f / std::numeric_limits<unsigned short>::max();
+        }
+};
 
-        GetFloat01Picture(float& minv, float& maxv, float& scale, float& shift):
-                m_min_val(minv),
-                m_max_val(maxv),
-                m_scale(scale),
-                m_shift(shift)
+/* Evaluate the intensity range of each brick of the image in texture values.
+ * The range also covers the voxels adjacent to the brick, because with linear
+ * interpolation these contribute to samples taken inside the brick.
+ * Hence, a ray segment inside a brick whose maximum is below the iso value
+ * can not cross the iso-surface. */
+struct CreateBrickGrid: public mia::TFilter<vector<QVector2D>> {
+
+        CreateBrickGrid(mia::C3DBounds& grid_size, const ProgressStep& progress):
+                m_grid_size(grid_size),
+                m_progress(progress)
         {
         }
 
         template <typename T>
-        mia::C3DFImage *operator() (const mia::T3DImage<T>& input) {
-                //should test that there are more than one
-                auto mm = std::minmax_element(input.begin(), input.end());
-                m_min_val =  *mm.first;
-                m_max_val =  *mm.second;
-                if (*mm.second != *mm.first) {
-                        m_scale = 1.0f /(*mm.second - *mm.first);
-                }else{
-                        m_scale = 1.0f;
-                }
-                m_shift = *mm.first;
-
-                C3DFImage *result = new C3DFImage(input.get_size(), input);
-                std::transform(input.begin(), input.end(), result->begin(),
-                               [this](T x){return (x - m_shift) * m_scale;});
+        vector<QVector2D> operator() (const mia::T3DImage<T>& image) {
+                auto size = image.get_size();
+                m_grid_size = mia::C3DBounds((size.x + brick_edge - 1) / brick_edge,
+                                             (size.y + brick_edge - 1) / brick_edge,
+                                             (size.z + brick_edge - 1) / brick_edge);
+                const float tex_scale = texture_value<T>::scale();
+
+                vector<QVector2D> result(m_grid_size.product());
+
+                // each slab of bricks writes its own part of the result
+                auto slab = [&](unsigned bz) {
+                        auto r = result.begin() + bz * m_grid_size.x * m_grid_size.y;
+                        unsigned z0 = bz * brick_edge > 0 ? bz * brick_edge - 1 : 0;
+                        unsigned z1 = std::min((bz + 1) * brick_edge + 1, size.z);
+                        for (unsigned by = 0; by < m_grid_size.y; ++by) {
+                                unsigned y0 = by * brick_edge > 0 ? by * brick_edge - 1 : 0;
+                                unsigned y1 = std::min((by + 1) * brick_edge + 1, size.y);
+                                for (unsigned bx = 0; bx < m_grid_size.x; ++bx, ++r) {
+                                        unsigned x0 = bx * brick_edge > 0 ? bx * brick_edge - 1 : 0;
+                                        unsigned x1 = std::min((bx + 1) * brick_edge + 1, size.x);
+
+                                        T bmin = std::numeric_limits<T>::max();
+                                        T bmax = std::numeric_limits<T>::lowest();
+                                        for (unsigned z = z0; z < z1; ++z)
+                                                for (unsigned y = y0; y < y1; ++y) {
+                                                        auto v = image.begin_at(x0, y, z);
+                                                        for (unsigned x = x0; x < x1; ++x, ++v) {
+                                                                if (*v < bmin) bmin = *v;
+                                                                if (*v > bmax) bmax = *v;
+                                                        }
+                                                }
+                                        *r = QVector2D(bmin * tex_scale, bmax * tex_scale);
+                                }
+                        }
+                };
+                parallel_blocks(m_grid_size.z, slab, m_progress);
                 return result;
         }
 private:
-        float& m_min_val;
-        float& m_max_val;
-        float& m_scale;
-        float& m_shift;
+        mia::C3DBounds& m_grid_size;
+        const ProgressStep& m_progress;
+};
+
+/* get the start of the voxel buffer for the texture upload */
+struct GetVoxelPointer: public mia::TFilter<const void *> {
+        template <typename T>
+        const void *operator() (const mia::T3DImage<T>& input) {
+                return &input[0];
+        }
+
+        // binary images are always converted to float
+        const void *operator() (const mia::T3DImage<bool>& /*input*/) {
+                assert(0 && "bit images can not be uploaded directly");
+                return nullptr;
+        }
 };
 
-VolumeDataImpl::VolumeDataImpl(mia::P3DImage data):
+/* Run the preprocessing of the image for rendering: evaluate the intensity
+ * range, convert the voxels to the texture format if needed, and create the
+ * brick grid for empty space skipping. */
+static VolumeData::HostData prepare_host_data(mia::P3DImage data, VolumeData::ETexturePolicy policy,
+                                              const VolumeData::ProgressCallback& progress)
+{
+        VolumeData::HostData host;
+        host.size = data->get_size();
+        host.voxel_size = data->get_voxel_size();
+
+        ProgressStep range_progress(progress, 0.0f, 0.3f);
+        auto range = get_intensity_range(*data, range_progress);
+        host.min = range.first;
+        host.max = range.second;
+
+        // scaling of the intensities to [0,1]
+        host.intensity_scale = host.max != host.min ? 1.0f / (host.max - host.min) : 1.0f;
+        host.intensity_shift = host.min;
+
+        auto pixel_type = data->get_pixel_type();
+        bool native = policy == VolumeData::tp_native &&
+                      (pixel_type == mia::it_ubyte || pixel_type == mia::it_ushort);
+
+        mia::P3DImage image;
+        if (native) {
+                // keep the data as is, the iso value is mapped to the
+                // normalized texture values instead
+                host.texel_type = pixel_type == mia::it_ubyte ? VolumeData::tt_ubyte :
+                                                                 VolumeData::tt_ushort;
+                image = data;
+        } else {
+                ProgressStep convert_progress(progress, 0.3f, 0.7f);
+                image = normalize_intensities(*data, host.intensity_scale, host.intensity_shift,
+                                              convert_progress);
+                host.texel_type = VolumeData::tt_float;
+        }
+
+        // the voxel pointer keeps the image alive
+        GetVoxelPointer get_voxels;
+        host.voxels = std::shared_ptr<const void>(image, accumulate(get_voxels, *image));
+
+        // the brick grid doesn't depend on the iso value, so it is created only once
+        ProgressStep brick_progress(progress, 0.7f, 1.0f);
+        CreateBrickGrid brick_grid(host.brick_grid_size, brick_progress);
+        host.brick_minmax = accumulate(brick_grid, *image);
+        brick_progress(1.0f);
+        return host;
+}
+
+/* Pack a normal with components in [-1,1] as RGB10A2 */
+static inline quint32 pack_normal(float nx, float ny, float nz)
+{
+        quint32 r = static_cast<quint32>((0.5f * nx + 0.5f) * 1023.0f + 0.5f);
+        quint32 g = static_cast<quint32>((0.5f * ny + 0.5f) * 1023.0f + 0.5f);
+        quint32 b = static_cast<quint32>((0.5f * nz + 0.5f) * 1023.0f + 0.5f);
+        return r | (g << 10) | (b << 20) | (3u << 30);
+}
+
+/* Evaluate the normals of one slice like the shaders do, i.e. by central
+ * differences in texture coordinates, voxels outside the volume are zero
+ * like the border color of the volume texture. */
+template <typename T>
+static void gradient_slice(const T *voxels, const mia::C3DBounds& size, unsigned z, quint32 *out)
+{
+        const int sx = size.x;
+        const int sy = size.y;
+        const int sz = size.z;
+        auto value = [voxels, sx, sy, sz](int x, int y, int z) -> float {
+                if (x < 0 || y < 0 || z < 0 || x >= sx || y >= sy || z >= sz)
+                        return 0.0f;
+                return voxels[(size_t(z) * sy + y) * sx + x];
+        };
+
+        for (int y = 0; y < sy; ++y) {
+                for (int x = 0; x < sx; ++x, ++out) {
+                        float gx = (value(x - 1, y, z) - value(x + 1, y, z)) * sx;
+                        float gy = (value(x, y - 1, z) - value(x, y + 1, z)) * sy;
+                        float gz = (value(x, y, z - 1) - value(x, y, z + 1)) * sz;
+                        float l = std::sqrt(gx * gx + gy * gy + gz * gz);
+                        if (l > 0) {
+                                gx /= l;
+                                gy /= l;
+                                gz /= l;
+                        }
+                        *out = pack_normal(gx, gy, gz);
+                }
+        }
+}
+
+template <typename T>
+static std::shared_ptr<const void> create_gradients(const VolumeData::HostData& host, const ProgressStep& progress)
+{
+        const auto& size = host.size;
+        const size_t slice_size = size_t(size.x) * size.y;
+        std::shared_ptr<quint32> result(new quint32[slice_size * size.z], std::default_delete<quint32[]>());
+        auto voxels = static_cast<const T *>(host.voxels.get());
+        quint32 *out = result.get();
+        auto slice = [&](unsigned z) {
+                gradient_slice(voxels, size, z, out + z * slice_size);
+        };
+        parallel_blocks(size.z, slice, progress);
+        return result;
+}
+
+VolumeDataImpl::VolumeDataImpl(const VolumeData::HostData& host):
+        m_host(host),
+        m_tex_format(QOpenGLTexture::R32F),
+        m_tex_pixel_type(QOpenGLTexture::Float32),
+        m_tex_iso_scale(1.0f),
+        m_tex_iso_shift(0.0f),
         m_iso_value(0.7),
+        m_lod(0),
+        m_lod_levels(1),
+        m_raycast_mode(VolumeData::rc_single_pass),
         m_arrayBuf(QOpenGLBuffer::VertexBuffer),
         m_indexBuf(QOpenGLBuffer::IndexBuffer),
         m_volume_tex(QOpenGLTexture::Target3D),
@@ -133,11 +432,54 @@ VolumeDataImpl::VolumeDataImpl(mia::P3DImage data):
         m_voltex_param(-1),
         m_ray_start_param(-1),
         m_ray_end_param(-1),
-        m_volume_blit_texture_param(-1)
+        m_volume_blit_texture_param(-1),
+        m_width(0),
+        m_height(0),
+        m_pick_buffer(QOpenGLBuffer::PixelPackBuffer),
+        m_pick_fence(0),
+        m_resolution_scale(1.0f),
+        m_step_scale(1.0f),
+        m_hit_refinement(0),
+        m_drawn_targets(&m_targets),
+        m_drawn_scale(1.0f),
+        m_cache_valid(false),
+        m_cache_hits(0),
+        m_cache_misses(0),
+        m_is_gl_attached(false),
+        m_brick_tex(QOpenGLTexture::Target3D),
+        m_gradient_tex(QOpenGLTexture::Target3D),
+        m_use_gradients(false),
+        m_pager(brick_edge),
+        m_paged(false),
+        m_paging_complete(true),
+        m_texture_budget(default_texture_budget)
 {
-
-        GetFloat01Picture scaler(m_min, m_max, m_intenisity_scale, m_intenisity_shift);
-        m_image.reset(accumulate(scaler,*data));
+        m_min = m_host.min;
+        m_max = m_host.max;
+        m_intenisity_scale = m_host.intensity_scale;
+        m_intenisity_shift = m_host.intensity_shift;
+
+        // map the normalized iso value to the normalized texture values,
+        // float data is already normalized
+        float tex_max = 0.0f;
+        switch (m_host.texel_type) {
+        case VolumeData::tt_ubyte:
+                m_tex_format = QOpenGLTexture::R8_UNorm;
+                m_tex_pixel_type = QOpenGLTexture::UInt8;
+                tex_max = std::numeric_limits<unsigned char>::max();
+                break;
+        case VolumeData::tt_ushort:
+                m_tex_format = QOpenGLTexture::R16_UNorm;
+                m_tex_pixel_type = QOpenGLTexture::UInt16;
+                tex_max = std::numeric_limits<unsigned short>::max();
+                break;
+        case VolumeData::tt_float:
+                break;
+        }
+        if (tex_max > 0) {
+                m_tex_iso_scale = 1.0f / (m_intenisity_scale * tex_max);
+                m_tex_iso_shift = m_intenisity_shift / tex_max;
+        }
 
         // we want at least 255 steps
         if (m_max - m_min < 255){
@@ -145,8 +487,8 @@ VolumeDataImpl::VolumeDataImpl(mia::P3DImage data):
                 m_intenisity_scale = 1.0 / 255;
         }
 
-        auto s = m_image->get_size();
-        auto v = m_image->get_voxel_size();
+        auto s = m_host.size;
+        auto v = m_host.voxel_size;
 
         m_physical_size = QVector3D(s.x * v.x, s.y * v.y, s.z * v.z);
         m_max_coord = m_physical_size.x();
@@ -166,12 +508,76 @@ VolumeDataImpl::~VolumeDataImpl()
 
 }
 
-VolumeData::VolumeData(mia::P3DImage data)
+VolumeData::VolumeData(mia::P3DImage data, ETexturePolicy policy, ProgressCallback progress)
 {
         assert(data);
+        impl = new VolumeDataImpl(prepare_host_data(data, policy, progress));
+}
+
+VolumeData::VolumeData(const HostData& data)
+{
+        assert(data.voxels);
+        assert(data.brick_minmax.size() == data.brick_grid_size.product());
         impl = new VolumeDataImpl(data);
 }
 
+const VolumeData::HostData& VolumeData::get_host_data() const
+{
+        return impl->m_host;
+}
+
+size_t VolumeData::HostData::get_voxel_bytes() const
+{
+        size_t texel_size = texel_type == tt_ubyte ? 1 : (texel_type == tt_ushort ? 2 : 4);
+        return texel_size * size.product();
+}
+
+void VolumeData::create_gradient_volume(ProgressCallback progress)
+{
+        auto& host = impl->m_host;
+        if (host.gradients)
+                return;
+
+        ProgressStep step(progress, 0.0f, 1.0f);
+        switch (host.texel_type) {
+        case tt_ubyte:
+                host.gradients = create_gradients<unsigned char>(host, step);
+                break;
+        case tt_ushort:
+                host.gradients = create_gradients<unsigned short>(host, step);
+                break;
+        case tt_float:
+                host.gradients = create_gradients<float>(host, step);
+                break;
+        }
+}
+
+bool VolumeData::has_gradient_volume() const
+{
+        return impl->m_host.gradients != nullptr;
+}
+
+void VolumeData::set_use_gradient_volume(bool enable)
+{
+        impl->m_use_gradients = enable;
+}
+
+bool VolumeData::get_use_gradient_volume() const
+{
+        return impl->m_use_gradients;
+}
+
+void VolumeData::move_to_thread(QThread *thread)
+{
+        impl->m_prep_program.moveToThread(thread);
+        impl->m_volume_program.moveToThread(thread);
+        impl->m_blit_program.moveToThread(thread);
+        impl->m_raycast_program.moveToThread(thread);
+        impl->m_paged_program.moveToThread(thread);
+        impl->m_vao.moveToThread(thread);
+        impl->m_vao_2nd_pass.moveToThread(thread);
+}
+
 VolumeData::~VolumeData()
 {
         delete impl;
@@ -192,20 +598,17 @@ QVector3D VolumeData::get_viewspace_shift() const
         return QVector3D(1,1,1) * impl->m_scale;
 }
 
-std::pair<bool, QVector3D> VolumeData::get_surface_coordinate(const QPoint& location) const
+void VolumeData::request_pick(const QPoint& location)
+{
+        impl->request_pick(location, *get_context(), get_gpu_profiler());
+}
+
+std::pair<bool, QVector3D> VolumeData::get_surface_coordinate(const QPoint& location)
 {
         qDebug() << "location:" << location << " in(" << impl->m_width << ":" << impl->m_height <<")";
-        QVector3D result(-1, -1, -1);
-        bool found = false;
-        if (location.x() < impl->m_width && location.y() < impl->m_height) {
-                QVector4D t = impl->m_tex_coordinates[impl->m_width * (impl->m_height - location.y() - 1) + location.x()];
-                qDebug() << "Tex=" << t;
-                if (t.w() > 0) {
-                        result =  QVector3D(t.x(), t.y(), t.z()) * impl->m_physical_size;
-                        found = true;
-                }
-        }
-        return make_pair(found, result);
+        if (!impl->m_pick_fence || impl->m_pick_location != location)
+                impl->request_pick(location, *get_context(), get_gpu_profiler());
+        return impl->resolve_pick(*get_context());
 }
 
 QVector3D VolumeData::get_viewspace_scale() const
@@ -220,14 +623,91 @@ std::pair<int, int> VolumeData::get_intensity_range() const
         return make_pair(range_min, range_max);
 }
 
+void VolumeData::resize_viewport(const QSize& size)
+{
+        impl->resize_viewport(size);
+}
+
+void VolumeData::set_lod(int level)
+{
+        impl->m_lod = std::max(0, std::min(level, impl->m_lod_levels - 1));
+}
+
+int VolumeData::get_lod() const
+{
+        return impl->m_lod;
+}
+
+int VolumeData::get_lod_levels() const
+{
+        return impl->m_lod_levels;
+}
+
+void VolumeData::set_resolution_scale(float scale)
+{
+        impl->m_resolution_scale = std::max(0.05f, std::min(scale, 1.0f));
+}
+
+float VolumeData::get_resolution_scale() const
+{
+        return impl->m_resolution_scale;
+}
+
+void VolumeData::set_sampling(float step_scale, int hit_refinement)
+{
+        impl->m_step_scale = std::max(0.05f, step_scale);
+        impl->m_hit_refinement = std::max(0, hit_refinement);
+}
+
+void VolumeData::set_texture_memory_budget(size_t bytes)
+{
+        impl->m_texture_budget = bytes;
+}
+
+bool VolumeData::is_paged() const
+{
+        return impl->m_paged;
+}
+
+bool VolumeData::is_complete() const
+{
+        return impl->m_paging_complete;
+}
+
+unsigned VolumeData::get_render_cache_hits() const
+{
+        return impl->m_cache_hits;
+}
+
+unsigned VolumeData::get_render_cache_misses() const
+{
+        return impl->m_cache_misses;
+}
+
+unsigned VolumeData::get_render_target_allocations() const
+{
+        return impl->m_targets.get_allocation_count() +
+                impl->m_reduced_targets.get_allocation_count();
+}
+
+void VolumeData::set_raycast_mode(ERaycastMode mode)
+{
+        impl->m_raycast_mode = mode;
+}
+
+VolumeData::ERaycastMode VolumeData::get_raycast_mode() const
+{
+        return impl->use_single_pass() ? rc_single_pass : rc_two_pass;
+}
+
 void VolumeData::do_detach_gl()
 {
-        impl->detach_gl();
+        impl->detach_gl(*get_context());
 }
 
 void VolumeData::do_draw(const GlobalSceneState& state)
 {
-        impl->do_draw(state, *get_context());
+        impl->do_draw(state, *get_context(), get_gpu_profiler());
 }
 void VolumeData::do_attach_gl()
 {
@@ -277,31 +757,92 @@ static const unsigned short screenspace_fan_idx[] {
         if (error_nr)  qWarning() << "VolumeData:" << text <<":"<< error_nr; \
 }
 
-void VolumeDataImpl::do_attach_gl(QOpenGLContext& context)
+void VolumeDataImpl::create_volume_texture(QOpenGLContext& context)
 {
-        OGL_ERRORTEST("VolumeData::do_attach_gl: Incoming error:");
-
-        auto ogl = context.functions();
-        m_vao.create();
-
-        // obtain properly intensity scaled picture
-        const C3DFImage& img = *m_image;
+        // the down-sampled levels used while interacting are read by textureLod
+        // that is only available with the GLSL 1.40 shader set
+        m_lod_levels = 1;
+        if (Drawable::get_shader_version() >= 330) {
+                unsigned min_size = std::min(std::min(m_host.size.x, m_host.size.y), m_host.size.z);
+                while (m_lod_levels < max_lod_levels && (min_size >> m_lod_levels) >= min_lod_size)
+                        ++m_lod_levels;
+        }
+        m_lod = std::min(m_lod, m_lod_levels - 1);
+        GLenum min_filter = m_lod_levels > 1 ? GL_LINEAR_MIPMAP_NEAREST : GL_NEAREST;
 
         // create the texture
+        auto ogl = context.functions();
         ogl->glActiveTexture(GL_TEXTURE0);
-        m_volume_tex.setFormat(QOpenGLTexture::R32F);
-        m_volume_tex.setMinMagFilters(QOpenGLTexture::Nearest, QOpenGLTexture::Linear);
+        m_volume_tex.setFormat(m_tex_format);
+        m_volume_tex.setMinMagFilters(m_lod_levels > 1 ? QOpenGLTexture::LinearMipMapNearest :
+                                                         QOpenGLTexture::Nearest, QOpenGLTexture::Linear);
         m_volume_tex.setWrapMode(QOpenGLTexture::ClampToBorder);
-        m_volume_tex.setSize(m_image->get_size().x, m_image->get_size().y, m_image->get_size().z);
+        m_volume_tex.setSize(m_host.size.x, m_host.size.y, m_host.size.z);
+        m_volume_tex.setMipLevels(m_lod_levels);
         m_volume_tex.allocateStorage();
         OGL_ERRORTEST("m_volume_tex.allocateStorage()");
         m_volume_tex.setBorderColor(0,0,0,0);
-        m_volume_tex.setData(0, 0, QOpenGLTexture::Red, QOpenGLTexture::Float32, &img[0]);
+        // rows of 8 and 16 bit volumes are not necessarily 4 byte aligned
+        QOpenGLPixelTransferOptions transfer_options;
+        transfer_options.setAlignment(1);
+        m_volume_tex.setData(0, 0, QOpenGLTexture::Red, m_tex_pixel_type, m_host.voxels.get(), &transfer_options);
         OGL_ERRORTEST("m_volume_tex.setData");
 
+        // build the 2x down-sampled pyramid from the uploaded data
+        if (m_lod_levels > 1) {
+                m_volume_tex.generateMipMaps();
+                OGL_ERRORTEST("m_volume_tex.generateMipMaps");
+        }
+
         // set the interpolation mode
-        ogl->glTexParameterf (GL_TEXTURE_3D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+        ogl->glTexParameterf (GL_TEXTURE_3D, GL_TEXTURE_MIN_FILTER, min_filter);
         ogl->glTexParameterf (GL_TEXTURE_3D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+}
+
+void VolumeDataImpl::create_gradient_texture()
+{
+        m_gradient_tex.setFormat(QOpenGLTexture::RGB10A2);
+        m_gradient_tex.setMinMagFilters(QOpenGLTexture::Linear, QOpenGLTexture::Linear);
+        m_gradient_tex.setWrapMode(QOpenGLTexture::ClampToEdge);
+        m_gradient_tex.setSize(m_host.size.x, m_host.size.y, m_host.size.z);
+        m_gradient_tex.allocateStorage();
+        m_gradient_tex.setData(QOpenGLTexture::RGBA, QOpenGLTexture::UInt32_RGB10A2_Rev,
+                               m_host.gradients.get());
+        OGL_ERRORTEST("m_gradient_tex.setData");
+}
+
+void VolumeDataImpl::do_attach_gl(QOpenGLContext& context)
+{
+        OGL_ERRORTEST("VolumeData::do_attach_gl: Incoming error:");
+
+        auto ogl = context.functions();
+        m_targets.attach_gl(&context);
+        m_reduced_targets.attach_gl(&context);
+        m_cache_valid = false;
+        m_is_gl_attached = true;
+        m_vao.create();
+
+        // volumes that don't fit into one texture are streamed in pages, this
+        // is only supported by the GLSL 1.40 single pass ray caster
+        m_paged = Drawable::get_shader_version() >= 330 &&
+                  VolumePager::needs_paging(m_host, m_texture_budget);
+        m_paging_complete = !m_paged;
+        if (m_paged) {
+                m_lod_levels = 1;
+                m_lod = 0;
+                m_pager.attach_gl(&context, m_host, m_texture_budget);
+                OGL_ERRORTEST("m_pager.attach_gl");
+        } else
+                create_volume_texture(context);
+
+        // the brick intensity ranges for empty space skipping
+        m_brick_tex.setFormat(QOpenGLTexture::RG32F);
+        m_brick_tex.setMinMagFilters(QOpenGLTexture::Nearest, QOpenGLTexture::Nearest);
+        m_brick_tex.setWrapMode(QOpenGLTexture::ClampToEdge);
+        m_brick_tex.setSize(m_host.brick_grid_size.x, m_host.brick_grid_size.y, m_host.brick_grid_size.z);
+        m_brick_tex.allocateStorage();
+        m_brick_tex.setData(0, 0, QOpenGLTexture::RG, QOpenGLTexture::Float32, &m_host.brick_minmax[0]);
+        OGL_ERRORTEST("m_brick_tex.setData");
 
         m_arrayBuf.create();
         m_indexBuf.create();
@@ -331,6 +872,14 @@ void VolumeDataImpl::do_attach_gl(QOpenGLContext& context)
         Drawable::compile_and_link(m_volume_program, "volume_2nd_pass_vtx.glsl", "volume_2nd_pass_frag.glsl");
         Drawable::compile_and_link(m_blit_program, "volume_2nd_pass_vtx.glsl", "volume_blit_frag.glsl");
 
+        // the single pass ray caster needs GLSL 1.40 features, with the old
+        // shader set only the two pass renderer is available
+        if (m_paged)
+                Drawable::compile_and_link(m_paged_program, "volume_2nd_pass_vtx.glsl",
+                                           "volume_raycast_paged_frag.glsl");
+        if (Drawable::get_shader_version() >= 330)
+                Drawable::compile_and_link(m_raycast_program, "volume_2nd_pass_vtx.glsl", "volume_raycast_frag.glsl");
+
         m_voltex_param = m_volume_program.uniformLocation("volume");
         if (m_voltex_param == -1)
                 qWarning() << "Can't find volume parameter";
@@ -383,8 +932,6 @@ void VolumeDataImpl::do_attach_gl(QOpenGLContext& context)
 
         m_volume_blit_texture_param = m_blit_program.uniformLocation("image");
 
-        m_iso_value_param = m_volume_program.uniformLocation("iso_value");
-
         auto vertex_location = m_volume_program.attributeLocation("qt_Vertex");
         if (vertex_location >= 0) {
                 m_volume_program.enableAttributeArray(vertex_location);
@@ -392,107 +939,285 @@ void VolumeDataImpl::do_attach_gl(QOpenGLContext& context)
         } else {
                 qWarning() << "qt_Vertex not found, rendering will fail";
         }
+
+        for (auto p: {&m_raycast_program, &m_paged_program}) {
+                if (!p->isLinked())
+                        continue;
+                auto raycast_vertex_location = p->attributeLocation("qt_Vertex");
+                if (raycast_vertex_location >= 0) {
+                        p->enableAttributeArray(raycast_vertex_location);
+                        p->setAttributeBuffer(raycast_vertex_location, GL_FLOAT, 0, 2);
+                }
+        }
         m_vao_2nd_pass.release();
 }
 
-void VolumeDataImpl::detach_gl()
+void VolumeDataImpl::resize_viewport(const QSize& size)
 {
-        m_volume_tex.destroy();
-        m_arrayBuf.destroy();
-        m_indexBuf.destroy();
-        m_prep_program.release();
+        // without a context the targets will be created with the first draw
+        if (!m_is_gl_attached || !size.isValid() || size.isEmpty())
+                return;
+
+        // allocate the same targets the next draw asks for
+        bool ray_targets = !use_single_pass();
+        m_targets.resize(size, ray_targets);
+        if (m_resolution_scale < 1.0f)
+                m_reduced_targets.resize(get_target_size(size), ray_targets);
 }
 
-
-// todo: Consider pre-allocating the FBOs in the attach_gl() function
-void VolumeDataImpl::do_draw(const GlobalSceneState& state, QOpenGLContext& context)
+QSize VolumeDataImpl::get_target_size(const QSize& viewport) const
 {
-        auto modelview = state.get_modelview_matrix();
-        auto& ogl = *context.functions();
+        if (m_resolution_scale >= 1.0f)
+                return viewport;
+        return QSize(std::max(1, static_cast<int>(viewport.width() * m_resolution_scale)),
+                     std::max(1, static_cast<int>(viewport.height() * m_resolution_scale)));
+}
 
-        m_width = state.viewport.width();
-        m_height = state.viewport.height();
+// half size of the read back window around the picked location, the
+// nearest hit within this window is used to be forgiving at the surface border
+static const int pick_radius = 2;
 
-        m_tex_coordinates.resize(m_width * m_height);
+void VolumeDataImpl::request_pick(const QPoint& location, QOpenGLContext& context, GpuProfiler *profiler)
+{
+        auto& ogl = *context.functions();
+        auto glex = context.extraFunctions();
 
-        // first pass: draw cube to fbo's to obtain ray texture start and end
+        if (m_pick_fence) {
+                glex->glDeleteSync(m_pick_fence);
+                m_pick_fence = 0;
+        }
+        m_pick_location = location;
+
+        // the last frame may have been cast at a reduced resolution
+        m_pick_center = QPoint(static_cast<int>(location.x() * m_drawn_scale),
+                               m_height - static_cast<int>(location.y() * m_drawn_scale) - 1);
+
+        if (m_width <= 0 || m_height <= 0)
+                return;
+
+        // window coordinates to OpenGL coordinates
+        QRect window(m_pick_center.x() - pick_radius, m_pick_center.y() - pick_radius,
+                     2 * pick_radius + 1, 2 * pick_radius + 1);
+        m_pick_rect = window.intersected(QRect(0, 0, m_width, m_height));
+        if (m_pick_rect.isEmpty())
+                return;
+
+        if (!m_pick_buffer.isCreated()) {
+                m_pick_buffer.create();
+                m_pick_buffer.bind();
+                m_pick_buffer.setUsagePattern(QOpenGLBuffer::StreamRead);
+                m_pick_buffer.allocate((2 * pick_radius + 1) * (2 * pick_radius + 1) * sizeof(QVector4D));
+        } else
+                m_pick_buffer.bind();
+
+        // with a pixel pack buffer bound glReadPixels returns immediately
+        GpuProfiler::Scope timer(profiler, GpuProfiler::gs_pick);
+        GLint target_fbo = 0;
+        ogl.glGetIntegerv(GL_FRAMEBUFFER_BINDING, &target_fbo);
+        auto& fbo_volume = m_drawn_targets->get_volume();
+        fbo_volume.bind();
+        glex->glReadBuffer(GL_COLOR_ATTACHMENT1);
+        ogl.glReadPixels(m_pick_rect.x(), m_pick_rect.y(), m_pick_rect.width(), m_pick_rect.height(),
+                         GL_RGBA, GL_FLOAT, 0);
+        glex->glReadBuffer(GL_COLOR_ATTACHMENT0);
+        ogl.glBindFramebuffer(GL_FRAMEBUFFER, target_fbo);
+        m_pick_buffer.release();
 
-        ogl.glClearColor(0,0,0,1);
-        ogl.glEnable(GL_DEPTH_TEST);
-        ogl.glEnable(GL_CULL_FACE);
-        ogl.glCullFace(GL_BACK);
+        m_pick_fence = glex->glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+        ogl.glFlush();
+}
 
-        m_vao.bind();
-        m_prep_program.bind();
-        m_arrayBuf.bind();
-        m_indexBuf.bind();
+std::pair<bool, QVector3D> VolumeDataImpl::resolve_pick(QOpenGLContext& context)
+{
+        QVector3D result(-1, -1, -1);
+        bool found = false;
 
-        m_prep_program.setUniformValue("qt_mvp", state.projection * modelview);
-        m_prep_program.setUniformValue("qt_mv", modelview);
+        if (!m_pick_fence)
+                return make_pair(found, result);
 
-        QOpenGLFramebufferObjectFormat fbformat;
-        fbformat.setTextureTarget(GL_TEXTURE_2D);
-        fbformat.setInternalTextureFormat(GL_RGBA32F);
-        QOpenGLFramebufferObject fbo_ray_start(state.viewport, fbformat);
-        QOpenGLFramebufferObject fbo_ray_end(state.viewport, fbformat);
+        auto glex = context.extraFunctions();
 
+        // normally the read back finished while the context menu was shown
+        auto wait = glex->glClientWaitSync(m_pick_fence, GL_SYNC_FLUSH_COMMANDS_BIT, GL_TIMEOUT_IGNORED);
+        glex->glDeleteSync(m_pick_fence);
+        m_pick_fence = 0;
 
-        fbo_ray_start.bind();
-        ogl.glClearColor(0,0,0,0);
-        ogl.glClear(GL_COLOR_BUFFER_BIT);
-        ogl.glDrawElements(GL_TRIANGLES, 36, GL_UNSIGNED_SHORT, 0);
-        fbo_ray_start.release();
+        if (wait == GL_WAIT_FAILED) {
+                qWarning() << "VolumeData: waiting for the pick read back failed";
+                return make_pair(found, result);
+        }
 
-        glCullFace(GL_FRONT);
-        fbo_ray_end.bind();
-        ogl.glClearColor(0,0,0,0);
-        ogl.glClear(GL_COLOR_BUFFER_BIT);
-        ogl.glDrawElements(GL_TRIANGLES, 36, GL_UNSIGNED_SHORT, 0);
-        fbo_ray_end.release();
+        m_pick_buffer.bind();
+        auto pixels = reinterpret_cast<const QVector4D *>(
+                              m_pick_buffer.mapRange(0, m_pick_rect.width() * m_pick_rect.height() * sizeof(QVector4D),
+                                                     QOpenGLBuffer::RangeRead));
+        if (pixels) {
+                const QPoint& center = m_pick_center;
+                int best_distance = std::numeric_limits<int>::max();
+                for (int y = 0; y < m_pick_rect.height(); ++y) {
+                        for (int x = 0; x < m_pick_rect.width(); ++x) {
+                                const QVector4D& t = pixels[y * m_pick_rect.width() + x];
+                                if (t.w() <= 0)
+                                        continue;
+                                QPoint delta = m_pick_rect.topLeft() + QPoint(x, y) - center;
+                                int distance = delta.x() * delta.x() + delta.y() * delta.y();
+                                if (distance < best_distance) {
+                                        best_distance = distance;
+                                        result = t.toVector3D() * m_physical_size;
+                                        found = true;
+                                }
+                        }
+                }
+                m_pick_buffer.unmap();
+        } else {
+                qWarning() << "VolumeData: unable to map the pick buffer";
+        }
+        m_pick_buffer.release();
+        return make_pair(found, result);
+}
 
-        m_arrayBuf.release();
-        m_indexBuf.release();
-        m_vao.release();
+void VolumeDataImpl::detach_gl(QOpenGLContext& context)
+{
+        m_is_gl_attached = false;
+        if (m_pick_fence) {
+                context.extraFunctions()->glDeleteSync(m_pick_fence);
+                m_pick_fence = 0;
+        }
+        m_pick_buffer.destroy();
+        m_targets.detach_gl();
+        m_reduced_targets.detach_gl();
+        m_cache_valid = false;
+        m_volume_tex.destroy();
+        if (m_paged)
+                m_pager.detach_gl();
+        m_brick_tex.destroy();
+        m_gradient_tex.destroy();
+        m_arrayBuf.destroy();
+        m_indexBuf.destroy();
         m_prep_program.release();
+}
+
+void VolumeDataImpl::cast_rays(const GlobalSceneState& state, QOpenGLContext& context, const RenderKey& key,
+                               RenderTargetPool& targets, GLint target_fbo, GpuProfiler *profiler)
+{
+        const QMatrix4x4& modelview = key.modelview;
+        auto mvp = state.projection * modelview;
+        auto& ogl = *context.functions();
+        const bool single_pass = key.single_pass;
+        const bool use_gradients = key.use_gradients;
+        const float tex_iso_value = key.iso_value;
+
+        if (!single_pass) {
+                // first pass: draw cube to fbo's to obtain ray texture start and end
+                GpuProfiler::Scope timer(profiler, GpuProfiler::gs_ray_setup);
+                auto& fbo_ray_start = targets.get_ray_start();
+                auto& fbo_ray_end = targets.get_ray_end();
+
+                ogl.glClearColor(0,0,0,1);
+                ogl.glEnable(GL_DEPTH_TEST);
+                ogl.glEnable(GL_CULL_FACE);
+                ogl.glCullFace(GL_BACK);
+
+                m_vao.bind();
+                m_prep_program.bind();
+                m_arrayBuf.bind();
+                m_indexBuf.bind();
+
+                m_prep_program.setUniformValue("qt_mvp", mvp);
+                m_prep_program.setUniformValue("qt_mv", modelview);
+
+                fbo_ray_start.bind();
+                ogl.glClearColor(0,0,0,0);
+                ogl.glClear(GL_COLOR_BUFFER_BIT);
+                ogl.glDrawElements(GL_TRIANGLES, 36, GL_UNSIGNED_SHORT, 0);
+                fbo_ray_start.release();
+
+                glCullFace(GL_FRONT);
+                fbo_ray_end.bind();
+                ogl.glClearColor(0,0,0,0);
+                ogl.glClear(GL_COLOR_BUFFER_BIT);
+                ogl.glDrawElements(GL_TRIANGLES, 36, GL_UNSIGNED_SHORT, 0);
+                fbo_ray_end.release();
+
+                m_arrayBuf.release();
+                m_indexBuf.release();
+                m_vao.release();
+                m_prep_program.release();
+        }
 
         // Second pass, render to another separate surface
         //
-        QOpenGLFramebufferObject fbo_volume(state.viewport, fbformat);
-        fbo_volume.bind();
+        GpuProfiler::Scope timer(profiler, GpuProfiler::gs_raycast);
+        targets.get_volume().bind();
 
         glDepthFunc(GL_ALWAYS);
         ogl.glDisable(GL_CULL_FACE);
 
-        if (!m_volume_program.bind())
-            qWarning() << "Unable to bind m_volume_program\n";
-
-        // enable the volume texture
-        ogl.glActiveTexture(GL_TEXTURE0);
-        m_volume_tex.bind();
-        m_volume_program.setUniformValue(m_voltex_param, 0);
-
-        // enable the ray endpoint textures
-        ogl.glActiveTexture(GL_TEXTURE0 + 1);
-        ogl.glBindTexture(GL_TEXTURE_2D, fbo_ray_start.texture());
-        m_volume_program.setUniformValue(m_ray_start_param, 1);
-
+        QOpenGLShaderProgram& program = m_paged ? m_paged_program :
+                                        (single_pass ? m_raycast_program : m_volume_program);
+        if (!program.bind())
+            qWarning() << "Unable to bind the volume ray casting program\n";
+
+        if (m_paged) {
+                // stream in the pages needed for this view, nearest to the eye first
+                QVector3D eye = 0.5f * modelview.inverted().map(QVector3D(0, 0, 0)) / m_scale +
+                                QVector3D(0.5f, 0.5f, 0.5f);
+                m_paging_complete = m_pager.update(tex_iso_value, eye, max_page_uploads);
+                m_pager.bind(program, 0, 4);
+        } else {
+                // enable the volume texture
+                ogl.glActiveTexture(GL_TEXTURE0);
+                m_volume_tex.bind();
+                program.setUniformValue("volume", 0);
+        }
 
-        ogl.glActiveTexture(GL_TEXTURE0 + 2);
-        ogl.glBindTexture(GL_TEXTURE_2D, fbo_ray_end.texture());
-        m_volume_program.setUniformValue(m_ray_end_param, 2);
+        if (single_pass) {
+                // the ray is evaluated from the inverse projection
+                program.setUniformValue("qt_mvp", mvp);
+                program.setUniformValue("qt_inv_mvp", mvp.inverted());
+                program.setUniformValue("box_scale", m_scale);
+        } else {
+                // enable the ray endpoint textures
+                ogl.glActiveTexture(GL_TEXTURE0 + 1);
+                ogl.glBindTexture(GL_TEXTURE_2D, targets.get_ray_start().texture());
+                program.setUniformValue(m_ray_start_param, 1);
+
+                ogl.glActiveTexture(GL_TEXTURE0 + 2);
+                ogl.glBindTexture(GL_TEXTURE_2D, targets.get_ray_end().texture());
+                program.setUniformValue(m_ray_end_param, 2);
+        }
 
-        // set iso-value; todo: use changable param
-        m_volume_program.setUniformValue(m_iso_value_param, m_iso_value);
+        // set iso-value in the value range of the texture
+        program.setUniformValue("iso_value", tex_iso_value);
+
+        // enable empty space skipping
+        ogl.glActiveTexture(GL_TEXTURE0 + 3);
+        m_brick_tex.bind();
+        program.setUniformValue("brick_grid", 3);
+        program.setUniformValue("brick_count", QVector3D(m_host.brick_grid_size.x, m_host.brick_grid_size.y,
+                                                         m_host.brick_grid_size.z));
+        program.setUniformValue("brick_size", brick_edge * m_gradient_delta);
+        // the brick grid is only conservative for the full resolution
+        program.setUniformValue("skip_empty_space", m_lod == 0);
+
+        program.setUniformValue("use_gradients", use_gradients);
+        if (use_gradients) {
+                ogl.glActiveTexture(GL_TEXTURE0 + 5);
+                m_gradient_tex.bind();
+                program.setUniformValue("gradients", 5);
+        }
+        program.setUniformValue("lod", float(m_lod));
+        program.setUniformValue("step_scale", m_step_scale);
+        program.setUniformValue("hit_refinement", m_hit_refinement);
 
         // set corrected light source
-        auto light_source_param = m_volume_program.uniformLocation("light_source");
         auto inv_normal = modelview.transposed();
 
         // this is really kind of stupid, but the 3x3 Maatrix doesn't implement multiplication with
         // a vector
         QVector4D l(state.light_source.x(), state.light_source.y(), state.light_source.z(), 0.0);
         QVector4D ls = inv_normal * l;
-        m_volume_program.setUniformValue(light_source_param, ls.toVector3D());
+        program.setUniformValue("light_source", ls.toVector3D());
 
         // bind buffers and draw
         m_vao_2nd_pass.bind();
@@ -500,21 +1225,10 @@ void VolumeDataImpl::do_draw(const GlobalSceneState& state, QOpenGLContext& cont
         m_indexBuf_2nd_pass.bind();
 
 
-        // consider putting this all into its own FBO class
         auto glex = context.extraFunctions();
 
-        // get FBO
-        GLuint space_coord_rb;
-
-        // attach a new renderbuffer for writing the texture coordinates
-        glex->glGenRenderbuffers(1, &space_coord_rb);
-        glex->glBindRenderbuffer(GL_RENDERBUFFER, space_coord_rb);
-        glex->glRenderbufferStorage(GL_RENDERBUFFER, GL_RGBA, state.viewport.width(), state.viewport.height());
-        glex->glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT1,
-                                        GL_RENDERBUFFER, space_coord_rb);
-
-
-        // Set both buffers to write and clear
+        // Set both buffers to write and clear, the texture coordinate
+        // render buffer is attached by the render target pool
         GLenum buffers[] = { GL_COLOR_ATTACHMENT0, GL_COLOR_ATTACHMENT1 };
         glex->glDrawBuffers(2, buffers);
 
@@ -525,32 +1239,102 @@ void VolumeDataImpl::do_draw(const GlobalSceneState& state, QOpenGLContext& cont
         ogl.glDrawElements(GL_TRIANGLE_FAN, 4, GL_UNSIGNED_SHORT, 0);
 
 
-        // grab the texture coordinates to have them for landmark picking
-        glex->glReadBuffer(GL_COLOR_ATTACHMENT1);
+        // the texture coordinates are kept in the render target and only
+        // read back when a pick is requested
+        program.release();
+        ogl.glBindFramebuffer(GL_FRAMEBUFFER, target_fbo);
 
-        // finish rendering before reading back
-        // this is no high-speed game, we can wait for glReadPixles
-        ogl.glFinish();
-        ogl.glReadPixels(0,0,state.viewport.width(), state.viewport.height(), GL_RGBA, GL_FLOAT, &m_tex_coordinates[0]);
+        m_vao_2nd_pass.release();
+        m_indexBuf_2nd_pass.release();
+        m_arrayBuf_2nd_pass.release();
 
-        // detach and release the render buffer
-        // should not be needed, since the fbo is destroyed when leaving the function ...
-        glex->glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT1,
-                                        GL_RENDERBUFFER, 0);
-        glex->glDeleteRenderbuffers(1, &space_coord_rb);
+        ogl.glActiveTexture(GL_TEXTURE3);
+        m_brick_tex.release();
 
-        // set read buffer to first render buffer
-        glex->glReadBuffer(GL_COLOR_ATTACHMENT0);
-        m_volume_program.release();
-        fbo_volume.release();
+        if (m_paged)
+                m_pager.release(0, 4);
 
-        ogl.glActiveTexture(GL_TEXTURE1);
-        ogl.glBindTexture(GL_TEXTURE_2D, 0);
-        ogl.glActiveTexture(GL_TEXTURE2);
-        ogl.glBindTexture(GL_TEXTURE_2D, 0);
+        if (use_gradients)
+                m_gradient_tex.release(5);
 
+        if (!single_pass) {
+                ogl.glActiveTexture(GL_TEXTURE1);
+                ogl.glBindTexture(GL_TEXTURE_2D, 0);
+                ogl.glActiveTexture(GL_TEXTURE2);
+                ogl.glBindTexture(GL_TEXTURE_2D, 0);
+        }
+}
 
-        // now blit it to the output surface (normally the screen)
+void VolumeDataImpl::do_draw(const GlobalSceneState& state, QOpenGLContext& context, GpuProfiler *profiler)
+{
+        auto modelview = state.get_modelview_matrix();
+        auto& ogl = *context.functions();
+
+        // the frame buffer to draw to is not necessarily the default one of the context
+        GLint target_fbo = 0;
+        ogl.glGetIntegerv(GL_FRAMEBUFFER_BINDING, &target_fbo);
+
+        bool single_pass = use_single_pass();
+
+        // the rays may be cast at a reduced resolution, the blit scales the image up
+        const bool reduced = m_resolution_scale < 1.0f;
+        QSize target_size = get_target_size(state.viewport);
+        RenderTargetPool& targets = reduced ? m_reduced_targets : m_targets;
+        m_drawn_targets = &targets;
+        m_drawn_scale = reduced ? m_resolution_scale : 1.0f;
+        m_width = target_size.width();
+        m_height = target_size.height();
+
+        // normally a no-op, the targets are resized when the viewport changes
+        bool reallocated = targets.resize(target_size, !single_pass);
+        auto& fbo_volume = targets.get_volume();
+        if (reduced)
+                ogl.glViewport(0, 0, target_size.width(), target_size.height());
+
+        // the normals are only uploaded when they are used the first time
+        bool use_gradients = m_use_gradients && m_host.gradients && !m_paged;
+        if (use_gradients && !m_gradient_tex.isCreated()) {
+                create_gradient_texture();
+                m_cache_valid = false;
+        }
+
+        // the last result is still in the volume target if nothing changed
+        // that affects the ray casting, e.g. if only the landmarks were edited
+        RenderKey key;
+        key.modelview = modelview;
+        key.projection = state.projection;
+        key.light_source = state.light_source;
+        key.size = target_size;
+        key.iso_value = m_iso_value * m_tex_iso_scale + m_tex_iso_shift;
+        key.lod = m_lod;
+        key.resolution_scale = m_resolution_scale;
+        key.step_scale = m_step_scale;
+        key.hit_refinement = m_hit_refinement;
+        key.single_pass = single_pass;
+        key.use_gradients = use_gradients;
+
+        if (!reallocated && m_cache_valid && key == m_cache_key) {
+                ++m_cache_hits;
+        } else {
+                ++m_cache_misses;
+                m_cache_key = key;
+                cast_rays(state, context, key, targets, target_fbo, profiler);
+
+                // an image with missing pages must be redrawn
+                m_cache_valid = !m_paged || m_paging_complete;
+        }
+
+        // bind buffers for drawing the screen quad
+        m_vao_2nd_pass.bind();
+        m_arrayBuf_2nd_pass.bind();
+        m_indexBuf_2nd_pass.bind();
+
+        // now blit it to the output surface (normally a frame of the render thread)
+        GpuProfiler::Scope timer(profiler, GpuProfiler::gs_blit);
+        if (reduced)
+                ogl.glViewport(0, 0, state.viewport.width(), state.viewport.height());
+        glDepthFunc(GL_ALWAYS);
+        ogl.glDisable(GL_CULL_FACE);
         ogl.glActiveTexture(GL_TEXTURE0);
         ogl.glBindTexture(GL_TEXTURE_2D, fbo_volume.texture());
 
@@ -563,3 +1347,8 @@ void VolumeDataImpl::do_draw(const GlobalSceneState& state, QOpenGLContext& cont
         m_indexBuf_2nd_pass.release();
         m_arrayBuf_2nd_pass.release();
 }
+
+bool VolumeDataImpl::use_single_pass() const
+{
+        return m_paged || (m_raycast_mode == VolumeData::rc_single_pass && m_raycast_program.isLinked());
+}
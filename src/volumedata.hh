@@ -25,6 +25,11 @@
 #include "drawable.hh"
 #include <mia/3d/image.hh>
 #include <QOpenGLBuffer>
+#include <QVector2D>
+#include <functional>
+#include <vector>
+
+class QThread;
 
 /**
   \brief Class for rendering an iso-surface from a volume data set
@@ -43,7 +48,73 @@ class VolumeData : public Drawable
 public:
         typedef std::shared_ptr<VolumeData> Pointer;
 
-        VolumeData(mia::P3DImage data);
+        /// The ray casting variants
+        enum ERaycastMode {
+                rc_two_pass,    /**< obtain the rays from rendering the volume box to two render targets */
+                rc_single_pass  /**< evaluate the rays analytically in the fragment shader (needs GLSL 1.40) */
+        };
+
+        /// How the voxel data is stored in the volume texture
+        enum ETexturePolicy {
+                tp_native, /**< keep 8 and 16 bit unsigned data in normalized integer textures */
+                tp_float   /**< always convert the data to float */
+        };
+
+        /// The type of the voxels stored in the volume texture
+        enum ETexelType {
+                tt_ubyte,  /**< original 8 bit data */
+                tt_ushort, /**< original 16 bit data */
+                tt_float   /**< data normalized to [0,1] */
+        };
+
+        /**
+          The preprocessed voxel data and its parameters as kept in host memory,
+          this is all that is needed to render the volume.
+        */
+        struct HostData {
+                mia::C3DBounds size;
+                mia::C3DFVector voxel_size;
+
+                /// intensity range of the original data
+                float min;
+                float max;
+
+                /// normalization of the original intensities to [0,1]
+                float intensity_scale;
+                float intensity_shift;
+
+                ETexelType texel_type;
+
+                /// the voxels, the pointer also owns the storage
+                std::shared_ptr<const void> voxels;
+
+                /// per brick intensity range in texture values for empty space skipping
+                mia::C3DBounds brick_grid_size;
+                std::vector<QVector2D> brick_minmax;
+
+                /// optional normals packed as RGB10A2, one 32 bit value per voxel
+                std::shared_ptr<const void> gradients;
+
+                /// size of the voxel buffer in bytes
+                size_t get_voxel_bytes() const;
+        };
+
+        /**
+          Callback to report the progress of the preprocessing as a fraction in [0,1],
+          if it returns false the preprocessing is cancelled.
+        */
+        typedef std::function<bool(float)> ProgressCallback;
+
+        /**
+          Prepare the volume data for rendering. This doesn't touch OpenGL and may be
+          run in a worker thread.
+          \throws QRuntimeExeption if the progress callback cancelled the preprocessing
+        */
+        VolumeData(mia::P3DImage data, ETexturePolicy policy = tp_native,
+                   ProgressCallback progress = ProgressCallback());
+
+        /// Create the volume from already preprocessed data
+        VolumeData(const HostData& data);
 
         ~VolumeData();
 
@@ -53,12 +124,128 @@ public:
 
         std::pair<int, int> get_intensity_range() const;
 
-        std::pair<bool, QVector3D> get_surface_coordinate(const QPoint& location) const;
+        /**
+          Start reading back the surface coordinates around the given
+          window location without waiting for the GPU. The result is obtained
+          by a later call to get_surface_coordinate. Requires the OpenGL
+          context to be current.
+        */
+        void request_pick(const QPoint& location);
+
+        /**
+          Get the volume coordinate of the surface rendered at the given window
+          location. If no pick was requested for this location, the read back is
+          started and waited for. Requires the OpenGL context to be current.
+        */
+        std::pair<bool, QVector3D> get_surface_coordinate(const QPoint& location);
 
         QVector3D get_viewspace_scale() const;
 
         QVector3D get_viewspace_shift() const;
 
+        /**
+          Select the ray casting mode, if the single pass mode is not supported
+          by the shader set in use the two pass mode is used.
+        */
+        void set_raycast_mode(ERaycastMode mode);
+
+        /// \returns the ray casting mode that is actually in use
+        ERaycastMode get_raycast_mode() const;
+
+        /**
+          Adapt the off-screen render targets to a new viewport size,
+          requires the OpenGL context to be current.
+        */
+        void resize_viewport(const QSize& size);
+
+        /**
+          Select the resolution level used for rendering, 0 is the full resolution
+          and each level halves the resolution. The level is clamped to the
+          available levels.
+        */
+        void set_lod(int level);
+
+        /// \returns the resolution level currently used for rendering
+        int get_lod() const;
+
+        /// \returns the number of resolution levels, only known after attaching to OpenGL
+        int get_lod_levels() const;
+
+        /**
+          Set the fraction of the viewport resolution the rays are cast with,
+          the image is scaled up when it is drawn. 1.0 casts one ray per pixel.
+        */
+        void set_resolution_scale(float scale);
+
+        /// \returns the fraction of the viewport resolution used for ray casting
+        float get_resolution_scale() const;
+
+        /**
+          Set how densely the rays are sampled.
+          \param step_scale step length relative to the voxel size, the default is 1.0
+          \param hit_refinement number of bisection steps used to locate the surface
+                 between the two samples enclosing it, the default is 0
+        */
+        void set_sampling(float step_scale, int hit_refinement);
+
+        /**
+          Set the texture memory the volume may use, volumes that are larger or
+          exceed the maximal 3D texture size are paged. Takes effect when the
+          volume is attached to OpenGL.
+        */
+        void set_texture_memory_budget(size_t bytes);
+
+        /// \returns whether the volume is streamed in pages
+        bool is_paged() const;
+
+        /// \returns false if the last frame was drawn while pages were still missing
+        bool is_complete() const;
+
+        /// number of render target allocations done so far
+        unsigned get_render_target_allocations() const;
+
+        /**
+          Number of frames that reused the ray casting result of the previous
+          frame, because the camera, the viewport, the iso value, and the
+          rendering quality were unchanged.
+        */
+        unsigned get_render_cache_hits() const;
+
+        /// number of frames that had to cast the rays
+        unsigned get_render_cache_misses() const;
+
+        /**
+          Move the Qt objects held for rendering to the given thread, this must
+          be called by the thread that created this object if it is not the one
+          that will render it.
+        */
+        void move_to_thread(QThread *thread);
+
+        /**
+          Evaluate the normals of the iso-surfaces for all voxels on the CPU. This
+          takes four bytes per voxel on the host and on the GPU. Like the constructor
+          it may be run in a worker thread before the volume is attached. It may also
+          run in a worker thread while the volume is rendered, as long as the normals
+          are not enabled by set_use_gradient_volume before it finished.
+          \throws QRuntimeExeption if the progress callback cancelled the evaluation
+        */
+        void create_gradient_volume(ProgressCallback progress = ProgressCallback());
+
+        /// \returns whether precomputed normals are available
+        bool has_gradient_volume() const;
+
+        /**
+          Shade the surface with the precomputed normals, which saves six texture
+          reads per hit. Only used if create_gradient_volume was called and the volume
+          isn't paged.
+        */
+        void set_use_gradient_volume(bool enable);
+
+        bool get_use_gradient_volume() const;
+
+        /// \returns the preprocessed data, e.g. for storing it in a cache
+        const HostData& get_host_data() const;
+
 private:
         void do_draw(const GlobalSceneState& state)override;
         void do_attach_gl() override;
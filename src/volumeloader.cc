@@ -0,0 +1,135 @@
+/* -*- mia-c++  -*-
+ *
+ * This file is part of qtlmpick- a tool for landmark picking and
+ * visualization in volume data
+ * Copyright (c) Genoa 2017,  Gert Wollny
+ *
+ * qtlmpick is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with MIA; if not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include "volumeloader.hh"
+#include "qruntimeexeption.hh"
+#include "volumecache.hh"
+#include <QCoreApplication>
+#include <mia/3d/imageio.hh>
+
+VolumeLoader::VolumeLoader(const QString& filename, QObject *parent):
+        QThread(parent),
+        m_filename(filename),
+        m_cancel(false),
+        m_create_gradients(false),
+        m_last_percent(-1)
+{
+}
+
+VolumeLoader::VolumeLoader(PVolumeData volume, QObject *parent):
+        QThread(parent),
+        m_volume(volume),
+        m_cancel(false),
+        m_create_gradients(true),
+        m_last_percent(-1)
+{
+}
+
+const QString& VolumeLoader::get_filename() const
+{
+        return m_filename;
+}
+
+PVolumeData VolumeLoader::get_result() const
+{
+        return m_result;
+}
+
+const QString& VolumeLoader::get_error() const
+{
+        return m_error;
+}
+
+bool VolumeLoader::was_cancelled() const
+{
+        return m_cancel;
+}
+
+void VolumeLoader::set_create_gradients(bool enable)
+{
+        m_create_gradients = enable;
+}
+
+void VolumeLoader::cancel()
+{
+        m_cancel = true;
+}
+
+bool VolumeLoader::report_progress(float fraction)
+{
+        int percent = static_cast<int>(100 * fraction);
+        if (percent != m_last_percent) {
+                m_last_percent = percent;
+                emit progress(percent);
+        }
+        return !m_cancel;
+}
+
+void VolumeLoader::run()
+{
+        try {
+                auto report = [this](float f) {
+                        return report_progress(f);
+                };
+
+                // the volume is rendered meanwhile, but it doesn't use the normals yet
+                if (m_volume) {
+                        m_volume->create_gradient_volume(report);
+                        m_result = m_volume;
+                        return;
+                }
+
+                VolumeCache cache;
+                auto volume = cache.load(m_filename);
+                if (volume) {
+                        if (m_create_gradients)
+                                volume->create_gradient_volume(report);
+                        volume->move_to_thread(QCoreApplication::instance()->thread());
+                        m_result = volume;
+                        return;
+                }
+
+                emit progress(-1);
+                auto image = mia::load_image3d(m_filename.toStdString());
+                if (m_cancel)
+                        return;
+                if (!image) {
+                        m_error = tr("Unable to read '%1'").arg(m_filename);
+                        return;
+                }
+
+                volume = std::make_shared<VolumeData>(image, VolumeData::tp_native, report);
+                cache.store(m_filename, *volume);
+                if (m_create_gradients)
+                        volume->create_gradient_volume(report);
+
+                // the volume is handed to the GUI thread, which passes it on to the render thread
+                volume->move_to_thread(QCoreApplication::instance()->thread());
+                m_result = volume;
+        }
+        catch (QRuntimeExeption& x) {
+                if (!m_cancel)
+                        m_error = x.qwhat();
+        }
+        catch (std::exception& x) {
+                m_error = x.what();
+        }
+}
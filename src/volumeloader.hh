@@ -0,0 +1,84 @@
+/* -*- mia-c++  -*-
+ *
+ * This file is part of qtlmpick- a tool for landmark picking and
+ * visualization in volume data
+ * Copyright (c) Genoa 2017,  Gert Wollny
+ *
+ * qtlmpick is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with MIA; if not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef VOLUMELOADER_HH
+#define VOLUMELOADER_HH
+
+#include "volumedata.hh"
+#include <QThread>
+#include <QString>
+#include <atomic>
+
+/**
+  \brief Loads and preprocesses a volume data set in a worker thread
+
+  The image is read and prepared for rendering in the thread, only the
+  texture upload is left to the OpenGL thread when the volume is attached
+  to the view. Prepared volumes are kept in the VolumeCache, so opening
+  the same file again only maps the cached data. The progress is
+  reported by the progress signal, and when the thread has finished the
+  result can be obtained by get_result.
+*/
+class VolumeLoader : public QThread
+{
+        Q_OBJECT
+public:
+        VolumeLoader(const QString& filename, QObject *parent = nullptr);
+
+        /// only evaluate the normals of a volume that is already loaded, see VolumeData::create_gradient_volume
+        VolumeLoader(PVolumeData volume, QObject *parent = nullptr);
+
+        const QString& get_filename() const;
+
+        /// the loaded volume, empty if loading failed or was cancelled
+        PVolumeData get_result() const;
+
+        /// the reason for failing to load the volume, empty on success
+        const QString& get_error() const;
+
+        bool was_cancelled() const;
+
+        /// also evaluate the normals of the volume, see VolumeData::create_gradient_volume
+        void set_create_gradients(bool enable);
+
+signals:
+        /// progress in percent, -1 while reading the file
+        void progress(int percent);
+
+public slots:
+        /// ask the loader to stop, the thread finishes at the next progress report
+        void cancel();
+
+private:
+        void run() override;
+
+        bool report_progress(float fraction);
+
+        QString m_filename;
+        PVolumeData m_volume;
+        PVolumeData m_result;
+        QString m_error;
+        std::atomic<bool> m_cancel;
+        bool m_create_gradients;
+        int m_last_percent;
+};
+
+#endif // VOLUMELOADER_HH
@@ -0,0 +1,408 @@
+/* -*- mia-c++  -*-
+ *
+ * This file is part of qtlmpick- a tool for landmark picking and
+ * visualization in volume data
+ * Copyright (c) Genoa 2017,  Gert Wollny
+ *
+ * qtlmpick is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with MIA; if not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include "volumepager.hh"
+#include <QOpenGLExtraFunctions>
+#include <QOpenGLTexture>
+#include <QVector4D>
+#include <QDebug>
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <cstring>
+#include <limits>
+
+using std::vector;
+
+// number of bricks of the host brick grid along each edge of a page
+static const unsigned bricks_per_page = 4;
+
+struct VolumePagerImpl {
+        VolumePagerImpl(unsigned brick_edge);
+
+        void create_page_ranges();
+        void find_needed_pages(float iso);
+        int get_slot();
+        void upload(unsigned page, int slot);
+
+        QOpenGLContext *m_context;
+        const VolumeData::HostData *m_host;
+        unsigned m_page_edge;
+        unsigned m_slot_edge;
+        size_t m_texel_size;
+        GLenum m_gl_type;
+
+        mia::C3DBounds m_page_grid;
+        vector<QVector2D> m_page_range;
+        vector<int> m_page_slot;
+        vector<unsigned> m_page_stamp;
+
+        // the atlas is a cube of m_slots_per_axis^3 slots
+        unsigned m_slots_per_axis;
+        vector<int> m_slot_page;
+        unsigned m_resident;
+
+        QOpenGLTexture m_atlas;
+        QOpenGLTexture m_page_table;
+        vector<QVector4D> m_page_table_data;
+        bool m_page_table_dirty;
+
+        float m_needed_iso;
+        vector<unsigned> m_needed;
+        unsigned m_frame;
+        bool m_atlas_full_reported;
+
+        vector<char> m_staging;
+};
+
+VolumePagerImpl::VolumePagerImpl(unsigned brick_edge):
+        m_context(nullptr),
+        m_host(nullptr),
+        m_page_edge(bricks_per_page * brick_edge),
+        m_slot_edge(m_page_edge + 2),
+        m_texel_size(4),
+        m_gl_type(GL_FLOAT),
+        m_slots_per_axis(0),
+        m_resident(0),
+        m_atlas(QOpenGLTexture::Target3D),
+        m_page_table(QOpenGLTexture::Target3D),
+        m_page_table_dirty(false),
+        m_needed_iso(-1.0f),
+        m_frame(0),
+        m_atlas_full_reported(false)
+{
+}
+
+VolumePager::VolumePager(unsigned brick_edge)
+{
+        impl = new VolumePagerImpl(brick_edge);
+}
+
+VolumePager::~VolumePager()
+{
+        delete impl;
+}
+
+unsigned VolumePager::get_page_edge() const
+{
+        return impl->m_page_edge;
+}
+
+unsigned VolumePager::get_resident_count() const
+{
+        return impl->m_resident;
+}
+
+bool VolumePager::needs_paging(const VolumeData::HostData& host, size_t budget)
+{
+        GLint max_size = 0;
+        QOpenGLContext::currentContext()->functions()->glGetIntegerv(GL_MAX_3D_TEXTURE_SIZE, &max_size);
+        GLuint max_3d = max_size;
+        return host.size.x > max_3d || host.size.y > max_3d || host.size.z > max_3d ||
+               host.get_voxel_bytes() > budget;
+}
+
+void VolumePager::attach_gl(QOpenGLContext *context, const VolumeData::HostData& host, size_t budget)
+{
+        impl->m_context = context;
+        impl->m_host = &host;
+
+        QOpenGLTexture::TextureFormat format = QOpenGLTexture::R32F;
+        switch (host.texel_type) {
+        case VolumeData::tt_ubyte:
+                format = QOpenGLTexture::R8_UNorm;
+                impl->m_gl_type = GL_UNSIGNED_BYTE;
+                impl->m_texel_size = 1;
+                break;
+        case VolumeData::tt_ushort:
+                format = QOpenGLTexture::R16_UNorm;
+                impl->m_gl_type = GL_UNSIGNED_SHORT;
+                impl->m_texel_size = 2;
+                break;
+        case VolumeData::tt_float:
+                impl->m_gl_type = GL_FLOAT;
+                impl->m_texel_size = 4;
+                break;
+        }
+
+        unsigned pe = impl->m_page_edge;
+        impl->m_page_grid = mia::C3DBounds((host.size.x + pe - 1) / pe,
+                                           (host.size.y + pe - 1) / pe,
+                                           (host.size.z + pe - 1) / pe);
+        const unsigned n_pages = impl->m_page_grid.product();
+        impl->create_page_ranges();
+        impl->m_page_slot.assign(n_pages, -1);
+        impl->m_page_stamp.assign(n_pages, 0);
+        impl->m_needed_iso = -1.0f;
+        impl->m_needed.clear();
+
+        // the largest cube of slots that fits into the budget and the maximal texture size,
+        // but not larger than needed to hold all pages
+        GLint max_size = 0;
+        context->functions()->glGetIntegerv(GL_MAX_3D_TEXTURE_SIZE, &max_size);
+        const unsigned se = impl->m_slot_edge;
+        const size_t slot_bytes = size_t(se) * se * se * impl->m_texel_size;
+        unsigned n = std::cbrt(double(std::max<size_t>(budget / slot_bytes, 1)));
+        n = std::min(n, unsigned(max_size) / se);
+        n = std::min(n, unsigned(std::ceil(std::cbrt(double(n_pages)))));
+        impl->m_slots_per_axis = std::max(n, 1u);
+        impl->m_slot_page.assign(impl->m_slots_per_axis * impl->m_slots_per_axis * impl->m_slots_per_axis, -1);
+        impl->m_resident = 0;
+        impl->m_atlas_full_reported = false;
+
+        const unsigned atlas_edge = impl->m_slots_per_axis * se;
+        qDebug() << "VolumePager:" << n_pages << "pages of" << pe << "^3 voxels, atlas of"
+                 << impl->m_slot_page.size() << "slots (" << atlas_edge << "^3 texels)";
+
+        impl->m_atlas.setFormat(format);
+        impl->m_atlas.setMinMagFilters(QOpenGLTexture::Linear, QOpenGLTexture::Linear);
+        impl->m_atlas.setWrapMode(QOpenGLTexture::ClampToEdge);
+        impl->m_atlas.setSize(atlas_edge, atlas_edge, atlas_edge);
+        impl->m_atlas.allocateStorage();
+
+        const auto& pg = impl->m_page_grid;
+        impl->m_page_table_data.assign(n_pages, QVector4D(0, 0, 0, 0));
+        impl->m_page_table.setFormat(QOpenGLTexture::RGBA32F);
+        impl->m_page_table.setMinMagFilters(QOpenGLTexture::Nearest, QOpenGLTexture::Nearest);
+        impl->m_page_table.setWrapMode(QOpenGLTexture::ClampToEdge);
+        impl->m_page_table.setSize(pg.x, pg.y, pg.z);
+        impl->m_page_table.allocateStorage();
+        impl->m_page_table.setData(QOpenGLTexture::RGBA, QOpenGLTexture::Float32, &impl->m_page_table_data[0]);
+        impl->m_page_table_dirty = false;
+}
+
+void VolumePager::detach_gl()
+{
+        impl->m_atlas.destroy();
+        impl->m_page_table.destroy();
+        impl->m_slot_page.clear();
+        impl->m_page_slot.assign(impl->m_page_slot.size(), -1);
+        impl->m_resident = 0;
+        impl->m_context = nullptr;
+}
+
+/* The range of a page is combined from the ranges of its bricks, these already
+ * include the adjacent voxels */
+void VolumePagerImpl::create_page_ranges()
+{
+        const auto& bg = m_host->brick_grid_size;
+        m_page_range.assign(m_page_grid.product(),
+                            QVector2D(std::numeric_limits<float>::max(), -std::numeric_limits<float>::max()));
+        auto b = m_host->brick_minmax.begin();
+        for (unsigned z = 0; z < bg.z; ++z)
+                for (unsigned y = 0; y < bg.y; ++y)
+                        for (unsigned x = 0; x < bg.x; ++x, ++b) {
+                                auto& r = m_page_range[((z / bricks_per_page) * m_page_grid.y + y / bricks_per_page) *
+                                                       m_page_grid.x + x / bricks_per_page];
+                                r.setX(std::min(r.x(), b->x()));
+                                r.setY(std::max(r.y(), b->y()));
+                        }
+}
+
+/* A ray stops at the iso-surface, hence it only reaches the pages that are
+ * crossed by the surface, and the pages inside the object that are entered
+ * from a page outside of it or from the volume boundary. Pages outside the
+ * object are leaped over by the empty space skipping. */
+void VolumePagerImpl::find_needed_pages(float iso)
+{
+        m_needed.clear();
+        m_needed_iso = iso;
+
+        const auto& pg = m_page_grid;
+        auto is_inside = [this, &pg, iso](int x, int y, int z) {
+                if (x < 0 || y < 0 || z < 0 || x >= int(pg.x) || y >= int(pg.y) || z >= int(pg.z))
+                        return false;
+                return m_page_range[(z * pg.y + y) * pg.x + x].x() >= iso;
+        };
+
+        unsigned page = 0;
+        for (int z = 0; z < int(pg.z); ++z)
+                for (int y = 0; y < int(pg.y); ++y)
+                        for (int x = 0; x < int(pg.x); ++x, ++page) {
+                                const auto& r = m_page_range[page];
+                                if (r.y() < iso)
+                                        continue;
+                                if (r.x() >= iso &&
+                                    is_inside(x - 1, y, z) && is_inside(x + 1, y, z) &&
+                                    is_inside(x, y - 1, z) && is_inside(x, y + 1, z) &&
+                                    is_inside(x, y, z - 1) && is_inside(x, y, z + 1))
+                                        continue;
+                                m_needed.push_back(page);
+                        }
+}
+
+/* Get a free slot, or the slot of the least recently needed page, that
+ * is not needed for the current frame */
+int VolumePagerImpl::get_slot()
+{
+        int best = -1;
+        unsigned best_stamp = m_frame;
+        for (unsigned slot = 0; slot < m_slot_page.size(); ++slot) {
+                int page = m_slot_page[slot];
+                if (page < 0)
+                        return slot;
+                if (m_page_stamp[page] < best_stamp) {
+                        best_stamp = m_page_stamp[page];
+                        best = slot;
+                }
+        }
+        if (best >= 0) {
+                int evicted = m_slot_page[best];
+                m_page_slot[evicted] = -1;
+                m_page_table_data[evicted] = QVector4D(0, 0, 0, 0);
+                m_slot_page[best] = -1;
+                --m_resident;
+        }
+        return best;
+}
+
+/* Copy the page with a one voxel apron to the slot, voxels outside of the
+ * volume are set to zero like the border color of the unpaged texture */
+void VolumePagerImpl::upload(unsigned page, int slot)
+{
+        const auto& size = m_host->size;
+        const unsigned se = m_slot_edge;
+        const size_t row_bytes = se * m_texel_size;
+        m_staging.resize(se * se * row_bytes);
+        std::fill(m_staging.begin(), m_staging.end(), 0);
+
+        unsigned px = page % m_page_grid.x;
+        unsigned py = (page / m_page_grid.x) % m_page_grid.y;
+        unsigned pz = page / (m_page_grid.x * m_page_grid.y);
+
+        // first voxel of the slot in volume coordinates, including the apron
+        int x0 = int(px * m_page_edge) - 1;
+        int y0 = int(py * m_page_edge) - 1;
+        int z0 = int(pz * m_page_edge) - 1;
+        int xs = std::max(x0, 0);
+        int xe = std::min(x0 + int(se), int(size.x));
+
+        auto voxels = static_cast<const char *>(m_host->voxels.get());
+        for (unsigned z = 0; z < se; ++z) {
+                int gz = z0 + int(z);
+                if (gz < 0 || gz >= int(size.z))
+                        continue;
+                for (unsigned y = 0; y < se; ++y) {
+                        int gy = y0 + int(y);
+                        if (gy < 0 || gy >= int(size.y))
+                                continue;
+                        size_t src = ((size_t(gz) * size.y + gy) * size.x + xs) * m_texel_size;
+                        size_t dst = (size_t(z) * se + y) * row_bytes + (xs - x0) * m_texel_size;
+                        memcpy(&m_staging[dst], voxels + src, (xe - xs) * m_texel_size);
+                }
+        }
+
+        unsigned sx = slot % m_slots_per_axis;
+        unsigned sy = (slot / m_slots_per_axis) % m_slots_per_axis;
+        unsigned sz = slot / (m_slots_per_axis * m_slots_per_axis);
+
+        auto glex = m_context->extraFunctions();
+        m_atlas.bind();
+        glex->glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+        glex->glTexSubImage3D(GL_TEXTURE_3D, 0, sx * se, sy * se, sz * se, se, se, se,
+                              GL_RED, m_gl_type, &m_staging[0]);
+        glex->glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+        m_atlas.release();
+
+        m_slot_page[slot] = page;
+        m_page_slot[page] = slot;
+        m_page_table_data[page] = QVector4D(sx, sy, sz, 1);
+        m_page_table_dirty = true;
+        ++m_resident;
+}
+
+bool VolumePager::update(float iso, const QVector3D& eye, unsigned max_uploads)
+{
+        assert(impl->m_context);
+
+        if (iso != impl->m_needed_iso)
+                impl->find_needed_pages(iso);
+
+        // front to back, so that the visible pages arrive first
+        const auto& pg = impl->m_page_grid;
+        const auto& size = impl->m_host->size;
+        const QVector3D page_scale(float(impl->m_page_edge) / size.x, float(impl->m_page_edge) / size.y,
+                                   float(impl->m_page_edge) / size.z);
+        auto distance = [&pg, &page_scale, &eye](unsigned page) {
+                QVector3D center(page % pg.x + 0.5f, (page / pg.x) % pg.y + 0.5f, page / (pg.x * pg.y) + 0.5f);
+                return (center * page_scale - eye).lengthSquared();
+        };
+        std::sort(impl->m_needed.begin(), impl->m_needed.end(),
+                  [&distance](unsigned a, unsigned b) { return distance(a) < distance(b); });
+
+        ++impl->m_frame;
+        for (auto page: impl->m_needed)
+                impl->m_page_stamp[page] = impl->m_frame;
+
+        bool complete = true;
+        unsigned uploads = 0;
+        for (auto page: impl->m_needed) {
+                if (impl->m_page_slot[page] >= 0)
+                        continue;
+                if (uploads == max_uploads) {
+                        complete = false;
+                        break;
+                }
+                int slot = impl->get_slot();
+                if (slot < 0) {
+                        // all slots hold pages needed for this frame
+                        if (!impl->m_atlas_full_reported) {
+                                qWarning() << "VolumePager: the atlas can not hold all" << impl->m_needed.size()
+                                           << "needed pages, increase the texture memory budget";
+                                impl->m_atlas_full_reported = true;
+                        }
+                        break;
+                }
+                impl->upload(page, slot);
+                ++uploads;
+        }
+
+        if (impl->m_page_table_dirty) {
+                impl->m_page_table.setData(QOpenGLTexture::RGBA, QOpenGLTexture::Float32,
+                                           &impl->m_page_table_data[0]);
+                impl->m_page_table_dirty = false;
+        }
+        return complete;
+}
+
+void VolumePager::bind(QOpenGLShaderProgram& program, int atlas_unit, int page_table_unit)
+{
+        auto ogl = impl->m_context->functions();
+        ogl->glActiveTexture(GL_TEXTURE0 + atlas_unit);
+        impl->m_atlas.bind();
+        program.setUniformValue("volume", atlas_unit);
+
+        ogl->glActiveTexture(GL_TEXTURE0 + page_table_unit);
+        impl->m_page_table.bind();
+        program.setUniformValue("page_table", page_table_unit);
+
+        const auto& size = impl->m_host->size;
+        float atlas_edge = impl->m_slots_per_axis * impl->m_slot_edge;
+        program.setUniformValue("volume_size", QVector3D(size.x, size.y, size.z));
+        program.setUniformValue("page_size", float(impl->m_page_edge));
+        program.setUniformValue("atlas_size", QVector3D(atlas_edge, atlas_edge, atlas_edge));
+}
+
+void VolumePager::release(int atlas_unit, int page_table_unit)
+{
+        impl->m_atlas.release(atlas_unit);
+        impl->m_page_table.release(page_table_unit);
+}
@@ -0,0 +1,84 @@
+/* -*- mia-c++  -*-
+ *
+ * This file is part of qtlmpick- a tool for landmark picking and
+ * visualization in volume data
+ * Copyright (c) Genoa 2017,  Gert Wollny
+ *
+ * qtlmpick is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with MIA; if not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef VOLUMEPAGER_HH
+#define VOLUMEPAGER_HH
+
+#include "volumedata.hh"
+#include <QOpenGLContext>
+#include <QOpenGLShaderProgram>
+
+/**
+  \brief Streams the bricks of a volume into a fixed size texture atlas
+
+  Volumes that exceed the maximal 3D texture size or the texture memory
+  budget are split into pages of page_edge^3 voxels. The pages are copied
+  on demand, with a one voxel apron for the interpolation, into the slots
+  of an atlas texture, and a page table texture maps each page of the
+  volume to its slot. Only the pages that can be reached by a ray before
+  it hits the iso-surface are needed: pages that are crossed by the
+  iso-surface, and pages inside the object that border on such pages.
+  These are streamed in front to back, a limited number per frame, and
+  the least recently needed pages are evicted when the atlas is full.
+*/
+class VolumePager
+{
+public:
+        /// \param brick_edge edge length of the bricks of the host data's brick grid
+        VolumePager(unsigned brick_edge);
+        ~VolumePager();
+
+        /// edge length of a page in voxels
+        unsigned get_page_edge() const;
+
+        /**
+          \returns whether the volume needs to be paged, i.e. whether it doesn't fit into a
+          3D texture or is larger than the memory budget. Requires a current context.
+        */
+        static bool needs_paging(const VolumeData::HostData& host, size_t budget);
+
+        /// Create the atlas of at most budget bytes and the page table
+        void attach_gl(QOpenGLContext *context, const VolumeData::HostData& host, size_t budget);
+
+        void detach_gl();
+
+        /**
+          Stream in the pages needed for the given iso value.
+          \param iso the iso value in texture values
+          \param eye the eye position in texture coordinates, nearer pages are loaded first
+          \param max_uploads the maximal number of pages copied by this call
+          \returns true if all needed pages are resident
+        */
+        bool update(float iso, const QVector3D& eye, unsigned max_uploads);
+
+        /// Bind the atlas and the page table and set the paging uniforms of the program
+        void bind(QOpenGLShaderProgram& program, int atlas_unit, int page_table_unit);
+
+        void release(int atlas_unit, int page_table_unit);
+
+        /// number of pages currently held in the atlas
+        unsigned get_resident_count() const;
+
+private:
+        struct VolumePagerImpl *impl;
+};
+
+#endif // VOLUMEPAGER_HH